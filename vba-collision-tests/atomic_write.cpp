@@ -0,0 +1,23 @@
+#include <string>
+#include <unistd.h>
+
+#include "atomic_write.hpp"
+
+
+bool replace_file_atomically(const char* path, const std::function<void(FILE*)>& write)
+{
+    std::string tmp_path = std::string(path) + ".new";
+
+    FILE* file = fopen(tmp_path.c_str(), "w");
+    if (!file) return false;
+
+    write(file);
+
+    bool ok = !ferror(file) && 0 == fflush(file) && 0 == fsync(fileno(file));
+    ok = 0 == fclose(file) && ok;
+
+    if (ok && 0 == rename(tmp_path.c_str(), path)) return true;
+
+    unlink(tmp_path.c_str());
+    return false;
+}
@@ -0,0 +1,16 @@
+#ifndef _ATOMIC_WRITE_H_
+#define _ATOMIC_WRITE_H_
+
+#include <functional>
+#include <stdio.h>
+
+
+/*
+ * Has 'write' fill a new file beside 'path', syncs it and renames it over 'path', so
+ *   a crash at any point leaves either the old contents or the new ones. False if any
+ *   step fails; 'path' is then untouched.
+ */
+bool replace_file_atomically(const char* path, const std::function<void(FILE*)>& write);
+
+
+#endif /* _ATOMIC_WRITE_H_ */
@@ -0,0 +1,278 @@
+#include <chrono>
+#include <map>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "collision_pool.hpp"
+
+
+CollisionPool::CollisionPool(unsigned int threads)
+{
+    if (!threads) threads = std::thread::hardware_concurrency();
+    if (!threads) threads = 1;
+
+    inflight.reset(new collision_inflight_t[threads]);
+    stats.resize(threads);
+    active = threads;
+
+    for (unsigned int i = 0; i < threads; ++i)
+        inflight[i].mark.store(0, std::memory_order_relaxed);
+
+    for (unsigned int i = 0; i < threads; ++i)
+        workers.emplace_back(&CollisionPool::_Work, this, i);
+}
+
+CollisionPool::~CollisionPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+
+void CollisionPool::SetActive(unsigned int count)
+{
+    if (!count || count > Threads()) count = Threads();
+    active = count;
+}
+
+
+void CollisionPool::Run(uint64_t first, uint64_t last, uint64_t chunk_size, chunk_fn chunk_job,
+                        const CancellationToken* cancel_token)
+{
+    Run(Split(first, last, chunk_size, Active()), chunk_size, chunk_job, cancel_token);
+}
+
+std::vector<collision_slice_t> CollisionPool::Split(uint64_t first, uint64_t last, uint64_t chunk, unsigned int parts)
+{
+    std::vector<collision_slice_t> slices;
+    if (!chunk) chunk = 1;
+    if (!parts) parts = 1;
+
+    /* Whole chunks, so no chunk straddles two slices. */
+    uint64_t chunks = (last - first + chunk - 1) / chunk;
+    for (unsigned int i = 0; i < parts; ++i) {
+        uint64_t from = first + chunks * i / parts * chunk;
+        uint64_t to = first + chunks * (i + 1) / parts * chunk;
+        if (from < last) slices.push_back({ from, to < last ? to : last });
+    }
+
+    return slices;
+}
+
+void CollisionPool::Run(const std::vector<collision_slice_t>& slices,
+                        uint64_t chunk_size,
+                        chunk_fn chunk_job,
+                        const CancellationToken* cancel_token,
+                        progress_fn progress,
+                        std::chrono::milliseconds interval)
+{
+    if (!chunk_size) chunk_size = 1;
+
+    /* Workers are all parked here, so the ranges can be replaced freely. */
+    if (slices.size() > range_capacity) {
+        ranges.reset(new collision_range_t[slices.size()]);
+        range_capacity = slices.size();
+    }
+    range_count = slices.size();
+
+    for (size_t r = 0; r < range_count; ++r) {
+        ranges[r].next.store(slices[r].first, std::memory_order_relaxed);
+        ranges[r].end = slices[r].last;
+    }
+    for (unsigned int i = 0; i < Threads(); ++i) {
+        inflight[i].mark.store(0, std::memory_order_relaxed);
+        stats[i] = {};
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    job = chunk_job;
+    chunk = chunk_size;
+    cancel = cancel_token;
+    running = active;
+    ++generation;
+    wake.notify_all();
+
+    auto finished = [this]() { return !running; };
+    if (progress && interval.count() > 0) {
+        while (!done.wait_for(guard, interval, finished)) {
+            guard.unlock();
+            progress(Remaining());
+            guard.lock();
+        }
+    } else {
+        done.wait(guard, finished);
+    }
+
+    job = nullptr;
+    cancel = nullptr;
+}
+
+
+std::vector<collision_slice_t> CollisionPool::Remaining() const
+{
+    std::vector<collision_slice_t> remaining;
+
+    /* 'next' first: a claim that moved it had already published its in-flight mark. */
+    for (size_t r = 0; r < range_count; ++r) {
+        uint64_t low = ranges[r].next.load();
+        if (low > ranges[r].end) low = ranges[r].end;
+
+        for (unsigned int i = 0; i < Threads(); ++i) {
+            uint64_t mark = inflight[i].mark.load();
+            if (mark >> COLLISION_INFLIGHT_SHIFT == r + 1 && (mark & COLLISION_VALUE_MASK) < low)
+                low = mark & COLLISION_VALUE_MASK;
+        }
+
+        if (low < ranges[r].end) remaining.push_back({ low, ranges[r].end });
+    }
+
+    return remaining;
+}
+
+
+bool CollisionPool::_Claim(unsigned int id, uint64_t* first, uint64_t* last, bool* stolen)
+{
+    if (!range_count) return false;
+
+    size_t home = id % range_count, r = home;
+    std::atomic<uint64_t>& mark = inflight[id].mark;
+    *stolen = false;
+
+    for (;;) {
+        collision_range_t* range = &ranges[r];
+        uint64_t tag = (uint64_t)(r + 1) << COLLISION_INFLIGHT_SHIFT;
+
+        /* Claims are sequentially consistent with the mark, for 'Remaining'. */
+        uint64_t next = range->next.load();
+        mark.store(tag | (next < range->end ? next : range->end));
+        uint64_t from = range->next.fetch_add(chunk);
+        if (from < range->end) {
+            mark.store(tag | from);
+            *first = from;
+            *last = from + chunk < range->end ? from + chunk : range->end;
+            return true;
+        }
+
+        /* Steal from the fullest slice; a lost race just means looking again. */
+        size_t victim = range_count;
+        uint64_t most = 0;
+        for (size_t i = 0; i < range_count; ++i) {
+            uint64_t next = ranges[i].next.load(std::memory_order_relaxed);
+            if (next < ranges[i].end && ranges[i].end - next > most) {
+                most = ranges[i].end - next;
+                victim = i;
+            }
+        }
+
+        if (victim == range_count) {
+            mark.store(0);
+            return false;
+        }
+
+        r = victim;
+        *stolen = r != home;
+    }
+}
+
+void CollisionPool::_Work(unsigned int id)
+{
+    uint64_t seen = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&]() { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            if (id >= active) continue;
+        }
+
+        collision_worker_stats_t* mine = &stats[id];
+        auto start = std::chrono::steady_clock::now();
+
+        uint64_t first, last;
+        bool stolen;
+        while (!(cancel && cancel->Cancelled()) && _Claim(id, &first, &last, &stolen)) {
+            ++mine->chunks;
+            mine->stolen += stolen;
+            mine->candidates += last - first;
+
+            if (!job(id, first, last)) break;
+        }
+
+        mine->busy_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (!--running) done.notify_all();
+    }
+}
+
+
+bool CollisionPool::Pin(const CpuTopology& topology, bool spread)
+{
+    std::vector<int> pinned(workers.size());
+
+    for (unsigned int i = 0; i < workers.size(); ++i) {
+        int cpu = topology.CpuFor(i, spread);
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+
+        int error = pthread_setaffinity_np(workers[i].native_handle(), sizeof(set), &set);
+        if (error) {
+            fprintf(stderr, "Cannot pin worker %u to CPU %d: %s\n", i, cpu, strerror(error));
+            return false;
+        }
+        pinned[i] = topology.NodeOf(cpu);
+    }
+
+    nodes = pinned;
+    return true;
+}
+
+
+void CollisionPool::PrintBalance() const
+{
+    uint64_t chunks = 0, stolen = 0, busy_min = UINT64_MAX, busy_max = 0, busy_total = 0;
+
+    for (unsigned int i = 0; i < active; ++i) {
+        const collision_worker_stats_t& s = stats[i];
+        chunks += s.chunks;
+        stolen += s.stolen;
+        busy_total += s.busy_ns;
+        if (s.busy_ns < busy_min) busy_min = s.busy_ns;
+        if (s.busy_ns > busy_max) busy_max = s.busy_ns;
+    }
+
+    /* Max over mean busy time: 1.00 is perfect balance. */
+    double mean = (double)busy_total / active;
+    printf("\n\t\tPool: %u of %u workers, %lu chunks (%lu stolen), busy %.3f-%.3f s, imbalance %.2f",
+           active, Threads(), chunks, stolen, busy_min / 1e9, busy_max / 1e9, mean > 0 ? busy_max / mean : 1.0);
+
+    if (nodes.empty()) return;
+
+    /* Per node: workers, MACs, and MACs per second of the node's busiest worker. */
+    std::map<int, collision_worker_stats_t> per_node;
+    std::map<int, unsigned int> node_workers;
+    for (unsigned int i = 0; i < active; ++i) {
+        collision_worker_stats_t& node = per_node[nodes[i]];
+        node.candidates += stats[i].candidates;
+        if (stats[i].busy_ns > node.busy_ns) node.busy_ns = stats[i].busy_ns;
+        ++node_workers[nodes[i]];
+    }
+
+    for (const auto& node : per_node)
+        printf("\n\t\t\tNode %d: %u workers, %lu MACs, %.0f MACs/s",
+               node.first, node_workers[node.first], node.second.candidates,
+               node.second.busy_ns ? node.second.candidates * 1e9 / node.second.busy_ns : 0.0);
+}
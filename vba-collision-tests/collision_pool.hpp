@@ -0,0 +1,175 @@
+#ifndef _COLLISION_POOL_H_
+#define _COLLISION_POOL_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+#include "cpu_topology.hpp"
+
+
+/*
+ * Each worker starts on its own slice of the range and claims chunks from the front
+ *   of it. Once that slice is empty it steals chunks from whichever slice has the
+ *   most left, so reserved MAC ranges or a busy core never leave a thread idle while
+ *   work remains.
+ */
+typedef struct alignas(64) _collision_range {
+    std::atomic<uint64_t> next;
+    uint64_t end;
+} collision_range_t;
+
+/*
+ * A lower bound on the chunk a worker is working on: (range index + 1) << 52 | first
+ *   value, or zero when it holds none. Set before every claim, so a chunk is never
+ *   taken without being covered by one. Range values must stay at or below 2^52 - 1
+ *   (the whole MAC space fits) and there can be at most 4095 slices.
+ */
+typedef struct alignas(64) _collision_inflight {
+    std::atomic<uint64_t> mark;
+} collision_inflight_t;
+
+#define COLLISION_INFLIGHT_SHIFT  52
+#define COLLISION_VALUE_MASK      ((1ULL << COLLISION_INFLIGHT_SHIFT) - 1)
+
+typedef struct _collision_slice {
+    uint64_t first;
+    uint64_t last;
+} collision_slice_t;
+
+/*
+ * Cancelled at most once, by whoever first has a reason to stop everyone. 'Cancel'
+ *   returns true only for that caller, which may then write its result without
+ *   racing anyone; readers see it after 'CollisionPool::Run' returns. Workers poll
+ *   'Cancelled' with a single load, so checking it once per candidate is free next
+ *   to a key derivation.
+ */
+class CancellationToken
+{
+public:
+    bool Cancel()
+    {
+        if (cancelled.exchange(true, std::memory_order_acq_rel)) return false;
+        cancelled_at = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    bool Cancelled() const { return cancelled.load(std::memory_order_acquire); }
+
+    /* Only valid once the work that could cancel has finished. */
+    std::chrono::steady_clock::time_point CancelledAt() const { return cancelled_at; }
+
+    void Reset() { cancelled.store(false, std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> cancelled{false};
+    std::chrono::steady_clock::time_point cancelled_at;
+};
+
+
+typedef struct _collision_worker_stats {
+    uint64_t chunks;
+    uint64_t stolen;       /* Chunks taken from another worker's slice. */
+    uint64_t candidates;
+    uint64_t busy_ns;
+} collision_worker_stats_t;
+
+
+class CollisionPool
+{
+public:
+    /* Called once per claimed chunk [first, last). Returning false stops that worker. */
+    typedef std::function<bool(unsigned int worker, uint64_t first, uint64_t last)> chunk_fn;
+
+    /* Called on the thread inside 'Run' with what is not yet known to be done. */
+    typedef std::function<void(const std::vector<collision_slice_t>& remaining)> progress_fn;
+
+    /* Zero threads means one per hardware thread. */
+    explicit CollisionPool(unsigned int threads = 0);
+    ~CollisionPool();
+
+    CollisionPool(const CollisionPool&) = delete;
+    CollisionPool& operator=(const CollisionPool&) = delete;
+
+    unsigned int Threads() const { return (unsigned int)workers.size(); }
+
+    /*
+     * How many of the workers take part in the next 'Run', from 1 to 'Threads'; the
+     *   rest stay parked. Memory-hard KDFs often run fastest on fewer threads than the
+     *   machine has. Only call it between runs.
+     */
+    void SetActive(unsigned int count);
+    unsigned int Active() const { return active; }
+
+    /*
+     * Runs 'job' over all of [first, last) in 'chunk'-sized pieces and waits for it.
+     *   With a token, no chunk is handed out once it is cancelled.
+     */
+    void Run(uint64_t first, uint64_t last, uint64_t chunk, chunk_fn job, const CancellationToken* cancel = nullptr);
+
+    /*
+     * As above over any set of slices, e.g. the remainder of an interrupted run, with
+     *   'progress' called every 'interval' while the workers are busy.
+     */
+    void Run(const std::vector<collision_slice_t>& slices,
+             uint64_t chunk,
+             chunk_fn job,
+             const CancellationToken* cancel = nullptr,
+             progress_fn progress = nullptr,
+             std::chrono::milliseconds interval = std::chrono::milliseconds(0));
+
+    /*
+     * Safe to call while a run is under way. Everything in the slices' ranges outside
+     *   the returned slices has been handed to 'job' and returned from it; work still
+     *   in flight is included, so at most one chunk per worker is done twice on resume.
+     */
+    std::vector<collision_slice_t> Remaining() const;
+
+    /* [first, last) cut into 'parts' home slices of whole chunks. */
+    static std::vector<collision_slice_t> Split(uint64_t first, uint64_t last, uint64_t chunk, unsigned int parts);
+
+    /*
+     * Binds each worker to one CPU of 'topology' (see 'CpuTopology::CpuFor'). Memory a
+     *   pinned worker touches first, such as its KDF arena, stays on its own node.
+     */
+    bool Pin(const CpuTopology& topology, bool spread);
+
+    /* Per-worker figures for the last 'Run'; parked workers' stay zero. */
+    const std::vector<collision_worker_stats_t>& LastStats() const { return stats; }
+
+    /* Once pinned, also each node's share, to show how the search scales across sockets. */
+    void PrintBalance() const;
+
+private:
+    void _Work(unsigned int id);
+    bool _Claim(unsigned int id, uint64_t* first, uint64_t* last, bool* stolen);
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<collision_range_t[]> ranges;
+    std::unique_ptr<collision_inflight_t[]> inflight;
+    size_t range_count = 0;
+    size_t range_capacity = 0;
+    std::vector<collision_worker_stats_t> stats;
+    std::vector<int> nodes;   /* Each worker's NUMA node; empty until 'Pin'. */
+    unsigned int active = 0;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    unsigned int running = 0;
+    bool stopping = false;
+
+    chunk_fn job;
+    uint64_t chunk = 1;
+    const CancellationToken* cancel = nullptr;
+};
+
+
+#endif /* _COLLISION_POOL_H_ */
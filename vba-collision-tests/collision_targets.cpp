@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "collision_targets.hpp"
+#include "mac_exclusions.hpp"
+#include "vba.h"
+
+
+CollisionTargets::CollisionTargets(const std::vector<collision_target_t>& targets)
+{
+    for (const auto& target : targets)
+        Insert(target);
+}
+
+
+void CollisionTargets::_Grow()
+{
+    size_t capacity = slots ? (mask + 1) * 2 : 16;
+    std::unique_ptr<collision_target_t[]> old(slots.release());
+    size_t old_capacity = old ? mask + 1 : 0;
+
+    slots.reset(new collision_target_t[capacity]());
+    mask = capacity - 1;
+    shift = 64 - __builtin_ctzll(capacity);
+    count = 0;
+
+    for (size_t i = 0; i < old_capacity; ++i)
+        if (old[i].suffix != COLLISION_TARGETS_EMPTY)
+            Insert(old[i]);
+}
+
+bool CollisionTargets::Insert(const collision_target_t& target)
+{
+    if (target.suffix == COLLISION_TARGETS_EMPTY) return false;
+
+    /* At most half full keeps miss chains short. */
+    if (!slots || (count + 1) * 2 > mask + 1) _Grow();
+
+    size_t slot = _Slot(target.suffix);
+    for (; slots[slot].suffix != COLLISION_TARGETS_EMPTY; slot = (slot + 1) & mask)
+        if (slots[slot].suffix == target.suffix) return false;
+
+    slots[slot] = target;
+    ++count;
+    return true;
+}
+
+
+bool CollisionTargets::LoadFile(const char* path, std::vector<collision_target_t>* targets)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot open targets file '%s'.\n", path);
+        return false;
+    }
+
+    char line[256];
+    for (unsigned long number = 1; fgets(line, sizeof(line), file); ++number) {
+        size_t length = strcspn(line, "\r\n");
+        line[length] = '\0';
+        if (!length || '#' == line[0]) continue;
+
+        char* comma = strchr(line, ',');
+        size_t address_length = comma ? (size_t)(comma - line) : length;
+
+        collision_target_t target = { 0, 0 };
+        if (0 != parse_lladdr(line, address_length, &target.suffix)) {
+            fprintf(stderr, "%s:%lu: not an address: '%s'\n", path, number, line);
+            continue;
+        }
+
+        if (comma && !parse_mac(comma + 1, &target.mac)) {
+            fprintf(stderr, "%s:%lu: not a MAC address: '%s'\n", path, number, comma + 1);
+            continue;
+        }
+
+        targets->push_back(target);
+    }
+
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef _COLLISION_TARGETS_H_
+#define _COLLISION_TARGETS_H_
+
+#include <memory>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Suffixes an attacker would be happy to collide with: every neighbour with the same
+ *   iteration count, not just one. Kept in an open-addressed table at most half full
+ *   so a miss, which is nearly every candidate, usually costs one probe of one cache
+ *   line. Suffixes are KDF output, so a multiply-shift of the key is hash enough.
+ */
+#define COLLISION_TARGETS_EMPTY  0ULL   /* Only 0xFFFF iterations and an all-zero hash make it. */
+
+typedef struct _collision_target {
+    uint64_t suffix;
+    uint64_t mac;     /* Whose address it is, for the report; 0 if unknown. */
+} collision_target_t;
+
+
+class CollisionTargets
+{
+public:
+    CollisionTargets() = default;
+    explicit CollisionTargets(const std::vector<collision_target_t>& targets);
+
+    /* False for duplicates and for the reserved empty value. */
+    bool Insert(const collision_target_t& target);
+
+    size_t Size() const { return count; }
+
+    inline const collision_target_t* Find(uint64_t suffix) const
+    {
+        if (!count) return nullptr;
+
+        for (size_t slot = _Slot(suffix); ; slot = (slot + 1) & mask) {
+            if (slots[slot].suffix == suffix) return &slots[slot];
+            if (slots[slot].suffix == COLLISION_TARGETS_EMPTY) return nullptr;
+        }
+    }
+
+    /*
+     * One target per line: an address as 'parse_lladdr' reads it, optionally followed
+     *   by ",<mac>" naming its owner. Blank lines and '#' comments are skipped.
+     *   Returns false if the file cannot be read; bad lines are reported and skipped.
+     */
+    static bool LoadFile(const char* path, std::vector<collision_target_t>* targets);
+
+private:
+    inline size_t _Slot(uint64_t suffix) const
+    {
+        return (size_t)((suffix * 0x9E3779B97F4A7C15ULL) >> shift);
+    }
+
+    void _Grow();
+
+    std::unique_ptr<collision_target_t[]> slots;
+    size_t count = 0;
+    size_t mask = 0;
+    unsigned int shift = 64;
+};
+
+
+#endif /* _COLLISION_TARGETS_H_ */
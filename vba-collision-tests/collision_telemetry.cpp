@@ -0,0 +1,251 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "collision_telemetry.hpp"
+#include "coordinator.hpp"
+
+
+CollisionTelemetry::CollisionTelemetry(unsigned int workers)
+    : workers(workers), counters(new telemetry_counter_t[workers])
+{
+    for (unsigned int i = 0; i < workers; ++i)
+        counters[i].candidates.store(0, std::memory_order_relaxed);
+
+    sampled.assign(workers, 0);
+    rates.assign(workers, 0.0);
+    printed.assign(workers, 0);
+    sampled_at = printed_at = std::chrono::steady_clock::now();
+}
+
+CollisionTelemetry::~CollisionTelemetry()
+{
+    if (thread.joinable()) {
+        char stop = 0;
+        while (write(wake[1], &stop, 1) < 0 && EINTR == errno) {}
+        thread.join();
+    }
+
+    if (listener >= 0) close(listener);
+    if (wake[0] >= 0) close(wake[0]);
+    if (wake[1] >= 0) close(wake[1]);
+}
+
+
+bool CollisionTelemetry::Start(std::chrono::seconds every, const char* metrics_address)
+{
+    if (thread.joinable()) return true;
+    if (!every.count() && !metrics_address) return true;
+
+    interval = every;
+    if (metrics_address && (listener = LineSocket::Listen(metrics_address)) < 0)
+        return false;
+
+    /* The thread sleeps in poll(); a byte on this pipe wakes it to stop. */
+    if (0 != pipe2(wake, O_CLOEXEC)) {
+        fprintf(stderr, "Cannot start telemetry: %s\n", strerror(errno));
+        return false;
+    }
+
+    thread = std::thread(&CollisionTelemetry::_Run, this);
+    return true;
+}
+
+
+void CollisionTelemetry::BeginPhase(const std::string& name, uint64_t total, unsigned int active)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    phase = name;
+    phase_total = total;
+    phase_workers = active && active < workers ? active : workers;
+    phase_base = 0;
+    for (unsigned int i = 0; i < workers; ++i) {
+        printed[i] = counters[i].candidates.load(std::memory_order_relaxed);
+        phase_base += printed[i];
+    }
+
+    phase_start = printed_at = std::chrono::steady_clock::now();
+    active = true;
+}
+
+void CollisionTelemetry::EndPhase()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    active = false;
+}
+
+
+void CollisionTelemetry::_Run()
+{
+    auto now = std::chrono::steady_clock::now();
+    auto next_sample = now + TELEMETRY_SAMPLE_EVERY;
+
+    for (;;) {
+        struct pollfd fds[2] = { { wake[0], POLLIN, 0 }, { listener, POLLIN, 0 } };
+        int timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(next_sample - now).count();
+
+        int ready = poll(fds, listener >= 0 ? 2 : 1, timeout > 0 ? timeout : 0);
+        if (ready < 0 && EINTR != errno) break;
+        if (ready > 0 && fds[0].revents) break;
+        if (ready > 0 && fds[1].revents) _Serve();
+
+        now = std::chrono::steady_clock::now();
+        if (now < next_sample) continue;
+
+        next_sample = now + TELEMETRY_SAMPLE_EVERY;
+        _Sample();
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (active && interval.count() && now - printed_at >= interval) _Print();
+    }
+}
+
+void CollisionTelemetry::_Sample()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - sampled_at).count();
+
+    for (unsigned int i = 0; i < workers; ++i) {
+        uint64_t candidates = counters[i].candidates.load(std::memory_order_relaxed);
+        rates[i] = seconds > 0 ? (candidates - sampled[i]) / seconds : 0.0;
+        sampled[i] = candidates;
+    }
+    sampled_at = now;
+}
+
+
+/* Days, or years once that stops being readable. */
+static std::string _format_duration(double seconds)
+{
+    char text[64];
+
+    if (seconds < 0 || seconds != seconds) {
+        snprintf(text, sizeof(text), "unknown");
+    } else if (seconds >= 365.25 * 86400) {
+        snprintf(text, sizeof(text), "%.3g years", seconds / (365.25 * 86400));
+    } else {
+        uint64_t s = (uint64_t)seconds;
+        snprintf(text, sizeof(text), "%lud %02lu:%02lu:%02lu", s / 86400, s / 3600 % 24, s / 60 % 60, s % 60);
+    }
+
+    return text;
+}
+
+/* With 'lock' held. */
+void CollisionTelemetry::_Print()
+{
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - printed_at).count();
+    double elapsed = std::chrono::duration<double>(now - phase_start).count();
+
+    uint64_t done = 0, interval_total = 0;
+    double slowest = 0, fastest = 0;
+
+    for (unsigned int i = 0; i < workers; ++i) {
+        uint64_t candidates = counters[i].candidates.load(std::memory_order_relaxed);
+        double rate = (candidates - printed[i]) / seconds;
+
+        if (i < phase_workers && (!i || rate < slowest)) slowest = rate;
+        if (i < phase_workers && (!i || rate > fastest)) fastest = rate;
+
+        done += candidates;
+        interval_total += candidates - printed[i];
+        printed[i] = candidates;
+    }
+    done -= phase_base;
+    printed_at = now;
+
+    double rate = interval_total / seconds;
+    double eta = rate > 0 && phase_total > done ? (phase_total - done) / rate : (phase_total > done ? -1 : 0);
+
+    printf("\t\t[%s, %.0f s] %.0f MACs/s, %lu of %lu (%.2f%%), ETA %s; workers %.0f-%.0f MACs/s\n",
+           phase.c_str(), elapsed, rate, done, phase_total,
+           phase_total ? 100.0 * done / phase_total : 0.0, _format_duration(eta).c_str(), slowest, fastest);
+    fflush(stdout);
+}
+
+
+std::string CollisionTelemetry::_Metrics()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::string text;
+    char line[512];
+    uint64_t total = 0;
+    double rate = 0;
+
+    text += "# HELP vba_collision_candidates_total MACs derived and compared, by pool worker.\n"
+            "# TYPE vba_collision_candidates_total counter\n";
+    for (unsigned int i = 0; i < workers; ++i) {
+        snprintf(line, sizeof(line), "vba_collision_candidates_total{worker=\"%u\"} %lu\n", i, sampled[i]);
+        text += line;
+        total += sampled[i];
+    }
+
+    text += "# HELP vba_collision_rate MACs per second over the last sample, by pool worker.\n"
+            "# TYPE vba_collision_rate gauge\n";
+    for (unsigned int i = 0; i < workers; ++i) {
+        snprintf(line, sizeof(line), "vba_collision_rate{worker=\"%u\"} %.1f\n", i, rates[i]);
+        text += line;
+        rate += rates[i];
+    }
+
+    if (active) {
+        uint64_t done = total > phase_base ? total - phase_base : 0;
+        double eta = rate > 0 && phase_total > done ? (phase_total - done) / rate : 0;
+
+        snprintf(line, sizeof(line),
+                 "# HELP vba_collision_phase_candidates MACs tried and to try in the current search.\n"
+                 "# TYPE vba_collision_phase_candidates gauge\n"
+                 "vba_collision_phase_candidates{phase=\"%s\",state=\"done\"} %lu\n"
+                 "vba_collision_phase_candidates{phase=\"%s\",state=\"total\"} %lu\n",
+                 phase.c_str(), done, phase.c_str(), phase_total);
+        text += line;
+
+        snprintf(line, sizeof(line),
+                 "# HELP vba_collision_eta_seconds Time left in the current search at the last rate.\n"
+                 "# TYPE vba_collision_eta_seconds gauge\n"
+                 "vba_collision_eta_seconds{phase=\"%s\"} %.0f\n",
+                 phase.c_str(), eta);
+        text += line;
+    }
+
+    return text;
+}
+
+/* One request per connection; whatever was asked for, the metrics are the answer. */
+void CollisionTelemetry::_Serve()
+{
+    int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) return;
+
+    LineSocket client(fd);
+    std::string request;
+
+    /* Headers end at a blank line. A slow or silent client gets a second per read, not the sampler. */
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    bool headers_done = false;
+    while (!headers_done && poll(&pfd, 1, 1000) > 0 && client.Fill()) {
+        while (!headers_done && client.TakeLine(&request))
+            headers_done = request.empty() || "\r" == request;
+    }
+
+    std::string body = _Metrics();
+    char header[128];
+    snprintf(header, sizeof(header),
+             "HTTP/1.0 200 OK\r\n"
+             "Content-Type: text/plain; version=0.0.4\r\n"
+             "Content-Length: %zu\r\n"
+             "Connection: close\r\n\r\n",
+             body.size() + 1);
+
+    /* 'Send' ends it with the newline counted above. */
+    client.Send(header + body);
+}
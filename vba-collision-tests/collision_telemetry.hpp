@@ -0,0 +1,91 @@
+#ifndef _COLLISION_TELEMETRY_H_
+#define _COLLISION_TELEMETRY_H_
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+
+/*
+ * Live progress for collision searches. Workers bump their own counter once per
+ *   candidate with a relaxed load and store; nothing else in the hot loop changes.
+ *   A separate thread samples the counters once a second, prints throughput, the
+ *   ETA for the current range and per-worker balance every 'interval', and can serve
+ *   the same figures as a Prometheus text endpoint.
+ */
+#define TELEMETRY_DEFAULT_SECONDS  10
+#define TELEMETRY_SAMPLE_EVERY     std::chrono::seconds(1)
+
+typedef struct alignas(64) _telemetry_counter {
+    std::atomic<uint64_t> candidates;
+} telemetry_counter_t;
+
+
+class CollisionTelemetry
+{
+public:
+    explicit CollisionTelemetry(unsigned int workers);
+    ~CollisionTelemetry();
+
+    CollisionTelemetry(const CollisionTelemetry&) = delete;
+    CollisionTelemetry& operator=(const CollisionTelemetry&) = delete;
+
+    /*
+     * Starts the sampling thread, printing every 'interval' (zero: never) and serving
+     *   metrics on 'metrics_address' ("host:port"; NULL: nowhere). Counting works
+     *   whether or not this is ever called.
+     */
+    bool Start(std::chrono::seconds interval, const char* metrics_address);
+
+    /*
+     * Progress and ETA are for the phase: 'total' candidates named 'name', searched by
+     *   the first 'active' workers (zero: all of them).
+     */
+    void BeginPhase(const std::string& name, uint64_t total, unsigned int active = 0);
+    void EndPhase();
+
+    /* Only ever called by 'worker' itself, so a plain store is enough. */
+    inline void Count(unsigned int worker, uint64_t n = 1)
+    {
+        std::atomic<uint64_t>& candidates = counters[worker].candidates;
+        candidates.store(candidates.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+private:
+    void _Run();
+    void _Sample();
+    void _Print();
+    void _Serve();
+    std::string _Metrics();
+
+    unsigned int workers;
+    std::unique_ptr<telemetry_counter_t[]> counters;
+
+    std::thread thread;
+    int listener = -1;
+    int wake[2] = { -1, -1 };
+    std::chrono::seconds interval{0};
+
+    /* Everything below is shared with the sampling thread. */
+    std::mutex lock;
+    std::vector<uint64_t> sampled;        /* Counters at the last sample... */
+    std::vector<double> rates;            /* ...and each worker's rate up to it. */
+    std::chrono::steady_clock::time_point sampled_at;
+
+    bool active = false;
+    std::string phase;
+    uint64_t phase_total = 0;
+    uint64_t phase_base = 0;              /* Sum of the counters when the phase began. */
+    unsigned int phase_workers = 0;
+    std::chrono::steady_clock::time_point phase_start;
+    std::vector<uint64_t> printed;        /* Counters at the last progress line. */
+    std::chrono::steady_clock::time_point printed_at;
+};
+
+
+#endif /* _COLLISION_TELEMETRY_H_ */
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "collision_tuning.hpp"
+#include "atomic_write.hpp"
+
+
+bool ConcurrencyTuning::Load(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) return true;
+
+    char magic[32] = {0};
+    bool ok = fgets(magic, sizeof(magic), file)
+        && 0 == strncmp(magic, COLLISION_TUNING_MAGIC, strlen(COLLISION_TUNING_MAGIC));
+
+    char name[32];
+    unsigned int iterations, pool_size, threads;
+    double rate;
+    int fields;
+
+    while (ok && 5 == (fields = fscanf(file, "%31s %x %u %u %lf", name, &iterations, &pool_size, &threads, &rate))) {
+        VbaAlgorithm algorithm = vba_algorithm_from_name(name);
+        ok = algorithm && threads && threads <= pool_size;
+        if (ok) Set(algorithm, (uint16_t)iterations, pool_size, threads, rate);
+    }
+    ok = ok && EOF == fields;
+
+    fclose(file);
+    if (!ok) fprintf(stderr, "Tuning file '%s' is malformed.\n", path);
+    return ok;
+}
+
+bool ConcurrencyTuning::Save(const char* path) const
+{
+    return replace_file_atomically(path, [&](FILE* file) {
+        fprintf(file, "%s\n", COLLISION_TUNING_MAGIC);
+        for (const auto& entry : settings)
+            fprintf(file, "%s %04x %u %u %.1f\n",
+                    vba_algorithm_name((VbaAlgorithm)std::get<0>(entry.first)), std::get<1>(entry.first),
+                    std::get<2>(entry.first), entry.second.threads, entry.second.rate);
+    });
+}
+
+
+unsigned int ConcurrencyTuning::Get(VbaAlgorithm algorithm, uint16_t iterations, unsigned int pool_size) const
+{
+    auto found = settings.find(key_t(algorithm, iterations, pool_size));
+    return found == settings.end() ? 0 : found->second.threads;
+}
+
+void ConcurrencyTuning::Set(VbaAlgorithm algorithm, uint16_t iterations, unsigned int pool_size,
+                            unsigned int threads, double rate)
+{
+    settings[key_t(algorithm, iterations, pool_size)] = { threads, rate };
+}
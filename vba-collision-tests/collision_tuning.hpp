@@ -0,0 +1,43 @@
+#ifndef _COLLISION_TUNING_H_
+#define _COLLISION_TUNING_H_
+
+#include <map>
+#include <tuple>
+#include <stdint.h>
+
+#include "vba.h"
+
+
+#define COLLISION_TUNING_DEFAULT  "vba-collisions.tuning"
+#define COLLISION_TUNING_MAGIC    "vba-collisions tuning 1"
+
+
+/*
+ * The best number of pool workers for each algorithm and iteration count, as found
+ *   by ramping up until throughput stopped rising. Settings are kept per pool size,
+ *   so a run with another '--threads' or on another machine tunes afresh.
+ */
+class ConcurrencyTuning
+{
+public:
+    /* A missing file is an empty table; only a malformed one is an error. */
+    bool Load(const char* path);
+    bool Save(const char* path) const;
+
+    /* Zero when nothing was recorded. */
+    unsigned int Get(VbaAlgorithm algorithm, uint16_t iterations, unsigned int pool_size) const;
+    void Set(VbaAlgorithm algorithm, uint16_t iterations, unsigned int pool_size, unsigned int threads, double rate);
+
+private:
+    typedef std::tuple<int, uint16_t, unsigned int> key_t;
+
+    typedef struct _setting {
+        unsigned int threads;
+        double rate;   /* MACs per second when it was measured, for the record. */
+    } setting_t;
+
+    std::map<key_t, setting_t> settings;
+};
+
+
+#endif /* _COLLISION_TUNING_H_ */
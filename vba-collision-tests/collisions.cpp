@@ -1,45 +1,31 @@
 #include <chrono>
+#include <memory>
 #include <sstream>
-#include <pthread.h>
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
 
 #include "collisions.hpp"
 
 #include "vba.h"
+#include "vba_types.hpp"
 #include "generator.h"
+#include "derivation_store.h"
+#include "kdf_backends.h"
+#include "timing.hpp"
+#include "atomic_write.hpp"
 
 
 extern uint16_t _fixed_iter[FIXED_ITERS_COUNT];
 extern uint16_t _fixed_iter_step;
 
-static worker_ctx_t _thread_contexts[THREAD_COUNT] = {0};
-
 static inline void _find_collisions(VbaAlgorithm);
 
-static inline void _roll_mac_address(uint8_t* mac_address, uint64_t rand)
-{
-    /* Generate and use any random MAC address. Unrolled for speed. */
-    rand = UINT64_MAX == rand ? Xoshiro128p__next_bounded_any() : rand;
-
-    mac_address[0] = *(((uint8_t *)&rand) + 0);
-    mac_address[1] = *(((uint8_t *)&rand) + 1);
-    mac_address[2] = *(((uint8_t *)&rand) + 2);
-    mac_address[3] = *(((uint8_t *)&rand) + 3);
-    mac_address[4] = *(((uint8_t *)&rand) + 4);
-    mac_address[5] = *(((uint8_t *)&rand) + 5);
-}
-
-static inline double _convert_time_to_seconds(std::chrono::high_resolution_clock::time_point start,
-                                                     std::chrono::high_resolution_clock::time_point end)
-{
-    std::chrono::duration<double> duration = end - start;
-    return std::chrono::duration_cast<std::chrono::seconds>(duration).count();
-}
-
-static uint8_t _stable_mac_address[6] = {
-    0xC0, 0x01, 0xCA, 0x70, 0xFF, 0xFF
-};
-static uint8_t _stable_voucher_seed[8] = {
-    0xDE, 0xAD, 0xBE, 0xEF, 0xCA, 0xFE, 0xF0, 0x0D
+static constexpr MacAddress _stable_mac_address = MacAddress::FromU64(0xC001CA70FFFFULL);
+/* Seeds are 16 bytes; the tail is spelled out rather than read from whatever follows. */
+static uint8_t _stable_voucher_seed[16] = {
+    0xDE, 0xAD, 0xBE, 0xEF, 0xCA, 0xFE, 0xF0, 0x0D,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
 
 
@@ -59,93 +45,772 @@ void find_collisions_scrypt()
 }
 
 
-static void* _thread_routine_collision_random(void* thread_ctx)
+collision_options_t collision_default_options()
 {
-    uint8_t fake_mac[6] = {0};
-    uint64_t fake_suffix = 0x0;
-    uint64_t loop_breaker = 1ULL << 24;
+    collision_options_t options;
+
+    options.checkpoint_path = COLLISION_CHECKPOINT_DEFAULT;
+    options.resume = false;
+    options.checkpoint_seconds = COLLISION_CHECKPOINT_SECONDS;
+    options.coordinator = NULL;
+    options.targets_path = NULL;
+    options.neighbours = 0;
+    options.exclusions_path = NULL;
+    options.telemetry_seconds = TELEMETRY_DEFAULT_SECONDS;
+    options.metrics_address = NULL;
+    options.pin = NULL;
+    options.threads = 0;
+    options.tune = false;
+    options.tuning_path = COLLISION_TUNING_DEFAULT;
+
+    return options;
+}
+
+static collision_options_t _options = collision_default_options();
 
-    worker_ctx_t* ctx = (worker_ctx_t *)thread_ctx;
+/* Workers persist across every iteration count and algorithm; how many run varies. */
+static CollisionPool& _pool()
+{
+    static CollisionPool pool(_options.threads);
+    return pool;
+}
+
+static uint64_t _chunk_size(uint16_t iterations, VbaAlgorithm algorithm)
+{
+    uint64_t cost = estimate_address_cost(iterations, algorithm);
+    uint64_t chunk = cost ? COLLISION_CHUNK_COST / cost : COLLISION_MAX_CHUNK;
 
-    auto start_random = std::chrono::high_resolution_clock::now();
+    if (!chunk) chunk = 1;
+    return chunk < COLLISION_MAX_CHUNK ? chunk : COLLISION_MAX_CHUNK;
+}
 
-    do {
-        _roll_mac_address(fake_mac, UINT64_MAX);
+/* Workers that never see the options still skip the default exclusions. */
+static MacExclusions _exclusions;
 
-        uint64_t fake_hash =
-                compute_address_hash_suffix(ctx->voucher_seed,
-                                            fake_mac,
-                                            ctx->iterations,
-                                            ctx->algorithm);
+static ConcurrencyTuning _tuning;
 
-        fake_suffix = build_address_suffix(ctx->iterations, fake_hash);
-    } while (--loop_breaker && fake_suffix != ctx->legitimate_suffix);
+/* Sized for the pool, so every pool worker has a counter. */
+static CollisionTelemetry& _telemetry()
+{
+    static CollisionTelemetry telemetry(_pool().Threads());
+    return telemetry;
+}
 
-    auto end_random = std::chrono::high_resolution_clock::now();
-    double duration_random = _convert_time_to_seconds(start_random, end_random);
 
-    if (!loop_breaker) {
-        printf("\n\tThread %d: FAILURE: Loop broken; no matches", ctx->id);
-    } else {
-        *(ctx->match_found_sync_bool) = true;
-        printf("\n\tThread %d: SUCCESS: Impostor MAC is ", ctx->id);
-        for (int x = 0; x < 6; ++x)
-            printf("%02x%s", fake_mac[x], x != 5 ? "-" : "");
+bool set_collision_options(const collision_options_t& options)
+{
+    _options = options;
+
+    if (_options.exclusions_path && *_options.exclusions_path && !_exclusions.LoadFile(_options.exclusions_path))
+        return false;
+
+    _exclusions.PrintSummary();
+
+    if (_options.tuning_path && *_options.tuning_path && !_tuning.Load(_options.tuning_path))
+        return false;
+
+    /* Pinned workers keep their Argon2 memory on their own node through per-thread arenas. */
+    if (_options.pin) {
+        CpuTopology topology = CpuTopology::Detect();
+        topology.Print();
+
+        if (!_pool().Pin(topology, 0 == strcmp(_options.pin, "spread")))
+            return false;
+        kdf_use_thread_arenas(1);
+    }
+
+    return _telemetry().Start(std::chrono::seconds(_options.telemetry_seconds), _options.metrics_address);
+}
+
+static uint64_t _slices_size(const std::vector<collision_slice_t>& slices)
+{
+    uint64_t size = 0;
+    for (const auto& slice : slices)
+        size += slice.last - slice.first;
+    return size;
+}
+
+
+/*
+ * The one comparison every candidate pays. A candidate that derives a target's own
+ *   address is that neighbour, not an impostor, so it does not count; with a single
+ *   target that is the stable MAC, checked only after a hit.
+ */
+static inline bool _is_match(const collision_search_t* search, uint64_t suffix, MacAddress mac, uint64_t* victim)
+{
+    if (!search->targets)
+        return suffix == search->legitimate_suffix && mac.ToU64() != _stable_mac_address.ToU64();
+
+    const collision_target_t* target = search->targets->Find(suffix);
+    if (!target || target->mac == mac.ToU64()) return false;
+
+    *victim = target->mac;
+    return true;
+}
+
+/* Only the first match of a search is kept; later ones lost the race to 'Cancel'. */
+static bool _report_match(collision_search_t* search, unsigned int worker, MacAddress mac, uint64_t victim)
+{
+    if (search->cancel.Cancel()) {
+        search->found = true;
+        search->match_mac = mac.ToU64();
+        search->match_target = victim;
+        search->match_worker = worker;
+    }
+    return false;
+}
+
+static void _print_mac(uint64_t value)
+{
+    MacAddress mac = MacAddress::FromU64(value);
+    for (int x = 0; x < 6; ++x)
+        printf("%02x%s", mac.octets[x], x != 5 ? "-" : "");
+}
+
+static void _print_outcome(const collision_search_t* search,
+                           CollisionPool& pool,
+                           std::chrono::steady_clock::time_point end)
+{
+    pool.PrintBalance();
+
+    if (!search->found) return;
+
+    printf("\n\tWorker %u: SUCCESS: Impostor MAC is ", search->match_worker);
+    _print_mac(search->match_mac);
+
+    if (search->targets && search->match_target) {
+        printf(", posing as ");
+        _print_mac(search->match_target);
     }
 
-    printf("\n\t\t\tThread %d: Operation took '%f' seconds.", ctx->id, duration_random);
-    return NULL;
+    printf("\n\t\tAll workers stopped %.3f ms after the match.",
+           std::chrono::duration<double, std::milli>(end - search->cancel.CancelledAt()).count());
 }
 
-static void* _thread_routine_collision_ordered(void* thread_ctx)
+
+static bool _chunk_collision_random(collision_search_t* search,
+                                    unsigned int worker,
+                                    uint64_t first,
+                                    uint64_t last)
 {
-    uint8_t fake_mac[6] = {0};
+    static const uint32_t chunk_label = Timing::Intern("collision.random.chunk");
+
+    MacAddress fake_mac = {};
     uint64_t fake_suffix = 0x0;
-    uint64_t mac = 0x0;
+    uint64_t candidate = first;
+    uint64_t victim = 0;
+    bool hit = false;
+
+    vba_salt_template_t salt;
+    init_salt_template(&salt, NULL);
+
+    uint64_t chunk_start = Timing::Now();
+
+    CollisionTelemetry& telemetry = _telemetry();
+    xoshiro128p_t* stream = &search->streams[worker].state;
+    uint64_t macs[COLLISION_RANDOM_BATCH];
+    size_t next = COLLISION_RANDOM_BATCH;
+
+    for (; !hit && candidate < last && !search->cancel.Cancelled(); ++candidate) {
+        uint64_t mac;
+        do {
+            if (COLLISION_RANDOM_BATCH == next) {
+                Xoshiro128p__fill(stream, macs, COLLISION_RANDOM_BATCH);
+                next = 0;
+            }
+            mac = macs[next++] & (COLLISION_MAC_SPACE - 1);
+        } while (_exclusions.Contains(mac));
+
+        fake_mac = MacAddress::FromU64(mac);
+
+        fake_suffix = derive_address_suffix(search->voucher_seed,
+                                            &salt,
+                                            fake_mac,
+                                            search->iterations,
+                                            search->algorithm).value;
+
+        hit = _is_match(search, fake_suffix, fake_mac, &victim);
+        telemetry.Count(worker);
+    }
+
+    Timing::Record(chunk_label, chunk_start, Timing::Now(), candidate - first);
 
-    worker_ctx_t* ctx = (worker_ctx_t *)thread_ctx;
-    mac = ctx->starting_mac;
+    if (!hit) return true;
 
-    auto start_ordered = std::chrono::high_resolution_clock::now();
+    return _report_match(search, worker, fake_mac, victim);
+}
 
-    do {
-        /* Reserved for IPv4 multicast: OUI 01-00-5E. */
-        if (0x000001005e000000 == mac) mac += 0x0000000001000000;
+static bool _chunk_collision_ordered(collision_search_t* search,
+                                     unsigned int worker,
+                                     uint64_t first,
+                                     uint64_t last)
+{
+    static const uint32_t chunk_label = Timing::Intern("collision.ordered.chunk");
 
-        /* Reserved for use by IANA: OUI 00-5E-xx. */
-        if (0x0000005e00000000 == mac) mac += 0x0000000100000000;
+    MacAddress fake_mac = {};
+    uint64_t fake_suffix = 0x0;
+    CollisionTelemetry& telemetry = _telemetry();
+    uint64_t mac = first;
+    uint64_t victim = 0;
+    bool hit = false;
 
-        /* Reserved by IANA for PPP: MACs starting with CF. */
-        if (0x0000CF0000000000 == mac) mac += 0x0000010000000000;
+    vba_salt_template_t salt;
+    init_salt_template(&salt, NULL);
 
-        /* Reserved IPv6 multicast range: 33-33-00 through 33-33-FF. */
-        if (0x0000333300000000 == mac) mac += 0x0000000100000000;
+    uint64_t chunk_start = Timing::Now();
 
-        _roll_mac_address(fake_mac, mac);
+    /* Slices come clipped by '_exclusions', so every MAC in a chunk is a candidate. */
+    for (; mac < last; ++mac) {
+        fake_mac = MacAddress::FromU64(mac);
 
-        uint64_t fake_hash =
-                compute_address_hash_suffix(ctx->voucher_seed,
+        fake_suffix = derive_address_suffix(search->voucher_seed,
+                                            &salt,
                                             fake_mac,
-                                            ctx->iterations,
-                                            ctx->algorithm);
+                                            search->iterations,
+                                            search->algorithm).value;
+
+        telemetry.Count(worker);
+        if ((hit = _is_match(search, fake_suffix, fake_mac, &victim)) || search->cancel.Cancelled()) break;
+    }
+
+    Timing::Record(chunk_label, chunk_start, Timing::Now(), (mac < last ? mac + 1 : last) - first);
+
+    if (!hit) return true;
+
+    return _report_match(search, worker, fake_mac, victim);
+}
+
+
+/* ===== Checkpoints ===== */
+
+typedef struct _collision_checkpoint {
+    int algorithm;
+    int iter_index;   /* FIXED_ITERS_COUNT once every count of 'algorithm' is done. */
+    uint16_t iterations;
+    int ordered;      /* 1 once the random search at 'iter_index' is done. */
+    std::vector<collision_slice_t> remaining;
+} collision_checkpoint_t;
+
+static collision_checkpoint_t _resume_point = {};
+static bool _resuming = false;
+
+
+static bool _read_checkpoint(const char* path, collision_checkpoint_t* checkpoint)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) return false;
+
+    char magic[32] = {0};
+    unsigned int iterations = 0;
+    size_t count = 0;
+
+    bool ok = fgets(magic, sizeof(magic), file)
+        && 0 == strncmp(magic, COLLISION_CHECKPOINT_MAGIC, strlen(COLLISION_CHECKPOINT_MAGIC))
+        && 5 == fscanf(file, "%d %d %x %d %zu",
+                       &checkpoint->algorithm, &checkpoint->iter_index, &iterations,
+                       &checkpoint->ordered, &count);
+
+    checkpoint->iterations = (uint16_t)iterations;
+    checkpoint->remaining.clear();
+
+    for (size_t i = 0; ok && i < count; ++i) {
+        collision_slice_t slice;
+        ok = 2 == fscanf(file, "%lx %lx", &slice.first, &slice.last) && slice.first < slice.last;
+        checkpoint->remaining.push_back(slice);
+    }
+
+    fclose(file);
+    return ok;
+}
+
+static bool _write_checkpoint(const char* path, const collision_checkpoint_t& checkpoint)
+{
+    return replace_file_atomically(path, [&](FILE* file) {
+        fprintf(file, "%s\n%d %d %x %d %zu\n", COLLISION_CHECKPOINT_MAGIC,
+                checkpoint.algorithm, checkpoint.iter_index, checkpoint.iterations,
+                checkpoint.ordered, checkpoint.remaining.size());
+        for (const auto& slice : checkpoint.remaining)
+            fprintf(file, "%lx %lx\n", slice.first, slice.last);
+    });
+}
+
+static void _checkpoint(VbaAlgorithm algorithm,
+                        int iter_index,
+                        int ordered,
+                        const std::vector<collision_slice_t>& remaining = {})
+{
+    if (!_options.checkpoint_path || !*_options.checkpoint_path) return;
+
+    collision_checkpoint_t checkpoint = {
+        algorithm,
+        iter_index,
+        iter_index < FIXED_ITERS_COUNT ? _fixed_iter[iter_index] : (uint16_t)0,
+        ordered,
+        remaining
+    };
+
+    if (!_write_checkpoint(_options.checkpoint_path, checkpoint))
+        fprintf(stderr, "Cannot write checkpoint '%s'.\n", _options.checkpoint_path);
+}
+
+/* Loads the resume point once, the first time any search starts. */
+static void _load_resume_point()
+{
+    static bool loaded = false;
+    if (loaded) return;
+    loaded = true;
+
+    if (!_options.resume || !_options.checkpoint_path || !*_options.checkpoint_path) return;
+
+    if (!_read_checkpoint(_options.checkpoint_path, &_resume_point)) {
+        fprintf(stderr, "No usable checkpoint '%s'; starting from the beginning.\n", _options.checkpoint_path);
+        return;
+    }
+
+    /* A checkpoint from a build with other fixed iteration counts cannot be trusted. */
+    if (_resume_point.iter_index < 0 || _resume_point.iter_index > FIXED_ITERS_COUNT
+        || (_resume_point.iter_index < FIXED_ITERS_COUNT
+            && _resume_point.iterations != _fixed_iter[_resume_point.iter_index])) {
+        fprintf(stderr, "Checkpoint '%s' does not match this build; starting from the beginning.\n",
+                _options.checkpoint_path);
+        return;
+    }
+
+    _resuming = true;
+    fprintf(stderr, "Resuming %s at iteration index %d (%s search, %zu slices left).\n",
+            vba_algorithm_name((VbaAlgorithm)_resume_point.algorithm), _resume_point.iter_index,
+            _resume_point.ordered ? "ordered" : "random", _resume_point.remaining.size());
+}
+
+/* True for searches the checkpoint says were already finished. */
+static bool _already_done(VbaAlgorithm algorithm, int iter_index)
+{
+    if (!_resuming) return false;
+
+    return algorithm < _resume_point.algorithm
+        || (algorithm == _resume_point.algorithm && iter_index < _resume_point.iter_index);
+}
+
+
+/* Every candidate is tried against every target at once, so that is the rate that counts. */
+static void _print_throughput(const collision_search_t* search,
+                              const CollisionPool& pool,
+                              std::chrono::steady_clock::duration elapsed)
+{
+    uint64_t candidates = 0;
+    for (const auto& worker : pool.LastStats())
+        candidates += worker.candidates;
+
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    if (seconds <= 0) return;
+
+    size_t targets = search->targets ? search->targets->Size() : 1;
+    printf("\n\t\t%.0f MACs/s against %zu target%s: %.0f target comparisons/s.",
+           candidates / seconds, targets, 1 == targets ? "" : "s", candidates * targets / seconds);
+}
+
+
+static std::string _phase_name(VbaAlgorithm algorithm, uint16_t iterations, const char* kind)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%s 0x%04x %s", vba_algorithm_name(algorithm), iterations, kind);
+    return name;
+}
+
+
+static void _search_random(CollisionPool& pool,
+                           uint64_t legitimate_suffix,
+                           const CollisionTargets* targets,
+                           uint16_t iterations,
+                           VbaAlgorithm algorithm,
+                           uint64_t chunk)
+{
+    printf("\t\tRandom... \n");
+
+    /* Split off the global stream, so no two workers (or searches) draw the same MACs. */
+    std::vector<collision_stream_t> streams(pool.Threads());
+    for (auto& stream : streams)
+        Xoshiro128p__split(&stream.state);
+
+    collision_search_t random_search = {
+            &_stable_voucher_seed[0],
+            legitimate_suffix,
+            iterations,
+            algorithm,
+            targets,
+            streams.data(),
+    };
+
+    _telemetry().BeginPhase(_phase_name(algorithm, iterations, "random"), COLLISION_RANDOM_CANDIDATES, pool.Active());
+
+    auto start_random = std::chrono::steady_clock::now();
+    pool.Run(0, COLLISION_RANDOM_CANDIDATES, chunk,
+             [&random_search](unsigned int worker, uint64_t first, uint64_t last) {
+                 return _chunk_collision_random(&random_search, worker, first, last);
+             },
+             &random_search.cancel);
+    auto end_random = std::chrono::steady_clock::now();
+
+    _telemetry().EndPhase();
+
+    _print_outcome(&random_search, pool, end_random);
+    printf("\n\t\tRandom search took '%f' seconds.",
+           std::chrono::duration<double>(end_random - start_random).count());
+    _print_throughput(&random_search, pool, end_random - start_random);
+
+    if (random_search.found)
+        printf("\n\n=== A RANDOM MAC ADDRESS WAS USED TO CREATE A COLLISION! ===\n\n");
+    else
+        printf("\n\t\tFAILURE: Candidates exhausted; no matches");
+}
+
+static void _search_ordered(CollisionPool& pool,
+                            uint64_t legitimate_suffix,
+                            const CollisionTargets* targets,
+                            uint16_t iterations,
+                            VbaAlgorithm algorithm,
+                            uint64_t chunk,
+                            int iter_index,
+                            const std::vector<collision_slice_t>& slices)
+{
+    printf("\n\t\tOrdered (%lu MACs)... \n", _slices_size(slices));
+
+    collision_search_t ordered_search = {
+            &_stable_voucher_seed[0],
+            legitimate_suffix,
+            iterations,
+            algorithm,
+            targets,
+    };
+
+    _telemetry().BeginPhase(_phase_name(algorithm, iterations, "ordered"), _slices_size(slices), pool.Active());
+
+    auto start_ordered = std::chrono::steady_clock::now();
+    pool.Run(slices, chunk,
+             [&ordered_search](unsigned int worker, uint64_t first, uint64_t last) {
+                 return _chunk_collision_ordered(&ordered_search, worker, first, last);
+             },
+             &ordered_search.cancel,
+             [algorithm, iter_index](const std::vector<collision_slice_t>& remaining) {
+                 _checkpoint(algorithm, iter_index, 1, remaining);
+             },
+             std::chrono::milliseconds(1000ULL * _options.checkpoint_seconds));
+    auto end_ordered = std::chrono::steady_clock::now();
+
+    _telemetry().EndPhase();
+
+    _print_outcome(&ordered_search, pool, end_ordered);
+    printf("\n\t\tOrdered search took '%f' seconds.",
+           std::chrono::duration<double>(end_ordered - start_ordered).count());
+    _print_throughput(&ordered_search, pool, end_ordered - start_ordered);
+
+    if (ordered_search.found)
+        printf("\n\n=== AN ORDERED MAC ADDRESS WAS USED TO CREATE A COLLISION! ===\n\n");
+    else
+        printf("\n\t\tFAILURE: MACs exhausted; no matches");
+}
+
+
+/* ===== Targets ===== */
+
+/* Loaded once; each search only takes the lines with its own iteration count. */
+static std::vector<collision_target_t> _file_targets;
+
+static void _load_file_targets()
+{
+    static bool loaded = false;
+    if (loaded) return;
+    loaded = true;
+
+    if (!_options.targets_path || !*_options.targets_path) return;
+
+    if (CollisionTargets::LoadFile(_options.targets_path, &_file_targets))
+        printf("Loaded %zu target addresses from '%s'.\n", _file_targets.size(), _options.targets_path);
+}
+
+/*
+ * The stable address plus every other address an impostor could just as well take
+ *   over at this iteration count. Nothing is built when that is only the stable one,
+ *   so a plain search keeps its single comparison.
+ */
+static bool _build_targets(CollisionTargets* targets,
+                           uint64_t legitimate_suffix,
+                           uint16_t iterations,
+                           VbaAlgorithm algorithm)
+{
+    _load_file_targets();
+
+    targets->Insert({ legitimate_suffix, _stable_mac_address.ToU64() });
+
+    for (const auto& target : _file_targets)
+        if (get_suffix_iterations(target.suffix) == iterations)
+            targets->Insert(target);
+
+    for (unsigned int k = 1; k <= _options.neighbours; ++k) {
+        MacAddress neighbour = MacAddress::FromU64((_stable_mac_address.ToU64() + k) & (COLLISION_MAC_SPACE - 1));
+
+        targets->Insert({ derivation_store_get_suffix(derivation_store_default(),
+                                                      _stable_voucher_seed,
+                                                      neighbour.octets,
+                                                      iterations,
+                                                      algorithm),
+                          neighbour.ToU64() });
+    }
+
+    return targets->Size() > 1;
+}
+
+
+/* ===== Concurrency ===== */
+
+/* MACs per second from the first 'active' workers deriving for about COLLISION_TUNE_SECONDS. */
+static double _measure_rate(CollisionPool& pool,
+                            unsigned int active,
+                            uint16_t iterations,
+                            VbaAlgorithm algorithm,
+                            uint64_t chunk)
+{
+    std::unique_ptr<telemetry_counter_t[]> counts(new telemetry_counter_t[pool.Threads()]());
+    auto total = [&]() {
+        uint64_t sum = 0;
+        for (unsigned int i = 0; i < active; ++i)
+            sum += counts[i].candidates.load(std::memory_order_relaxed);
+        return sum;
+    };
+    auto everyone_counted = [&]() {
+        for (unsigned int i = 0; i < active; ++i)
+            if (!counts[i].candidates.load(std::memory_order_relaxed)) return false;
+        return true;
+    };
+
+    CancellationToken stop;
+    pool.SetActive(active);
+
+    /* Slow derivations run past the budget until every worker has finished one. */
+    auto start = std::chrono::steady_clock::now();
+    pool.Run(CollisionPool::Split(0, COLLISION_MAC_SPACE, chunk, active), chunk,
+             [&](unsigned int worker, uint64_t first, uint64_t last) {
+                 vba_salt_template_t salt;
+                 init_salt_template(&salt, NULL);
+
+                 std::atomic<uint64_t>& count = counts[worker].candidates;
+                 for (uint64_t mac = first; mac < last && !stop.Cancelled(); ++mac) {
+                     derive_address_suffix(_stable_voucher_seed, &salt, MacAddress::FromU64(mac), iterations, algorithm);
+                     count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                 }
+                 return true;
+             },
+             &stop,
+             [&](const std::vector<collision_slice_t>&) {
+                 if (std::chrono::steady_clock::now() - start >= std::chrono::seconds(COLLISION_TUNE_SECONDS)
+                     && everyone_counted())
+                     stop.Cancel();
+             },
+             std::chrono::milliseconds(50));
+    auto end = std::chrono::steady_clock::now();
+
+    return total() / std::chrono::duration<double>(end - start).count();
+}
+
+/*
+ * Doubles the worker count from one, ending on the pool size, while throughput still
+ *   rises by COLLISION_TUNE_GAIN; the last count that did so wins.
+ */
+static unsigned int _tune_concurrency(CollisionPool& pool,
+                                      uint16_t iterations,
+                                      VbaAlgorithm algorithm,
+                                      uint64_t chunk,
+                                      double* best_rate)
+{
+    unsigned int best = 1;
+    *best_rate = 0;
+
+    printf("\n\tTuning workers:");
+    for (unsigned int threads = 1; ; threads = threads * 2 < pool.Threads() ? threads * 2 : pool.Threads()) {
+        double rate = _measure_rate(pool, threads, iterations, algorithm, chunk);
+        printf(" %u: %.0f MACs/s;", threads, rate);
+        fflush(stdout);
+
+        if (rate < *best_rate * COLLISION_TUNE_GAIN) break;
+        best = threads;
+        *best_rate = rate;
+
+        if (threads == pool.Threads()) break;
+    }
+    printf(" using %u.", best);
+
+    return best;
+}
+
+/* The recorded worker count, else a freshly tuned one with '--tune', else all of them. */
+static unsigned int _concurrency(CollisionPool& pool, uint16_t iterations, VbaAlgorithm algorithm, uint64_t chunk)
+{
+    unsigned int threads = _tuning.Get(algorithm, iterations, pool.Threads());
+    if (threads) {
+        printf("\n\tUsing %u of %u workers, as tuned before.", threads, pool.Threads());
+        return threads;
+    }
+
+    if (!_options.tune) return pool.Threads();
+
+    double rate;
+    threads = _tune_concurrency(pool, iterations, algorithm, chunk, &rate);
+    _tuning.Set(algorithm, iterations, pool.Threads(), threads, rate);
 
-        fake_suffix = build_address_suffix(ctx->iterations, fake_hash);
-    } while (++mac < ctx->ending_mac && fake_suffix != ctx->legitimate_suffix);
+    if (_options.tuning_path && *_options.tuning_path && !_tuning.Save(_options.tuning_path))
+        fprintf(stderr, "Cannot write tuning file '%s'.\n", _options.tuning_path);
 
-    auto end_ordered = std::chrono::high_resolution_clock::now();
-    double duration_ordered = _convert_time_to_seconds(start_ordered, end_ordered);
+    return threads;
+}
+
+
+/* ===== Sharded searches ===== */
 
-    if (mac >= 0x0000FFFFFFFFFFFF) {
-        printf("\n\tThread %d: FAILURE: MACs exhausted; no matches", ctx->id);
+static void _coordinate_ordered(CollisionCoordinator& coordinator,
+                                uint64_t legitimate_suffix,
+                                uint16_t iterations,
+                                VbaAlgorithm algorithm,
+                                uint64_t chunk,
+                                int iter_index,
+                                const std::vector<collision_slice_t>& slices)
+{
+    printf("\t\tOrdered (%lu MACs), leased to workers... ", _slices_size(slices));
+
+    collision_job_t job = { algorithm, iterations, legitimate_suffix, {0}, get_argon2_parameters() };
+    memcpy(job.voucher_seed, _stable_voucher_seed, sizeof(job.voucher_seed));
+
+    uint64_t match_mac = 0;
+    auto start_ordered = std::chrono::steady_clock::now();
+    bool found = coordinator.RunSearch(job, slices, chunk * COORDINATOR_LEASE_CHUNKS,
+                                       [algorithm, iter_index](const std::vector<collision_slice_t>& remaining) {
+                                           _checkpoint(algorithm, iter_index, 1, remaining);
+                                       },
+                                       std::chrono::milliseconds(1000ULL * _options.checkpoint_seconds),
+                                       &match_mac);
+    auto end_ordered = std::chrono::steady_clock::now();
+
+    printf("\n\t\tOrdered search took '%f' seconds.",
+           std::chrono::duration<double>(end_ordered - start_ordered).count());
+
+    if (found) {
+        printf("\n\tSUCCESS: Impostor MAC is ");
+        _print_mac(match_mac);
+        printf("\n\n=== AN ORDERED MAC ADDRESS WAS USED TO CREATE A COLLISION! ===\n\n");
     } else {
-        *(ctx->match_found_sync_bool) = true;
-        printf("\n\tThread %d: SUCCESS: Impostor MAC is ", ctx->id);
-        for (int x = 0; x < 6; ++x)
-            printf("%02x%s", fake_mac[x], x != 5 ? "-" : "");
+        printf("\n\t\tFAILURE: MACs exhausted; no matches");
+    }
+}
+
+
+static bool _parse_lease(const std::string& line, uint64_t* id, collision_job_t* job, collision_slice_t* slice)
+{
+    unsigned int algorithm, iterations, memory_kib, lanes;
+    char seed[33] = {0};
+
+    if (9 != sscanf(line.c_str(), "LEASE %lx %x %x %lx %32s %x %x %lx %lx",
+                     id, &algorithm, &iterations, &job->legitimate_suffix, seed,
+                     &memory_kib, &lanes, &slice->first, &slice->last)
+        || 32 != strlen(seed)) {
+        return false;
     }
 
-    printf("\t\t\tThread %d: Operation took '%f' seconds.", ctx->id, duration_ordered);
-    return NULL;
+    for (int i = 0; i < 16; ++i) {
+        char byte[3] = { seed[i * 2], seed[i * 2 + 1], '\0' };
+        job->voucher_seed[i] = (uint8_t)strtoul(byte, NULL, 16);
+    }
+
+    job->algorithm = (VbaAlgorithm)algorithm;
+    job->iterations = (uint16_t)iterations;
+    job->argon2 = { memory_kib, lanes };
+    return slice->first < slice->last && slice->last <= COLLISION_MAC_SPACE;
+}
+
+int run_collision_worker(const char* address, unsigned int threads)
+{
+    _options.threads = threads;
+
+    int fd = -1;
+    for (int attempt = 0; fd < 0 && attempt < COORDINATOR_CONNECT_ATTEMPTS; ++attempt) {
+        if (attempt) sleep(1);
+        fd = LineSocket::Connect(address);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Cannot reach the coordinator at '%s'.\n", address);
+        return 1;
+    }
+
+    LineSocket coordinator(fd);
+    CollisionPool& pool = _pool();
+    std::string reply;
+    char message[128];
+
+    snprintf(message, sizeof(message), "HELLO %x", pool.Threads());
+    if (!coordinator.Send(message) || !coordinator.ReadLine(&reply)) return 1;
+
+    uint64_t leases = 0, candidates = 0;
+
+    while (coordinator.Send("NEXT") && coordinator.ReadLine(&reply)) {
+        if (0 == reply.compare(0, 3, "BYE")) {
+            printf("Worker done: %lu leases, %lu MACs.\n", leases, candidates);
+            return 0;
+        }
+        if (0 == reply.compare(0, 4, "WAIT")) {
+            usleep(1000 * strtoul(reply.c_str() + 4, NULL, 10));
+            continue;
+        }
+
+        uint64_t id;
+        collision_job_t job;
+        collision_slice_t slice;
+        if (!_parse_lease(reply, &id, &job, &slice)) {
+            fprintf(stderr, "Bad lease from the coordinator: '%s'\n", reply.c_str());
+            return 1;
+        }
+
+        set_argon2_parameters(job.argon2.memory_kib, job.argon2.lanes);
+
+        collision_search_t search = {
+                job.voucher_seed,
+                job.legitimate_suffix,
+                job.iterations,
+                job.algorithm,
+        };
+
+        /* Progress doubles as the heartbeat that keeps the lease, and as the way to be told to stop. */
+        uint64_t lease_size = slice.last - slice.first;
+        bool lost = false;
+
+        pool.Run({ slice }, _chunk_size(job.iterations, job.algorithm),
+                 [&search](unsigned int worker, uint64_t first, uint64_t last) {
+                     return _chunk_collision_ordered(&search, worker, first, last);
+                 },
+                 &search.cancel,
+                 [&](const std::vector<collision_slice_t>& remaining) {
+                     char progress[64];
+                     snprintf(progress, sizeof(progress), "PROGRESS %lx %lx", id, lease_size - _slices_size(remaining));
+                     if (!coordinator.Send(progress) || !coordinator.ReadLine(&reply) || reply != "OK") {
+                         lost = true;
+                         search.cancel.Cancel();
+                     }
+                 },
+                 COORDINATOR_PROGRESS_EVERY);
+
+        ++leases;
+        uint64_t searched = lease_size - _slices_size(pool.Remaining());
+        candidates += searched;
+
+        if (search.found)
+            snprintf(message, sizeof(message), "MATCH %lx %lx", id, search.match_mac);
+        else if (lost)
+            continue;
+        else
+            snprintf(message, sizeof(message), "DONE %lx %lx", id, searched);
+
+        if (!coordinator.Send(message) || !coordinator.ReadLine(&reply)) break;
+    }
+
+    fprintf(stderr, "Lost the coordinator at '%s'.\n", address);
+    return 1;
 }
 
 
@@ -168,80 +833,68 @@ static void* _thread_routine_collision_ordered(void* thread_ctx)
 static inline void
 _find_collisions(VbaAlgorithm algorithm)
 {
-    bool is_random_match = false;
-    bool is_ordered_match = false;
+    CollisionPool& pool = _pool();
+    _load_resume_point();
 
     for (int i = 0, j = 0; i < FIXED_ITERS_COUNT; ++i, j += 2) {
         uint16_t iterations = _fixed_iter[i];
 
-        printf("Computing address for '0x%04x' (%d) iterations.\n", iterations, iterations);
+        if (_already_done(algorithm, i)) continue;
 
-        uint64_t legitimate_hash =
-            compute_address_hash_suffix(_stable_voucher_seed,
-                                        _stable_mac_address,
-                                        iterations,
-                                        algorithm);
+        /* Only the search the checkpoint was taken in picks up part-way. */
+        bool resume_ordered = _resuming && algorithm == _resume_point.algorithm
+            && i == _resume_point.iter_index && _resume_point.ordered;
+        _resuming = false;
 
-        uint64_t legitimate_suffix = build_address_suffix(iterations,
-                                                          legitimate_hash);
+        printf("Computing address for '0x%04x' (%d) iterations.\n", iterations, iterations);
+
+        /* The target never changes between runs, so it is only ever derived once per store. */
+        uint64_t legitimate_suffix = derivation_store_get_suffix(derivation_store_default(),
+                                                                 _stable_voucher_seed,
+                                                                 _stable_mac_address.octets,
+                                                                 iterations,
+                                                                 algorithm);
         
         printf("\tGot address: ");
         print_lladdr_from_suffix(legitimate_suffix);
 
-        printf("\n\tNow searching for a collision...\n\t\tRandom... \n");
-
-        for (unsigned int x = 0; x < THREAD_COUNT; ++x) {
-            worker_ctx_t thread_ctx = {
-                    {0},
-                    x + 1,
-                    0,
-                    0,
-                    &_stable_voucher_seed[0],
-                    legitimate_suffix,
-                    iterations,
-                    algorithm,
-                    &is_random_match
-            };
-            memcpy(&_thread_contexts[x], &thread_ctx, sizeof(worker_ctx_t));
-
-            pthread_create(&(_thread_contexts[x].thread_handle),
-                           NULL,
-                           _thread_routine_collision_random,
-                           &_thread_contexts[x]);
+        CollisionTargets all_targets;
+        const CollisionTargets* targets = nullptr;
+        if (!_options.coordinator && _build_targets(&all_targets, legitimate_suffix, iterations, algorithm)) {
+            targets = &all_targets;
+            printf("\n\tMatching against %zu target addresses at once.", targets->Size());
         }
-        for (int x = 0; x < THREAD_COUNT; ++x)
-            pthread_join(_thread_contexts[x].thread_handle, NULL);
 
-        if (is_random_match)
-            printf("\n\n=== A RANDOM MAC ADDRESS WAS USED TO CREATE A COLLISION! ===\n\n");
+        uint64_t chunk = _chunk_size(iterations, algorithm);
 
-        /* ================================= */
-        printf("\n\t\tOrdered... \n");
-
-        for (unsigned int x = 0; x < THREAD_COUNT; ++x) {
-            worker_ctx_t thread_ctx = {
-                    {0},
-                    x + 1,
-                    x * MACS_PER_THREAD,
-                    ((x + 1) * MACS_PER_THREAD) - 1,
-                    &_stable_voucher_seed[0],
-                    legitimate_suffix,
-                    iterations,
-                    algorithm,
-                    &is_ordered_match
-            };
-            memcpy(&_thread_contexts[x], &thread_ctx, sizeof(worker_ctx_t));
-
-            pthread_create(&(_thread_contexts[x].thread_handle),
-                           NULL,
-                           _thread_routine_collision_ordered,
-                           &_thread_contexts[x]);
+        if (!_options.coordinator)
+            pool.SetActive(_concurrency(pool, iterations, algorithm, chunk));
+
+        printf("\n\tNow searching for a collision (%u workers, %lu MACs per chunk)...\n",
+               pool.Active(), chunk);
+
+        /* Random guesses gain nothing from sharding, so a coordinator goes straight to ordered. */
+        if (!resume_ordered && !_options.coordinator) {
+            _checkpoint(algorithm, i, 0);
+            _search_random(pool, legitimate_suffix, targets, iterations, algorithm, chunk);
         }
-        for (int x = 0; x < THREAD_COUNT; ++x)
-            pthread_join(_thread_contexts[x].thread_handle, NULL);
 
-        if (is_ordered_match)
-            printf("\n\n=== AN ORDERED MAC ADDRESS WAS USED TO CREATE A COLLISION! ===\n\n");
+        /* ================================= */
+        std::vector<collision_slice_t> slices;
+        if (resume_ordered)
+            slices = _resume_point.remaining;
+        else
+            slices = CollisionPool::Split(0, COLLISION_MAC_SPACE, chunk, pool.Active());
+
+        /* Also for resumed slices, in case the exclusions have grown since. */
+        slices = _exclusions.Clip(slices);
+
+        _checkpoint(algorithm, i, 1, slices);
+        if (_options.coordinator)
+            _coordinate_ordered(*_options.coordinator, legitimate_suffix, iterations, algorithm, chunk, i, slices);
+        else
+            _search_ordered(pool, legitimate_suffix, targets, iterations, algorithm, chunk, i, slices);
+        _checkpoint(algorithm, i + 1, 0);
 
         printf("\n\n");
     }
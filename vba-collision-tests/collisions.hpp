@@ -3,23 +3,102 @@
 
 
 #include "vba.h"
+#include "generator.h"
+#include "collision_pool.hpp"
+#include "collision_telemetry.hpp"
+#include "collision_tuning.hpp"
+#include "collision_targets.hpp"
+#include "coordinator.hpp"
+#include "mac_exclusions.hpp"
 
-#define THREAD_COUNT  32
-#define MACS_PER_THREAD  ((1ULL << 48) / THREAD_COUNT)
+/* The random search tries as many MACs as it did with one 2^24 loop per thread on 32 threads. */
+#define COLLISION_RANDOM_CANDIDATES  (32ULL << 24)
+#define COLLISION_MAC_SPACE          (1ULL << 48)
 
+/*
+ * Chunks are sized so each costs roughly this many 'estimate_address_cost' units:
+ *   small enough to balance at high iteration counts, large enough that claiming
+ *   one is noise at low ones.
+ */
+#define COLLISION_CHUNK_COST         (1ULL << 24)
+#define COLLISION_MAX_CHUNK          (1ULL << 12)
 
-typedef struct _worker_ctx {
-    pthread_t thread_handle;
-    unsigned int id;
-    uint64_t starting_mac;
-    uint64_t ending_mac;
+/*
+ * Tuning measures each worker count for this long, doubling it while throughput
+ *   still rises by at least this factor.
+ */
+#define COLLISION_TUNE_SECONDS       1
+#define COLLISION_TUNE_GAIN          1.05
+
+#define COLLISION_CHECKPOINT_DEFAULT  "vba-collisions.checkpoint"
+#define COLLISION_CHECKPOINT_SECONDS  60
+#define COLLISION_CHECKPOINT_MAGIC    "vba-collisions 1"
+
+
+/* Random candidates are drawn from each worker's stream this many at a time. */
+#define COLLISION_RANDOM_BATCH       64
+
+/* Neighbours of the stable MAC added as targets by '--neighbours' are capped here. */
+#define COLLISION_MAX_NEIGHBOURS     (1U << 20)
+
+
+/* A worker's own random stream, on its own cache line. */
+typedef struct alignas(64) _collision_stream {
+    xoshiro128p_t state;
+} collision_stream_t;
+
+
+/*
+ * Shared by every pool worker for one search at one iteration count. The first
+ *   worker to match wins 'cancel' and is the only one to write the result fields.
+ *   Without 'targets' a candidate must equal 'legitimate_suffix'; with them it may
+ *   equal any suffix in the set other than its own.
+ */
+typedef struct _collision_search {
     uint8_t* voucher_seed;
     uint64_t legitimate_suffix;
     uint16_t iterations;
     VbaAlgorithm algorithm;
-    bool* match_found_sync_bool;
-} worker_ctx_t;
+    const CollisionTargets* targets;
+    collision_stream_t* streams;   /* One per worker, for random searches. */
+    CancellationToken cancel;   /* Also cancelled from outside, e.g. by a coordinator. */
+    bool found;
+    uint64_t match_mac;
+    uint64_t match_target;      /* The MAC whose address was matched, when known. */
+    unsigned int match_worker;
+} collision_search_t;
+
+
+/*
+ * Ordered searches save what is left of the MAC space every 'checkpoint_seconds',
+ *   and the position in the run (algorithm, '_fixed_iter' index) as each search
+ *   starts and ends. With 'resume', searches already finished are skipped and the
+ *   interrupted ordered search continues from its remaining slices. Algorithms are
+ *   assumed to run in ascending 'VbaAlgorithm' order, as 'main' does.
+ */
+typedef struct _collision_options {
+    const char* checkpoint_path;   /* NULL or empty: no checkpoints. */
+    bool resume;
+    unsigned int checkpoint_seconds;
+    CollisionCoordinator* coordinator;   /* Leases ordered searches to workers when set. */
+    const char* targets_path;   /* More targets, one address per line; see 'CollisionTargets::LoadFile'. */
+    unsigned int neighbours;    /* Also target the stable MAC's next 'neighbours' MACs. */
+    const char* exclusions_path;   /* More MACs to skip; see 'MacExclusions::LoadFile'. */
+    unsigned int telemetry_seconds;   /* Between progress lines; zero for none. */
+    const char* metrics_address;      /* Serves Prometheus metrics here when set. */
+    const char* pin;                  /* "spread" or "compact" pins pool workers; NULL leaves them. */
+    unsigned int threads;             /* Pool workers; zero for one per hardware thread. */
+    bool tune;                        /* Find and save worker counts not yet in the tuning file. */
+    const char* tuning_path;          /* Worker counts by algorithm and iterations; NULL or empty: none. */
+} collision_options_t;
+
+collision_options_t collision_default_options();
+
+/* False if the exclusions or tuning file cannot be used, or telemetry or pinning fail. */
+bool set_collision_options(const collision_options_t& options);
 
+/* Searches leases from the coordinator at 'address' until it says goodbye; zero 'threads' means all. */
+int run_collision_worker(const char* address, unsigned int threads);
 
 void find_collisions_pbkdf2();
 void find_collisions_argon2();
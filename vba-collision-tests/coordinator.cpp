@@ -0,0 +1,490 @@
+#include <algorithm>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "coordinator.hpp"
+#include "vba_types.hpp"
+
+
+extern char** environ;
+
+
+/* ===== Line sockets ===== */
+
+LineSocket::~LineSocket()
+{
+    if (fd >= 0) close(fd);
+}
+
+/* Splits "host:port" or "port"; a bare port means any address (listen) or localhost. */
+static bool _resolve(const char* address, bool passive, struct addrinfo** result)
+{
+    std::string text(address);
+    std::string host, port = text;
+
+    size_t colon = text.rfind(':');
+    if (std::string::npos != colon) {
+        host = text.substr(0, colon);
+        port = text.substr(colon + 1);
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+    int error = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, result);
+    if (error) {
+        fprintf(stderr, "Cannot resolve '%s': %s\n", address, gai_strerror(error));
+        return false;
+    }
+    return true;
+}
+
+int LineSocket::Connect(const char* address)
+{
+    struct addrinfo* found = NULL;
+    if (!_resolve(address, false, &found)) return -1;
+
+    int fd = -1;
+    for (struct addrinfo* a = found; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && 0 != connect(fd, a->ai_addr, a->ai_addrlen)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+
+    if (fd >= 0) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}
+
+int LineSocket::Listen(const char* address)
+{
+    struct addrinfo* found = NULL;
+    if (!_resolve(address, true, &found)) return -1;
+
+    int fd = -1;
+    for (struct addrinfo* a = found; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        if (0 != bind(fd, a->ai_addr, a->ai_addrlen) || 0 != listen(fd, 64)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+
+    if (fd < 0) fprintf(stderr, "Cannot listen on '%s': %s\n", address, strerror(errno));
+    return fd;
+}
+
+bool LineSocket::Send(const std::string& line)
+{
+    std::string framed = line + "\n";
+
+    for (size_t sent = 0; sent < framed.size(); ) {
+        ssize_t n = send(fd, framed.data() + sent, framed.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && EINTR == errno) continue;
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+bool LineSocket::Fill()
+{
+    char chunk[4096];
+    ssize_t n;
+
+    do {
+        n = read(fd, chunk, sizeof(chunk));
+    } while (n < 0 && EINTR == errno);
+
+    if (n <= 0) return false;
+    buffer.append(chunk, n);
+    return true;
+}
+
+bool LineSocket::TakeLine(std::string* line)
+{
+    size_t newline = buffer.find('\n');
+    if (std::string::npos == newline) return false;
+
+    line->assign(buffer, 0, newline);
+    buffer.erase(0, newline + 1);
+    return true;
+}
+
+bool LineSocket::ReadLine(std::string* line)
+{
+    while (!TakeLine(line))
+        if (!Fill()) return false;
+    return true;
+}
+
+
+/* ===== Coordinator ===== */
+
+CollisionCoordinator::~CollisionCoordinator()
+{
+    if (!finished) Finish();
+}
+
+bool CollisionCoordinator::Listen(const char* listen_address)
+{
+    int fd = LineSocket::Listen(listen_address);
+    if (fd < 0) return false;
+
+    listener.reset(new LineSocket(fd));
+
+    /* Workers spawned here connect to the loopback address on the same port. */
+    std::string text(listen_address);
+    size_t colon = text.rfind(':');
+    address = "127.0.0.1:" + (std::string::npos == colon ? text : text.substr(colon + 1));
+
+    printf("Coordinator listening on '%s'.\n", listen_address);
+    return true;
+}
+
+bool CollisionCoordinator::SpawnWorkers(unsigned int count, unsigned int threads)
+{
+    char program[4096];
+    ssize_t length = readlink("/proc/self/exe", program, sizeof(program) - 1);
+    if (length <= 0) {
+        fprintf(stderr, "Cannot find this program to spawn workers.\n");
+        return false;
+    }
+    program[length] = '\0';
+
+    char threads_text[16];
+    snprintf(threads_text, sizeof(threads_text), "%u", threads);
+
+    for (unsigned int i = 0; i < count; ++i) {
+        char* argv[] = { program, (char*)"--worker", (char*)address.c_str(), (char*)"--threads", threads_text, NULL };
+        pid_t pid;
+
+        int error = posix_spawn(&pid, program, NULL, NULL, argv, environ);
+        if (error) {
+            fprintf(stderr, "Cannot spawn worker %u: %s\n", i, strerror(error));
+            return false;
+        }
+        children.push_back(pid);
+    }
+
+    printf("Spawned %u local workers of %u threads each.\n", count, threads);
+    return true;
+}
+
+
+bool CollisionCoordinator::RunSearch(const collision_job_t& search_job,
+                                     const std::vector<collision_slice_t>& slices,
+                                     uint64_t size,
+                                     CollisionPool::progress_fn progress,
+                                     std::chrono::milliseconds interval,
+                                     uint64_t* match_mac)
+{
+    job = search_job;
+    lease_size = size ? size : 1;
+    pending.assign(slices.begin(), slices.end());
+    leases.clear();
+    first_lease = next_lease;
+    found = false;
+    searching = true;
+    search_start = std::chrono::steady_clock::now();
+
+    for (auto& worker : workers) {
+        worker.lease = 0;
+        worker.lease_candidates = 0;
+        worker.candidates = 0;
+    }
+
+    auto last_progress = search_start, last_status = search_start;
+
+    while (!found && (!pending.empty() || !leases.empty())) {
+        _Poll(COORDINATOR_WAIT_MS);
+        _ExpireLeases();
+
+        auto now = std::chrono::steady_clock::now();
+        if (progress && interval.count() > 0 && now - last_progress >= interval) {
+            progress(_Remaining());
+            last_progress = now;
+        }
+        if (now - last_status >= COORDINATOR_STATUS_EVERY) {
+            _PrintStatus(false);
+            last_status = now;
+        }
+    }
+
+    searching = false;
+    _PrintStatus(true);
+
+    /* Leases still out belong to a search that is over; their reports are ignored. */
+    leases.clear();
+    pending.clear();
+    for (auto& worker : workers)
+        worker.lease = 0;
+
+    if (found) *match_mac = found_mac;
+    return found;
+}
+
+
+void CollisionCoordinator::_Poll(int timeout_ms)
+{
+    std::vector<struct pollfd> fds;
+    fds.push_back({ listener->Fd(), POLLIN, 0 });
+    for (auto& worker : workers)
+        fds.push_back({ worker.socket->Fd(), POLLIN, 0 });
+
+    if (poll(fds.data(), fds.size(), timeout_ms) <= 0) return;
+
+    if (fds[0].revents & POLLIN) _Accept();
+
+    /* Backwards, so dropping a worker does not shift the ones still to visit. */
+    for (size_t i = fds.size() - 1; i > 0; --i) {
+        size_t w = i - 1;
+        if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+        if (!workers[w].socket->Fill()) {
+            _Drop(w);
+            continue;
+        }
+
+        std::string line;
+        while (workers[w].socket->TakeLine(&line))
+            if (!_Handle(w, line)) break;
+    }
+}
+
+void CollisionCoordinator::_Accept()
+{
+    struct sockaddr_storage peer;
+    socklen_t peer_length = sizeof(peer);
+
+    int fd = accept(listener->Fd(), (struct sockaddr*)&peer, &peer_length);
+    if (fd < 0) return;
+
+    char host[NI_MAXHOST] = "?", port[NI_MAXSERV] = "?";
+    getnameinfo((struct sockaddr*)&peer, peer_length, host, sizeof(host), port, sizeof(port),
+                NI_NUMERICHOST | NI_NUMERICSERV);
+
+    coordinator_worker_t worker = {};
+    worker.socket.reset(new LineSocket(fd));
+    worker.peer = std::string(host) + ":" + port;
+    worker.joined = std::chrono::steady_clock::now();
+    workers.push_back(std::move(worker));
+}
+
+void CollisionCoordinator::_Drop(size_t w)
+{
+    if (workers[w].lease) {
+        printf("\n\t\tWorker %s left; lease %lu goes back to the queue.", workers[w].peer.c_str(), workers[w].lease);
+        _Requeue(workers[w].lease);
+    }
+
+    workers.erase(workers.begin() + w);
+
+    /* Lease owners are indices into 'workers'. */
+    for (auto& lease : leases)
+        if (lease.second.worker > w) --lease.second.worker;
+}
+
+void CollisionCoordinator::_Requeue(uint64_t id)
+{
+    auto lease = leases.find(id);
+    if (lease == leases.end()) return;
+
+    pending.push_front(lease->second.slice);
+    leases.erase(lease);
+}
+
+/* One derivation per reported match, so a confused worker cannot end a search. */
+bool CollisionCoordinator::_Confirms(uint64_t mac) const
+{
+    vba_salt_template_t salt;
+    init_salt_template(&salt, NULL);
+
+    return job.legitimate_suffix
+        == derive_address_suffix(job.voucher_seed, &salt, MacAddress::FromU64(mac), job.iterations, job.algorithm).value;
+}
+
+void CollisionCoordinator::_ExpireLeases()
+{
+    auto now = std::chrono::steady_clock::now();
+
+    for (size_t w = 0; w < workers.size(); ++w) {
+        auto lease = leases.find(workers[w].lease);
+        if (lease == leases.end() || lease->second.deadline > now) continue;
+
+        printf("\n\t\tLease %lu from %s expired; it goes back to the queue.", lease->first, workers[w].peer.c_str());
+        _Requeue(workers[w].lease);
+        workers[w].lease = 0;
+    }
+}
+
+
+bool CollisionCoordinator::_Handle(size_t w, const std::string& line)
+{
+    coordinator_worker_t& worker = workers[w];
+    char verb[16] = {0};
+    uint64_t id = 0, value = 0;
+
+    int fields = sscanf(line.c_str(), "%15s %lx %lx", verb, &id, &value);
+    if (fields < 1) return true;
+
+    auto lease = leases.find(id);
+    bool current = lease != leases.end() && lease->second.worker == w && worker.lease == id;
+
+    if (0 == strcmp(verb, "HELLO")) {
+        worker.threads = (unsigned int)id;
+        printf("\n\t\tWorker %s joined with %u threads.", worker.peer.c_str(), worker.threads);
+        worker.socket->Send("OK");
+
+    } else if (0 == strcmp(verb, "NEXT")) {
+        if (finished) {
+            worker.socket->Send("BYE");
+        } else if (!searching || found || pending.empty()) {
+            worker.socket->Send("WAIT " + std::to_string(COORDINATOR_WAIT_MS));
+        } else {
+            /* Leases are cut from the front of the queue as they are handed out. */
+            collision_slice_t& front = pending.front();
+            collision_slice_t slice = { front.first, std::min(front.last, front.first + lease_size) };
+            front.first = slice.last;
+            if (front.first >= front.last) pending.pop_front();
+
+            uint64_t lease_id = next_lease++;
+            leases[lease_id] = { lease_id, slice, w, std::chrono::steady_clock::now() + COORDINATOR_LEASE_TIMEOUT };
+            worker.lease = lease_id;
+            worker.lease_candidates = 0;
+
+            char message[256];
+            char seed[33];
+            for (int i = 0; i < 16; ++i)
+                snprintf(&seed[i * 2], 3, "%02x", job.voucher_seed[i]);
+            snprintf(message, sizeof(message), "LEASE %lx %x %x %lx %s %x %x %lx %lx",
+                     lease_id, job.algorithm, job.iterations, job.legitimate_suffix, seed,
+                     job.argon2.memory_kib, job.argon2.lanes, slice.first, slice.last);
+            worker.socket->Send(message);
+        }
+
+    } else if (0 == strcmp(verb, "PROGRESS")) {
+        if (current && !found) {
+            lease->second.deadline = std::chrono::steady_clock::now() + COORDINATOR_LEASE_TIMEOUT;
+            if (value > worker.lease_candidates) {
+                worker.candidates += value - worker.lease_candidates;
+                worker.lease_candidates = value;
+            }
+            worker.socket->Send("OK");
+        } else {
+            worker.socket->Send("CANCEL");
+        }
+
+    } else if (0 == strcmp(verb, "DONE")) {
+        if (current) {
+            if (value > worker.lease_candidates) worker.candidates += value - worker.lease_candidates;
+            leases.erase(lease);
+            worker.lease = 0;
+        }
+        worker.socket->Send("OK");
+
+    } else if (0 == strcmp(verb, "MATCH")) {
+        /*
+         * A match is a match even on a lease that was given up on in the meantime, but
+         *   not on one from an earlier search, and only if it derives the target here too.
+         */
+        if (searching && !found && 3 == fields && id >= first_lease) {
+            if (_Confirms(value)) {
+                found = true;
+                found_mac = value;
+                printf("\n\t\tWorker %s matched on lease %lu.", worker.peer.c_str(), id);
+            } else {
+                fprintf(stderr, "Worker %s reported MAC %lx on lease %lu, which does not match; ignoring it.\n",
+                        worker.peer.c_str(), value, id);
+            }
+        }
+        if (current) {
+            leases.erase(lease);
+            worker.lease = 0;
+        }
+        worker.socket->Send("OK");
+
+    } else {
+        fprintf(stderr, "Worker %s sent '%s'; dropping it.\n", worker.peer.c_str(), line.c_str());
+        _Drop(w);
+        return false;
+    }
+
+    return true;
+}
+
+
+std::vector<collision_slice_t> CollisionCoordinator::_Remaining() const
+{
+    std::vector<collision_slice_t> remaining(pending.begin(), pending.end());
+    for (const auto& lease : leases)
+        remaining.push_back(lease.second.slice);
+
+    std::sort(remaining.begin(), remaining.end(), [](const collision_slice_t& a, const collision_slice_t& b) {
+        return a.first < b.first;
+    });
+    return remaining;
+}
+
+void CollisionCoordinator::_PrintStatus(bool final) const
+{
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - search_start).count();
+    uint64_t total = 0;
+
+    printf("\n\t\t%s: %zu workers, %zu leases out, %zu ranges queued, %.1f s",
+           final ? "Search over" : "Status", workers.size(), leases.size(), pending.size(), elapsed);
+
+    for (const auto& worker : workers) {
+        total += worker.candidates;
+        printf("\n\t\t\t%-24s %2u threads  %12lu MACs  %10.0f/s",
+               worker.peer.c_str(), worker.threads, worker.candidates,
+               elapsed > 0 ? worker.candidates / elapsed : 0.0);
+    }
+
+    printf("\n\t\t\tTotal %lu MACs, %.0f/s", total, elapsed > 0 ? total / elapsed : 0.0);
+    fflush(stdout);
+}
+
+
+void CollisionCoordinator::Finish()
+{
+    finished = true;
+
+    /* Everyone asking for work is told to leave; give stragglers a lease timeout to ask. */
+    auto deadline = std::chrono::steady_clock::now() + COORDINATOR_LEASE_TIMEOUT;
+    while (listener && !workers.empty() && std::chrono::steady_clock::now() < deadline)
+        _Poll(COORDINATOR_WAIT_MS);
+
+    workers.clear();
+    listener.reset();
+
+    for (pid_t child : children) {
+        int status;
+        while (waitpid(child, &status, 0) < 0 && EINTR == errno) {}
+    }
+    children.clear();
+}
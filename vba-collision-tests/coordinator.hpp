@@ -0,0 +1,162 @@
+#ifndef _COORDINATOR_H_
+#define _COORDINATOR_H_
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "vba.h"
+#include "collision_pool.hpp"
+
+
+/*
+ * Sharding the ordered search across processes and hosts. A coordinator listens on
+ *   a TCP port and hands out MAC-range leases; worker processes search each lease
+ *   with their own CollisionPool and report back. The protocol is one text line per
+ *   message, always a worker request followed by one coordinator reply:
+ *
+ *     HELLO <threads>                  -> OK
+ *     NEXT                             -> LEASE <id> <algorithm> <iterations> <suffix>
+ *                                               <seed> <argon2 KiB> <argon2 lanes>
+ *                                               <first> <last>
+ *                                         | WAIT <ms> | BYE
+ *     PROGRESS <id> <candidates>       -> OK | CANCEL
+ *     DONE <id> <candidates>           -> OK
+ *     MATCH <id> <mac>                 -> OK
+ *
+ *   Every number is hex. A lease that is not renewed by PROGRESS within
+ *   COORDINATOR_LEASE_TIMEOUT, or whose worker disconnects, goes back to the queue
+ *   whole; late reports about it are ignored.
+ */
+#define COORDINATOR_DEFAULT_PORT      "47800"
+#define COORDINATOR_LEASE_CHUNKS      1024
+#define COORDINATOR_LEASE_TIMEOUT     std::chrono::seconds(30)
+#define COORDINATOR_PROGRESS_EVERY    std::chrono::milliseconds(1000)
+#define COORDINATOR_STATUS_EVERY      std::chrono::seconds(10)
+#define COORDINATOR_WAIT_MS           250
+#define COORDINATOR_CONNECT_ATTEMPTS  30
+
+
+/* Newline-framed messages over a blocking stream socket. */
+class LineSocket
+{
+public:
+    explicit LineSocket(int fd = -1) : fd(fd) {}
+    ~LineSocket();
+
+    LineSocket(const LineSocket&) = delete;
+    LineSocket& operator=(const LineSocket&) = delete;
+
+    /* "host:port" or "port"; returns -1 with a message on stderr on failure. */
+    static int Connect(const char* address);
+    static int Listen(const char* address);
+
+    int Fd() const { return fd; }
+    bool Send(const std::string& line);
+
+    /* One read() into the buffer; false on end of stream or error. */
+    bool Fill();
+    bool TakeLine(std::string* line);
+
+    /* Blocks until a whole line arrives. */
+    bool ReadLine(std::string* line);
+
+private:
+    int fd;
+    std::string buffer;
+};
+
+
+/* Everything a worker needs to search a lease on its own. */
+typedef struct _collision_job {
+    VbaAlgorithm algorithm;
+    uint16_t iterations;
+    uint64_t legitimate_suffix;
+    uint8_t voucher_seed[16];
+    vba_argon2_params_t argon2;
+} collision_job_t;
+
+typedef struct _coordinator_lease {
+    uint64_t id;
+    collision_slice_t slice;
+    size_t worker;
+    std::chrono::steady_clock::time_point deadline;
+} coordinator_lease_t;
+
+typedef struct _coordinator_worker {
+    std::unique_ptr<LineSocket> socket;
+    std::string peer;
+    unsigned int threads;
+    uint64_t lease;          /* Zero when it holds none. */
+    uint64_t lease_candidates;
+    uint64_t candidates;     /* Across every finished or reported lease. */
+    std::chrono::steady_clock::time_point joined;
+} coordinator_worker_t;
+
+
+class CollisionCoordinator
+{
+public:
+    CollisionCoordinator() = default;
+    ~CollisionCoordinator();
+
+    bool Listen(const char* address);
+
+    /*
+     * Starts 'count' copies of this program as workers connected to this coordinator,
+     *   each with a pool of 'threads' workers.
+     */
+    bool SpawnWorkers(unsigned int count, unsigned int threads);
+
+    /*
+     * Leases out 'slices' 'lease_size' MACs at a time until every one is searched or a
+     *   worker matches. 'progress' gets the unfinished slices (queued and leased) every
+     *   'interval'. Returns true with the MAC on a match.
+     */
+    bool RunSearch(const collision_job_t& job,
+                   const std::vector<collision_slice_t>& slices,
+                   uint64_t lease_size,
+                   CollisionPool::progress_fn progress,
+                   std::chrono::milliseconds interval,
+                   uint64_t* match_mac);
+
+    /* Tells every worker to exit and waits for spawned ones. */
+    void Finish();
+
+private:
+    void _Poll(int timeout_ms);
+    void _Accept();
+    void _Drop(size_t w);
+    bool _Handle(size_t w, const std::string& line);   /* False if it dropped the worker. */
+    void _ExpireLeases();
+    void _Requeue(uint64_t lease);
+    bool _Confirms(uint64_t mac) const;
+    std::vector<collision_slice_t> _Remaining() const;
+    void _PrintStatus(bool final) const;
+
+    std::unique_ptr<LineSocket> listener;
+    std::string address;
+    std::vector<coordinator_worker_t> workers;
+    std::vector<pid_t> children;
+
+    std::deque<collision_slice_t> pending;
+    std::map<uint64_t, coordinator_lease_t> leases;
+    uint64_t next_lease = 1;
+    uint64_t first_lease = 1;   /* Lower ids belong to earlier searches. */
+    uint64_t lease_size = 1;
+
+    collision_job_t job = {};
+    bool searching = false;
+    bool finished = false;
+    bool found = false;
+    uint64_t found_mac = 0;
+    std::chrono::steady_clock::time_point search_start;
+};
+
+
+#endif /* _COORDINATOR_H_ */
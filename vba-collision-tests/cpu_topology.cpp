@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+
+#include "cpu_topology.hpp"
+
+
+std::vector<int> CpuTopology::ParseCpuList(const char* text)
+{
+    std::vector<int> cpus;
+
+    while (*text) {
+        char* end;
+        long first = strtol(text, &end, 10);
+        if (end == text) break;
+
+        long last = first;
+        if ('-' == *end) {
+            text = end + 1;
+            last = strtol(text, &end, 10);
+            if (end == text) break;
+        }
+
+        for (long cpu = first; cpu <= last; ++cpu)
+            cpus.push_back((int)cpu);
+
+        text = end;
+        if (',' == *text) ++text;
+        else break;
+    }
+
+    return cpus;
+}
+
+
+CpuTopology CpuTopology::Detect()
+{
+    CpuTopology topology;
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool masked = 0 == sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    DIR* directory = opendir(CPU_TOPOLOGY_SYSFS);
+    for (struct dirent* entry; directory && (entry = readdir(directory)); ) {
+        int node;
+        if (1 != sscanf(entry->d_name, "node%d", &node)) continue;
+
+        std::string path = std::string(CPU_TOPOLOGY_SYSFS "/") + entry->d_name + "/cpulist";
+        FILE* file = fopen(path.c_str(), "r");
+        if (!file) continue;
+
+        char line[4096] = {0};
+        if (fgets(line, sizeof(line), file)) {
+            cpu_node_t found = { node, {} };
+            for (int cpu : ParseCpuList(line))
+                if (!masked || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+                    found.cpus.push_back(cpu);
+
+            /* Memory-only nodes have no CPUs to place threads on. */
+            if (!found.cpus.empty()) topology.nodes.push_back(found);
+        }
+        fclose(file);
+    }
+    if (directory) closedir(directory);
+
+    if (topology.nodes.empty()) {
+        cpu_node_t only = { 0, {} };
+        int count = (int)std::thread::hardware_concurrency();
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (masked ? CPU_ISSET(cpu, &allowed) : cpu < count)
+                only.cpus.push_back(cpu);
+        if (only.cpus.empty()) only.cpus.push_back(0);
+        topology.nodes.push_back(only);
+    }
+
+    std::sort(topology.nodes.begin(), topology.nodes.end(),
+              [](const cpu_node_t& a, const cpu_node_t& b) { return a.node < b.node; });
+    return topology;
+}
+
+
+size_t CpuTopology::CpuCount() const
+{
+    size_t count = 0;
+    for (const auto& node : nodes)
+        count += node.cpus.size();
+    return count;
+}
+
+int CpuTopology::CpuFor(unsigned int index, bool spread) const
+{
+    index %= (unsigned int)CpuCount();
+
+    if (!spread) {
+        for (const auto& node : nodes) {
+            if (index < node.cpus.size()) return node.cpus[index];
+            index -= (unsigned int)node.cpus.size();
+        }
+        return -1;
+    }
+
+    /* Round-robin over nodes; nodes with fewer CPUs drop out once they are full. */
+    for (size_t round = 0; ; ++round) {
+        for (const auto& node : nodes) {
+            if (round >= node.cpus.size()) continue;
+            if (!index--) return node.cpus[round];
+        }
+    }
+}
+
+int CpuTopology::NodeOf(int cpu) const
+{
+    for (const auto& node : nodes)
+        if (std::find(node.cpus.begin(), node.cpus.end(), cpu) != node.cpus.end())
+            return node.node;
+    return -1;
+}
+
+
+void CpuTopology::Print() const
+{
+    printf("CPU topology: %zu NUMA node%s.\n", nodes.size(), 1 == nodes.size() ? "" : "s");
+
+    /* Back in 'cpulist' form, runs folded into ranges. */
+    for (const auto& node : nodes) {
+        printf("\tNode %d: %zu CPUs (", node.node, node.cpus.size());
+        for (size_t i = 0, j; i < node.cpus.size(); i = j) {
+            for (j = i + 1; j < node.cpus.size() && node.cpus[j] == node.cpus[j - 1] + 1; ++j) {}
+            printf("%s%d", i ? "," : "", node.cpus[i]);
+            if (j - i > 1) printf("-%d", node.cpus[j - 1]);
+        }
+        printf(")\n");
+    }
+}
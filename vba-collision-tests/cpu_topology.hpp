@@ -0,0 +1,47 @@
+#ifndef _CPU_TOPOLOGY_H_
+#define _CPU_TOPOLOGY_H_
+
+#include <vector>
+#include <stddef.h>
+
+
+#define CPU_TOPOLOGY_SYSFS  "/sys/devices/system/node"
+
+
+typedef struct _cpu_node {
+    int node;
+    std::vector<int> cpus;   /* Only those this process may run on. */
+} cpu_node_t;
+
+
+/*
+ * NUMA nodes and their CPUs as sysfs describes them, restricted to the process's
+ *   affinity mask. Without sysfs node information everything is one node.
+ */
+class CpuTopology
+{
+public:
+    static CpuTopology Detect();
+
+    const std::vector<cpu_node_t>& Nodes() const { return nodes; }
+    size_t CpuCount() const;
+
+    /*
+     * The CPU for the 'index'th thread. 'spread' deals threads out across nodes in
+     *   turn, so every socket's memory bandwidth is used from the second thread on;
+     *   otherwise each node is filled before the next is used.
+     */
+    int CpuFor(unsigned int index, bool spread) const;
+    int NodeOf(int cpu) const;
+
+    void Print() const;
+
+    /* "0-3,8,10-11" as in sysfs 'cpulist' files. */
+    static std::vector<int> ParseCpuList(const char* text);
+
+private:
+    std::vector<cpu_node_t> nodes;
+};
+
+
+#endif /* _CPU_TOPOLOGY_H_ */
@@ -0,0 +1,74 @@
+#ifndef _DERIVATION_STORE_H_
+#define _DERIVATION_STORE_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "vba.h"
+
+
+#define DERIVATION_STORE_ENV            "VBA_DERIVATION_STORE"
+#define DERIVATION_STORE_DEFAULT_PATH   "vba-derivations.db"
+#define DERIVATION_STORE_MIN_CAPACITY   1024
+
+
+/*
+ * A persistent, memory-mapped table of address suffixes that have already been
+ *   derived, keyed by (algorithm, voucher seed, MAC, iterations). Long benchmark
+ *   and attack campaigns use it to skip re-deriving targets they already know.
+ *
+ * The file is an open-addressed hash table that doubles (through a rewritten
+ *   file, renamed over the old one) once it is three quarters full. Argon2
+ *   entries also record the memory and lane parameters they were derived with.
+ *   A handle is safe to share between threads; one file must not be written by
+ *   two processes at once.
+ */
+typedef struct _derivation_store derivation_store_t;
+
+/* Opens or creates the store at 'path'. Returns NULL if the file cannot be used. */
+derivation_store_t *derivation_store_open(const char *path, size_t initial_capacity);
+void derivation_store_close(derivation_store_t *store);
+
+/*
+ * The process-wide store at '$VBA_DERIVATION_STORE', or 'vba-derivations.db' in the
+ *   working directory. Setting the variable to an empty string disables it, and
+ *   NULL is returned then or if the file cannot be opened.
+ */
+derivation_store_t *derivation_store_default();
+
+/* Returns 1 and fills 'suffix' on a hit, 0 on a miss. */
+int derivation_store_lookup(derivation_store_t *store,
+                            enum VbaAlgorithm algorithm,
+                            const uint8_t *voucher_seed,
+                            const uint8_t *mac_address,
+                            uint16_t iterations,
+                            uint64_t *suffix);
+
+/* Returns 0 on success, -1 if the table could not grow. */
+int derivation_store_insert(derivation_store_t *store,
+                            enum VbaAlgorithm algorithm,
+                            const uint8_t *voucher_seed,
+                            const uint8_t *mac_address,
+                            uint16_t iterations,
+                            uint64_t suffix);
+
+/*
+ * The full address suffix (as 'build_address_suffix' returns it), from the store when
+ *   known, otherwise derived and recorded unless the KDF failed. A NULL store always
+ *   derives.
+ */
+uint64_t derivation_store_get_suffix(derivation_store_t *store,
+                                     const uint8_t *voucher_seed,
+                                     const uint8_t *mac_address,
+                                     uint16_t iterations,
+                                     enum VbaAlgorithm algorithm);
+
+void derivation_store_stats(derivation_store_t *store,
+                            uint64_t *entries, uint64_t *hits, uint64_t *misses);
+
+/* Flushes dirty pages to disk; also done on close. */
+void derivation_store_sync(derivation_store_t *store);
+
+
+#endif /* _DERIVATION_STORE_H_ */
@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#include "mac_exclusions.hpp"
+
+
+static const uint64_t _mac_space = 1ULL << 48;
+
+
+static inline int _hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool parse_mac(const char* text, uint64_t* mac, const char** end)
+{
+    uint64_t value = 0;
+
+    for (int octet = 0; octet < 6; ++octet) {
+        if (octet && (':' == *text || '-' == *text)) ++text;
+
+        int high = _hex_digit(text[0]);
+        int low = high < 0 ? -1 : _hex_digit(text[1]);
+        if (low < 0) return false;
+
+        value = (value << 8) | (uint64_t)(high << 4 | low);
+        text += 2;
+    }
+
+    *mac = value;
+    if (end) *end = text;
+    return true;
+}
+
+
+MacExclusions::MacExclusions()
+{
+    /* Group addresses: the I/G bit is the lowest bit of the first octet. */
+    for (uint64_t first_octet = 0x01; first_octet < 0x100; first_octet += 2)
+        intervals.push_back({ first_octet << 40, (first_octet + 1) << 40 });
+
+    /* Reserved for use by IANA: OUI 00-00-5E. The other RFC 7042 ranges, */
+    /*   01-00-5E and 33-33 for multicast and CF for PPP, are group addresses already. */
+    Add(0x00005E000000ULL, 0x00005F000000ULL);
+}
+
+
+bool MacExclusions::Add(uint64_t first, uint64_t last)
+{
+    if (last > _mac_space) last = _mac_space;
+    if (first >= last) return true;
+
+    /* Every interval touching [first, last) is folded into it. */
+    size_t from = _Find(first ? first - 1 : 0);
+    size_t to = from;
+    while (to < intervals.size() && intervals[to].first <= last) {
+        first = std::min(first, intervals[to].first);
+        last = std::max(last, intervals[to].last);
+        ++to;
+    }
+
+    if (to == from && intervals.size() >= MAC_EXCLUSIONS_MAX) return false;
+
+    intervals.erase(intervals.begin() + from, intervals.begin() + to);
+    intervals.insert(intervals.begin() + from, { first, last });
+    return true;
+}
+
+
+bool MacExclusions::LoadFile(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot open exclusions file '%s'.\n", path);
+        return false;
+    }
+
+    bool ok = true;
+    char line[256];
+    for (unsigned long number = 1; ok && fgets(line, sizeof(line), file); ++number) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        const char* text = line + strspn(line, " \t");
+        if (!*text || '#' == *text) continue;
+
+        uint64_t first, last;
+        if (!parse_mac(text, &first, &text)) {
+            fprintf(stderr, "%s:%lu: not a MAC address: '%s'\n", path, number, line);
+            continue;
+        }
+
+        text += strspn(text, " \t");
+        if (!*text) {
+            last = first;
+        } else if (!parse_mac(text, &last) || last < first) {
+            fprintf(stderr, "%s:%lu: not a MAC range: '%s'\n", path, number, line);
+            continue;
+        }
+
+        if (!(ok = Add(first, last + 1)))
+            fprintf(stderr, "%s:%lu: more than %d excluded ranges.\n", path, number, MAC_EXCLUSIONS_MAX);
+    }
+
+    fclose(file);
+    return ok;
+}
+
+
+uint64_t MacExclusions::Excluded() const
+{
+    return Excluded(0, _mac_space);
+}
+
+uint64_t MacExclusions::Excluded(uint64_t first, uint64_t last) const
+{
+    uint64_t excluded = 0;
+
+    for (size_t i = _Find(first); i < intervals.size() && intervals[i].first < last; ++i)
+        excluded += std::min(last, intervals[i].last) - std::max(first, intervals[i].first);
+
+    return excluded;
+}
+
+
+std::vector<collision_slice_t> MacExclusions::Clip(const std::vector<collision_slice_t>& slices) const
+{
+    std::vector<collision_slice_t> clipped;
+
+    /* Jump from each gap between intervals straight to the next one. */
+    for (const auto& slice : slices) {
+        uint64_t mac = slice.first;
+
+        for (size_t i = _Find(mac); mac < slice.last; ++i) {
+            uint64_t gap_end = i < intervals.size() ? std::min(slice.last, intervals[i].first) : slice.last;
+
+            if (mac < gap_end) clipped.push_back({ mac, gap_end });
+            if (i >= intervals.size()) break;
+
+            mac = std::max(mac, intervals[i].last);
+        }
+    }
+
+    return clipped;
+}
+
+
+void MacExclusions::PrintSummary() const
+{
+    uint64_t excluded = Excluded();
+
+    printf("Excluding %zu MAC ranges: %lu of 2^48 MACs (%.2f%%), leaving %lu candidates.\n",
+           Size(), excluded, 100.0 * excluded / _mac_space, _mac_space - excluded);
+}
@@ -0,0 +1,79 @@
+#ifndef _MAC_EXCLUSIONS_H_
+#define _MAC_EXCLUSIONS_H_
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "collision_pool.hpp"
+
+
+/* Fewer than the pool's 4095 slices, with room left for one home slice per thread. */
+#define MAC_EXCLUSIONS_MAX  2048
+
+
+/*
+ * Six hex octets separated by ':' or '-' (or not at all). Returns false if 'text'
+ *   does not start with one; otherwise '*end', if given, points past it.
+ */
+bool parse_mac(const char* text, uint64_t* mac, const char** end = nullptr);
+
+
+/*
+ * MACs no real node would have, so a search never derives them: every group
+ *   (multicast or broadcast) address, the ranges RFC 7042 reserves, and whatever the
+ *   user adds. Held as sorted, disjoint [first, last) intervals. 'Clip' takes them
+ *   out of a search's slices up front, so chunks only ever cover usable MACs and the
+ *   ordered loop has nothing to test.
+ */
+class MacExclusions
+{
+public:
+    /* Starts with the group addresses and the RFC 7042 reservations. */
+    MacExclusions();
+
+    /* [first, last); overlapping or adjacent intervals are merged. False if full. */
+    bool Add(uint64_t first, uint64_t last);
+
+    /*
+     * One "<first MAC> [<last MAC>]" per line, both ends included. Blank lines and '#'
+     *   comments are skipped. Returns false if the file cannot be read or is too long;
+     *   bad lines are reported and skipped.
+     */
+    bool LoadFile(const char* path);
+
+    size_t Size() const { return intervals.size(); }
+
+    /* How many MACs are excluded, in all or within [first, last). */
+    uint64_t Excluded() const;
+    uint64_t Excluded(uint64_t first, uint64_t last) const;
+
+    inline bool Contains(uint64_t mac) const
+    {
+        size_t i = _Find(mac);
+        return i < intervals.size() && intervals[i].first <= mac;
+    }
+
+    /* 'slices' with every excluded MAC cut out, in the same order. */
+    std::vector<collision_slice_t> Clip(const std::vector<collision_slice_t>& slices) const;
+
+    void PrintSummary() const;
+
+private:
+    /* The first interval that ends after 'mac'. */
+    inline size_t _Find(uint64_t mac) const
+    {
+        size_t low = 0, high = intervals.size();
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (intervals[middle].last <= mac) low = middle + 1;
+            else high = middle;
+        }
+        return low;
+    }
+
+    std::vector<collision_slice_t> intervals;
+};
+
+
+#endif /* _MAC_EXCLUSIONS_H_ */
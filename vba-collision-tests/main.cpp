@@ -12,24 +12,190 @@
 
 
 #include <chrono>
+#include <getopt.h>
 #include <sstream>
+#include <thread>
 #include <tuple>
 #include <vector>
 #include <string>
 
 #include "vba.h"
 #include "generator.h"
+#include "kdf_backends.h"
+#include "derivation_store.h"
+#include "timing.hpp"
 
 #include "collisions.hpp"
 
 
-int main()
+static void _usage(const char* program)
 {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "\n"
+            "  -r, --resume                Skip finished searches and continue the ordered search\n"
+            "                              that was under way when the checkpoint was taken.\n"
+            "  -c, --checkpoint FILE       Checkpoint file (default " COLLISION_CHECKPOINT_DEFAULT ");\n"
+            "                              an empty name turns checkpoints off.\n"
+            "  -e, --checkpoint-every SEC  Seconds between ordered-search checkpoints (default %d).\n"
+            "  -t, --targets FILE          Also accept a collision with any address listed in FILE,\n"
+            "                              one per line, optionally followed by \",<owner MAC>\".\n"
+            "                              Each search uses the ones with its iteration count.\n"
+            "  -n, --neighbours N          Also accept a collision with the stable MAC's next N\n"
+            "                              MACs (at most %u).\n"
+            "  -x, --exclude FILE          Never search the MACs in FILE, one \"<first> [<last>]\"\n"
+            "                              range per line, besides group and reserved MACs.\n"
+            "  -i, --telemetry-every SEC   Seconds between progress lines (default %d; 0 for none).\n"
+            "  -m, --metrics [HOST:]PORT   Serve Prometheus metrics there (a bare port means\n"
+            "                              localhost only).\n"
+            "  -p, --pin spread|compact    Pin pool workers to CPUs, dealt across NUMA nodes in\n"
+            "                              turn (spread) or filling one node first (compact),\n"
+            "                              and keep each worker's Argon2 memory on its node.\n"
+            "  -j, --threads N             Pool workers (default: one per hardware thread). With\n"
+            "                              --spawn-workers, shared out among the spawned workers.\n"
+            "  -T, --tune                  Find the best number of workers for each algorithm and\n"
+            "                              iteration count not yet in the tuning file, and add it.\n"
+            "      --tuning FILE           Tuning file (default " COLLISION_TUNING_DEFAULT "); searches\n"
+            "                              use the worker counts recorded there for this pool size.\n"
+            "                              An empty name turns tuning off.\n"
+            "  -C, --coordinate [HOST:]PORT\n"
+            "                              Lease ordered searches to worker processes connecting\n"
+            "                              here instead of searching in this process.\n"
+            "  -s, --spawn-workers N       With --coordinate, also start N local workers.\n"
+            "  -w, --worker HOST:PORT      Search leases from that coordinator until it is done.\n"
+            "                              Workers, spawned or not, take only --threads; they\n"
+            "                              ignore --pin and the other search options.\n",
+            program, COLLISION_CHECKPOINT_SECONDS, COLLISION_MAX_NEIGHBOURS, TELEMETRY_DEFAULT_SECONDS);
+}
+
+/* Each spawned worker's share of the local threads, so together they do not oversubscribe. */
+static unsigned int _spawned_threads(unsigned int threads, unsigned int workers)
+{
+    if (!threads) threads = std::thread::hardware_concurrency();
+    if (!workers) return threads;
+
+    return threads / workers ? threads / workers : 1;
+}
+
+int main(int argc, char** argv)
+{
+    collision_options_t options = collision_default_options();
+    const char* coordinate = NULL;
+    const char* worker = NULL;
+    unsigned int spawn_workers = 0;
+    std::string metrics;
+
+    static const struct option long_options[] = {
+        { "resume",           no_argument,       NULL, 'r' },
+        { "checkpoint",       required_argument, NULL, 'c' },
+        { "checkpoint-every", required_argument, NULL, 'e' },
+        { "targets",          required_argument, NULL, 't' },
+        { "neighbours",       required_argument, NULL, 'n' },
+        { "exclude",          required_argument, NULL, 'x' },
+        { "telemetry-every",  required_argument, NULL, 'i' },
+        { "metrics",          required_argument, NULL, 'm' },
+        { "pin",              required_argument, NULL, 'p' },
+        { "threads",          required_argument, NULL, 'j' },
+        { "tune",             no_argument,       NULL, 'T' },
+        { "tuning",           required_argument, NULL, 'U' },
+        { "coordinate",       required_argument, NULL, 'C' },
+        { "spawn-workers",    required_argument, NULL, 's' },
+        { "worker",           required_argument, NULL, 'w' },
+        { "help",             no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    for (int opt; -1 != (opt = getopt_long(argc, argv, "rc:e:t:n:x:i:m:p:j:TC:s:w:h", long_options, NULL)); ) {
+        switch (opt) {
+            case 'r': options.resume = true; break;
+            case 'c': options.checkpoint_path = optarg; break;
+            case 'e':
+                options.checkpoint_seconds = (unsigned int)strtoul(optarg, NULL, 0);
+                if (!options.checkpoint_seconds) {
+                    fprintf(stderr, "Checkpoints need at least one second between them.\n");
+                    return 1;
+                }
+                break;
+            case 't': options.targets_path = optarg; break;
+            case 'n':
+                options.neighbours = (unsigned int)strtoul(optarg, NULL, 0);
+                if (options.neighbours > COLLISION_MAX_NEIGHBOURS) {
+                    fprintf(stderr, "At most %u neighbours can be targeted.\n", COLLISION_MAX_NEIGHBOURS);
+                    return 1;
+                }
+                break;
+            case 'x': options.exclusions_path = optarg; break;
+            case 'i': options.telemetry_seconds = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'm':
+                metrics = strchr(optarg, ':') ? optarg : std::string("127.0.0.1:") + optarg;
+                options.metrics_address = metrics.c_str();
+                break;
+            case 'p':
+                if (strcmp(optarg, "spread") && strcmp(optarg, "compact")) {
+                    fprintf(stderr, "--pin takes 'spread' or 'compact'.\n");
+                    return 1;
+                }
+                options.pin = optarg;
+                break;
+            case 'j': options.threads = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'T': options.tune = true; break;
+            case 'U': options.tuning_path = optarg; break;
+            case 'C': coordinate = optarg; break;
+            case 's': spawn_workers = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'w': worker = optarg; break;
+            default:
+                _usage(argv[0]);
+                return 'h' == opt ? 0 : 1;
+        }
+    }
+
+    if (spawn_workers && !coordinate) {
+        fprintf(stderr, "--spawn-workers needs --coordinate.\n");
+        return 1;
+    }
+
+    /* Leases carry a single target suffix. */
+    if ((coordinate || worker) && (options.targets_path || options.neighbours)) {
+        fprintf(stderr, "--targets and --neighbours cannot be combined with --coordinate or --worker.\n");
+        return 1;
+    }
+
     Xoshiro128p__init();
 
+    /* Self-test the registered KDF backends and use the fastest correct one of each. */
+    /*   Set VBA_KDF_BACKEND (e.g. "pbkdf2=intree") to pin a backend instead. */
+    printf("KDF backends:\n");
+    for (int a = 1; a < VBA_ALGORITHM_SLOTS; ++a)
+        kdf_backends_autoselect((VbaAlgorithm)a, KDF_SELECT_ITERATIONS, 1);
+    printf("\n");
+
+    if (worker)
+        return run_collision_worker(worker, options.threads);
+
+    CollisionCoordinator coordinator;
+    if (coordinate) {
+        if (!coordinator.Listen(coordinate) || !coordinator.SpawnWorkers(spawn_workers, _spawned_threads(options.threads, spawn_workers)))
+            return 1;
+        options.coordinator = &coordinator;
+    }
+
+    if (!set_collision_options(options))
+        return 1;
+
     rotate_voucher_seed();
 
-    find_collisions_pbkdf2();
-    find_collisions_argon2();
-    find_collisions_scrypt();
+    /* Each search is one span around its threads' block spans in the timing trace. */
+    { TimingSpan search(Timing::Intern("collisions.pbkdf2")); find_collisions_pbkdf2(); }
+    { TimingSpan search(Timing::Intern("collisions.argon2")); find_collisions_argon2(); }
+    { TimingSpan search(Timing::Intern("collisions.scrypt")); find_collisions_scrypt(); }
+
+    uint64_t entries, hits, misses;
+    derivation_store_stats(derivation_store_default(), &entries, &hits, &misses);
+    printf("Derivation store: %lu entries, %lu targets reused, %lu derived.\n", entries, hits, misses);
+
+    if (coordinate) coordinator.Finish();
+
+    /* Per-thread search spans; set VBA_TIMING_TRACE to a path to keep them */
+    /*   ("*.json" writes a Chrome trace for chrome://tracing or Perfetto). */
+    Timing::DumpEventsIfRequested();
 }
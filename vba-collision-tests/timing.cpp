@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <cpuid.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "timing.hpp"
+#include "kdf_backends.h"
+
+
+std::vector<std::tuple<uint64_t, uint64_t, double, double, std::string>> Timing::timing_results{};
+
+uint64_t Timing::ConvertTimeToMicroseconds(std::chrono::high_resolution_clock::time_point start,
+                                           std::chrono::high_resolution_clock::time_point end)
+{
+    std::chrono::duration<double> duration = end - start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+
+void Timing::RecordTiming(uint64_t slot,
+                          uint64_t microseconds,
+                          std::string comment)
+{
+    timing_results.push_back(
+        std::make_tuple(slot,
+                        microseconds,
+                        (double)microseconds / 1000.0,
+                        (double)microseconds / 1000.0 / 1000.0,
+                        comment)
+    );
+}
+
+
+void Timing::RecordTiming(uint64_t slot,
+                          std::chrono::high_resolution_clock::time_point start,
+                          std::chrono::high_resolution_clock::time_point end,
+                          std::string comment)
+{
+    return Timing::RecordTiming(slot, Timing::ConvertTimeToMicroseconds(start, end), comment);
+}
+
+
+void Timing::DumpToCsv(std::string with_name, std::stringstream& to_stream)
+{
+    for (int i = 0; i < (int)timing_results.size(); ++i) {
+        to_stream << with_name << ","
+            << std::get<0>(timing_results[i]) << ","
+            << std::get<1>(timing_results[i]) << ","
+            << std::get<2>(timing_results[i]) << ","
+            << std::get<3>(timing_results[i]) << ","
+            << std::get<4>(timing_results[i])
+            << std::endl;
+    }
+
+    timing_results.clear();
+}
+
+
+/* ===== Event recording ===== */
+
+/* Only an invariant TSC ticks at a constant rate across frequency changes and cores. */
+static bool _invariant_tsc()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) return false;
+    return edx & (1u << 8);
+}
+
+bool Timing::use_tsc = _invariant_tsc();
+thread_local timing_event_block_t* Timing::current_block = nullptr;
+
+/* Shared state touched only when interning, turning over a block, or exporting. */
+static std::mutex _events_lock;
+static std::vector<std::string> _labels;
+static std::unordered_map<std::string, uint32_t> _label_ids;
+static std::vector<timing_event_block_t*> _blocks;
+static uint32_t _next_thread = 0;
+
+/* Pairs of (ticks, steady nanoseconds) far apart give the tick rate. */
+static const uint64_t _epoch_ticks = Timing::Now();
+static const auto _epoch_steady = std::chrono::steady_clock::now();
+
+
+uint32_t Timing::Intern(const char* label)
+{
+    std::lock_guard<std::mutex> guard(_events_lock);
+
+    auto found = _label_ids.find(label);
+    if (found != _label_ids.end()) return found->second;
+
+    uint32_t id = (uint32_t)_labels.size();
+    _labels.push_back(label);
+    _label_ids.emplace(label, id);
+    return id;
+}
+
+timing_event_block_t* Timing::_NewBlock()
+{
+    static thread_local uint32_t thread_id = UINT32_MAX;
+
+    uint32_t capacity = current_block ? current_block->capacity * 2 : TIMING_FIRST_BLOCK_EVENTS;
+    if (capacity > TIMING_BLOCK_EVENTS) capacity = TIMING_BLOCK_EVENTS;
+
+    timing_event_block_t* block = new timing_event_block_t;
+    block->count.store(0, std::memory_order_relaxed);
+    block->capacity = capacity;
+    block->events = new timing_event_t[capacity];
+
+    {
+        std::lock_guard<std::mutex> guard(_events_lock);
+        if (UINT32_MAX == thread_id) thread_id = _next_thread++;
+        block->thread = thread_id;
+        _blocks.push_back(block);
+    }
+
+    current_block = block;
+    return block;
+}
+
+double Timing::TicksToNanoseconds(uint64_t ticks)
+{
+    if (!use_tsc) return (double)ticks;
+
+    /* Re-measured on every call; exports are rare and a longer baseline only helps. */
+    uint64_t elapsed_ticks = Now() - _epoch_ticks;
+    double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - _epoch_steady).count();
+
+    return elapsed_ticks ? ticks * (elapsed_ns / elapsed_ticks) : 0;
+}
+
+size_t Timing::EventCount()
+{
+    std::lock_guard<std::mutex> guard(_events_lock);
+
+    size_t total = 0;
+    for (auto* block : _blocks)
+        total += block->count.load(std::memory_order_acquire);
+    return total;
+}
+
+void Timing::ClearEvents()
+{
+    std::lock_guard<std::mutex> guard(_events_lock);
+
+    /* Blocks stay owned by their threads; emptying them is enough. */
+    for (auto* block : _blocks)
+        block->count.store(0, std::memory_order_release);
+}
+
+/* Every committed event, in start order, with the rate used to convert them. */
+static std::vector<timing_event_t> _snapshot(double* ns_per_tick)
+{
+    *ns_per_tick = Timing::TicksToNanoseconds(1ULL << 32) / (double)(1ULL << 32);
+
+    std::vector<timing_event_t> events;
+    std::lock_guard<std::mutex> guard(_events_lock);
+
+    for (auto* block : _blocks) {
+        uint32_t count = block->count.load(std::memory_order_acquire);
+        events.insert(events.end(), block->events, block->events + count);
+    }
+
+    std::sort(events.begin(), events.end(), [](const timing_event_t& a, const timing_event_t& b) {
+        return a.start < b.start;
+    });
+    return events;
+}
+
+void Timing::DumpEventsToCsv(std::ostream& to_stream)
+{
+    double ns_per_tick;
+    std::vector<timing_event_t> events = _snapshot(&ns_per_tick);
+    uint64_t origin = events.empty() ? 0 : events.front().start;
+
+    to_stream << "Thread,Label,StartNs,DurationNs,Value" << std::endl;
+
+    std::lock_guard<std::mutex> guard(_events_lock);
+    for (const auto& e : events) {
+        to_stream << e.thread << ","
+            << (e.label < _labels.size() ? _labels[e.label] : "?") << ","
+            << (uint64_t)((e.start - origin) * ns_per_tick) << ","
+            << (uint64_t)((e.end - e.start) * ns_per_tick) << ","
+            << e.value
+            << std::endl;
+    }
+}
+
+bool Timing::DumpEventsToBinary(const char* path)
+{
+    double ns_per_tick;
+    std::vector<timing_event_t> events = _snapshot(&ns_per_tick);
+
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+
+    std::lock_guard<std::mutex> guard(_events_lock);
+
+    uint32_t version = 1, label_count = (uint32_t)_labels.size();
+    uint64_t event_count = events.size();
+
+    bool ok = 8 == fwrite(TIMING_TRACE_MAGIC, 1, 8, file)
+        && 1 == fwrite(&version, sizeof(version), 1, file)
+        && 1 == fwrite(&label_count, sizeof(label_count), 1, file)
+        && 1 == fwrite(&event_count, sizeof(event_count), 1, file)
+        && 1 == fwrite(&ns_per_tick, sizeof(ns_per_tick), 1, file);
+
+    for (uint32_t id = 0; ok && id < label_count; ++id) {
+        uint16_t length = (uint16_t)_labels[id].size();
+        ok = 1 == fwrite(&id, sizeof(id), 1, file)
+            && 1 == fwrite(&length, sizeof(length), 1, file)
+            && length == fwrite(_labels[id].data(), 1, length, file);
+    }
+
+    if (ok && event_count)
+        ok = event_count == fwrite(events.data(), sizeof(timing_event_t), event_count, file);
+
+    return 0 == fclose(file) && ok;
+}
+
+static void _write_json_string(std::ostream& to_stream, const std::string& text)
+{
+    to_stream << '"';
+    for (unsigned char c : text) {
+        if ('"' == c || '\\' == c) {
+            to_stream << '\\' << c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            to_stream << escaped;
+        } else {
+            to_stream << c;
+        }
+    }
+    to_stream << '"';
+}
+
+void Timing::DumpEventsToChromeTrace(std::ostream& to_stream)
+{
+    double ns_per_tick;
+    std::vector<timing_event_t> events = _snapshot(&ns_per_tick);
+    uint64_t origin = events.empty() ? 0 : events.front().start;
+
+    std::lock_guard<std::mutex> guard(_events_lock);
+
+    /* Microseconds with nanosecond decimals, as the format expects. */
+    char number[32];
+    to_stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    for (uint32_t thread = 0; thread < _next_thread; ++thread)
+        to_stream << (thread ? "," : "") << "\n{\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+            << ",\"name\":\"thread_name\",\"args\":{\"name\":\"thread " << thread << "\"}}";
+
+    bool first = !_next_thread;
+    for (const auto& e : events) {
+        std::string label = e.label < _labels.size() ? _labels[e.label] : "?";
+
+        to_stream << (first ? "" : ",") << "\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread << ",\"name\":";
+        _write_json_string(to_stream, label);
+        to_stream << ",\"cat\":";
+        _write_json_string(to_stream, label.substr(0, label.find('.')));
+
+        snprintf(number, sizeof(number), "%.3f", (e.start - origin) * ns_per_tick / 1000.0);
+        to_stream << ",\"ts\":" << number;
+        snprintf(number, sizeof(number), "%.3f", (e.end - e.start) * ns_per_tick / 1000.0);
+        to_stream << ",\"dur\":" << number << ",\"args\":{\"value\":" << e.value << "}}";
+
+        first = false;
+    }
+
+    to_stream << "\n]}" << std::endl;
+}
+
+bool Timing::TraceRequested()
+{
+    const char* path = getenv(TIMING_TRACE_ENV);
+    return path && *path;
+}
+
+void Timing::DumpEventsIfRequested()
+{
+    if (!TraceRequested() || !EventCount()) return;
+
+    const char* path = getenv(TIMING_TRACE_ENV);
+    size_t length = strlen(path);
+    bool ok;
+
+    if (length > 5 && 0 == strcmp(path + length - 5, ".json")) {
+        std::ofstream file(path);
+        DumpEventsToChromeTrace(file);
+        file.close();
+        ok = !file.fail();
+    } else {
+        ok = DumpEventsToBinary(path);
+    }
+
+    if (ok)
+        printf("Wrote %zu timing events to '%s'.\n", EventCount(), path);
+    else
+        fprintf(stderr, "Cannot write timing trace '%s'.\n", path);
+}
+
+
+/* Labels per algorithm slot, single and batched, filled in before the hooks go live. */
+static uint32_t _kdf_labels[VBA_ALGORITHM_SLOTS][2];
+
+static uint64_t _kdf_trace_begin(void)
+{
+    return Timing::Now();
+}
+
+static void _kdf_trace_end(enum VbaAlgorithm algorithm, uint16_t iterations, size_t count, uint64_t mark)
+{
+    if ((unsigned int)algorithm >= VBA_ALGORITHM_SLOTS) return;
+    Timing::Record(_kdf_labels[algorithm][count > 1], mark, Timing::Now(), iterations);
+}
+
+void Timing::TraceKdfCalls(bool enable)
+{
+    if (!enable) {
+        kdf_set_trace_hooks(NULL);
+        return;
+    }
+
+    for (int a = 1; a < VBA_ALGORITHM_SLOTS; ++a) {
+        std::string name = std::string("kdf.") + vba_algorithm_name((enum VbaAlgorithm)a);
+        _kdf_labels[a][0] = Intern(name.c_str());
+        _kdf_labels[a][1] = Intern((name + ".batch").c_str());
+    }
+
+    static const kdf_trace_hooks_t hooks = { _kdf_trace_begin, _kdf_trace_end };
+    kdf_set_trace_hooks(&hooks);
+}
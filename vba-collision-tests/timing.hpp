@@ -0,0 +1,146 @@
+#ifndef _TIMING_H_
+#define _TIMING_H_
+
+#include <atomic>
+#include <vector>
+#include <tuple>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <sstream>
+#include <stdint.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+
+
+/*
+ * Each thread records into blocks that start small and double up to the maximum, so
+ *   short-lived worker threads cost little while busy ones turn over rarely.
+ */
+#define TIMING_FIRST_BLOCK_EVENTS  256
+#define TIMING_BLOCK_EVENTS        4096
+#define TIMING_TRACE_MAGIC   "VBATRACE"
+#define TIMING_TRACE_ENV     "VBA_TIMING_TRACE"
+
+
+/* One binary trace record; also the in-memory layout. */
+typedef struct _timing_event {
+    uint32_t label;
+    uint32_t thread;
+    uint64_t start;   /* Ticks; see 'Timing::TicksToNanoseconds'. */
+    uint64_t end;
+    uint64_t value;   /* Free for the caller, e.g. a count of work done in the span. */
+} timing_event_t;
+
+/* Written only by its owning thread; 'count' publishes each event to exporters. */
+typedef struct _timing_event_block {
+    std::atomic<uint32_t> count;
+    uint32_t capacity;
+    uint32_t thread;
+    timing_event_t* events;
+} timing_event_block_t;
+
+
+class Timing
+{
+public:
+    static void RecordTiming(uint64_t slot, uint64_t microseconds, std::string comment = "");
+    static void RecordTiming(uint64_t slot,
+                             std::chrono::high_resolution_clock::time_point start,
+                             std::chrono::high_resolution_clock::time_point end,
+                             std::string comment = "");
+
+    static void DumpToCsv(std::string with_name, std::stringstream& to_stream);
+
+    static uint64_t ConvertTimeToMicroseconds(std::chrono::high_resolution_clock::time_point start,
+                                              std::chrono::high_resolution_clock::time_point end);
+
+    /*
+     * Event recording for hot and threaded code. Labels are interned once up front;
+     *   each thread then appends fixed-size events to its own blocks with no locks
+     *   and no allocation outside block turnover. Ticks come from the TSC when it
+     *   is invariant, and from steady_clock nanoseconds otherwise.
+     *
+     * Exports and 'ClearEvents' see every event whose 'Record' has returned, but
+     *   'ClearEvents' must not run while other threads are still recording.
+     */
+    static uint32_t Intern(const char* label);
+
+    static inline uint64_t Now()
+    {
+        if (use_tsc) return __rdtsc();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static inline void Record(uint32_t label, uint64_t start, uint64_t end, uint64_t value = 0)
+    {
+        timing_event_block_t* block = current_block;
+
+        if (__builtin_expect(!block || block->count.load(std::memory_order_relaxed) == block->capacity, 0))
+            block = _NewBlock();
+
+        uint32_t count = block->count.load(std::memory_order_relaxed);
+        block->events[count] = { label, block->thread, start, end, value };
+        block->count.store(count + 1, std::memory_order_release);
+    }
+
+
+    static double TicksToNanoseconds(uint64_t ticks);
+    static size_t EventCount();
+    static void ClearEvents();
+
+    /* "Thread,Label,StartNs,DurationNs,Value", start times relative to the first event. */
+    static void DumpEventsToCsv(std::ostream& to_stream);
+
+    /*
+     * Header (magic, version, label count, event count, nanoseconds per tick), the
+     *   label table (id, length, bytes), then raw 'timing_event_t' records.
+     */
+    static bool DumpEventsToBinary(const char* path);
+
+    /*
+     * Chrome trace event JSON ("X" complete events) for chrome://tracing or Perfetto.
+     *   Spans on one thread nest by time, the label prefix before the first '.' is
+     *   the category, and the recorded value appears under "args".
+     */
+    static void DumpEventsToChromeTrace(std::ostream& to_stream);
+
+    /*
+     * Writes '$VBA_TIMING_TRACE' if it is set: Chrome trace JSON when the path ends in
+     *   ".json", the binary trace otherwise.
+     */
+    static bool TraceRequested();
+    static void DumpEventsIfRequested();
+
+    /* Records every KDF derivation as a "kdf.<algorithm>" span (see kdf_set_trace_hooks). */
+    static void TraceKdfCalls(bool enable = true);
+
+private:
+    static timing_event_block_t* _NewBlock();
+
+    static bool use_tsc;
+    static thread_local timing_event_block_t* current_block;
+
+    static std::vector<std::tuple<uint64_t, uint64_t, double, double, std::string>> timing_results;
+};
+
+
+/* Records the enclosing scope as one event. */
+class TimingSpan
+{
+public:
+    explicit TimingSpan(uint32_t label, uint64_t value = 0)
+        : label(label), value(value), start(Timing::Now()) {}
+    ~TimingSpan() { Timing::Record(label, start, Timing::Now(), value); }
+
+    void SetValue(uint64_t new_value) { value = new_value; }
+
+private:
+    uint32_t label;
+    uint64_t value;
+    uint64_t start;
+};
+
+
+#endif /* _TIMING_H_ */
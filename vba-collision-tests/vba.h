@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <strings.h>
 
 #include <openssl/evp.h>
 #include <openssl/rand.h>
@@ -17,16 +18,59 @@
 #define ITERATIONS_FACTOR  256
 #define FIXED_ITERS_COUNT  15
 
+#define VBA_SALT_LENGTH         17
+#define VBA_SALT_PREFIX_OFFSET  9
+
+/* "fe80::xxxx:xxxx:xxxx:xxxx", as 'print_lladdr_from_suffix' prints it. */
+#define VBA_LLADDR_FIXED_LENGTH  25
+/* Longest possible RFC 5952 text for any link-local address, without a zone. */
+#define VBA_LLADDR_MAX_LENGTH    39
+
 enum VbaAlgorithm
 {
     PBKDF2 = 1,
     ARGON2 = 2,
     SCRYPT = 3,
+    ARGON2ID = 4,
+    /* Argon2 with 'lanes' > 1, each lane filled by its own thread. */
+    ARGON2D_LANES = 5,
+    ARGON2ID_LANES = 6,
 };
 
+/* One past the largest 'VbaAlgorithm' value; handy for per-algorithm arrays. */
+#define VBA_ALGORITHM_SLOTS  7
+
+#define ARGON2_DEFAULT_MEMORY_KIB  128
+#define ARGON2_DEFAULT_LANES       4
+
+/*
+ * Argon2 cost parameters. Both are inputs to the derivation itself, so every node
+ *   generating or verifying addresses with a given algorithm must use the same
+ *   values. 'lanes' only applies to the *_LANES algorithms; the others use one.
+ */
+typedef struct _vba_argon2_params {
+    uint32_t memory_kib;
+    uint32_t lanes;
+} vba_argon2_params_t;
+
+
+/* MAC (6) + 'vba' (3) + subnet prefix (8). Build once, then patch the MAC per call. */
+typedef struct _vba_salt_template {
+    uint8_t bytes[VBA_SALT_LENGTH];
+} vba_salt_template_t;
+
 
 void rotate_voucher_seed();
 
+/* A NULL prefix selects the link-local fe80::/64 prefix. */
+void init_salt_template(vba_salt_template_t *salt, const uint8_t *subnet_prefix);
+
+uint64_t compute_address_hash_suffix_salted(const uint8_t *voucher_seed,
+                                            vba_salt_template_t *salt,
+                                            const uint8_t *mac_address,
+                                            uint16_t iterations,
+                                            enum VbaAlgorithm algorithm);
+
 uint64_t compute_address_hash_suffix(uint8_t *voucher_seed,
                                      uint8_t *mac_address,
                                      uint16_t iterations,
@@ -36,6 +80,44 @@ uint64_t build_address_suffix(uint16_t iterations, uint64_t hash_result);
 
 void print_lladdr_from_suffix(uint64_t suffix);
 
+/*
+ * Address text without printf. The fixed form always uses four zero-padded groups
+ *   after "fe80::" and writes exactly VBA_LLADDR_FIXED_LENGTH characters plus a
+ *   terminator. The canonical form follows RFC 5952 (lower case, no leading zeros,
+ *   longest zero run compressed). Both return the length written, or 0 if 'size'
+ *   is too small.
+ */
+size_t format_lladdr_fixed(uint64_t suffix, char *out, size_t size);
+size_t format_lladdr(uint64_t suffix, char *out, size_t size);
+
+/*
+ * One address per line, for logs. The fixed form has a stride of
+ *   VBA_LLADDR_FIXED_LENGTH + 1 bytes and no terminator. Returns the bytes written;
+ *   the canonical form stops at the last address that fits entirely.
+ */
+size_t format_lladdrs_fixed(const uint64_t *suffixes, size_t count, char *out, size_t size);
+size_t format_lladdrs(const uint64_t *suffixes, size_t count, char *out, size_t size);
+
+/*
+ * Parses any RFC 4291 text form of a link-local fe80::/64 address (upper or lower
+ *   case, compressed or not, the last 32 bits optionally as a dotted quad, with an
+ *   optional "%zone") into its 64-bit suffix.
+ *   Returns 0 on success, -1 for malformed text or another prefix.
+ */
+int parse_lladdr(const char *text, size_t length, uint64_t *suffix);
+
+/* Lower-case names ("pbkdf2", ...) for options and output; unknown names map to 0. */
+const char *vba_algorithm_name(enum VbaAlgorithm algorithm);
+enum VbaAlgorithm vba_algorithm_from_name(const char *name);
+
+/* Memory is raised to the Argon2 minimum of 8 KiB per lane when needed. */
+void set_argon2_parameters(uint32_t memory_kib, uint32_t lanes);
+vba_argon2_params_t get_argon2_parameters();
+
+uint16_t get_suffix_iterations(uint64_t suffix);
+
+uint64_t estimate_address_cost(uint16_t iterations, VbaAlgorithm algorithm);
+
 bool verify_address_suffix(uint64_t suffix,
                            uint8_t* voucher_seed,
                            uint8_t* mac_address,
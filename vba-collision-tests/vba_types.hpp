@@ -0,0 +1,92 @@
+#ifndef _VBA_TYPES_H_
+#define _VBA_TYPES_H_
+
+#include <stdint.h>
+
+#include "vba.h"
+
+
+/*
+ * A 48-bit link-layer address held as six octets in transmission order. Packing
+ *   to and from integers is big-endian, so 0x01005E000000 is 01-00-5E-00-00-00 and
+ *   consecutive integers walk the address space the way the IEEE assigns it.
+ */
+struct MacAddress
+{
+    uint8_t octets[6];
+
+    static constexpr MacAddress FromU64(uint64_t value)
+    {
+        return MacAddress{{
+            (uint8_t)(value >> 40), (uint8_t)(value >> 32), (uint8_t)(value >> 24),
+            (uint8_t)(value >> 16), (uint8_t)(value >> 8),  (uint8_t)(value),
+        }};
+    }
+
+    constexpr uint64_t ToU64() const
+    {
+        return ((uint64_t)octets[0] << 40) | ((uint64_t)octets[1] << 32)
+             | ((uint64_t)octets[2] << 24) | ((uint64_t)octets[3] << 16)
+             | ((uint64_t)octets[4] << 8)  | ((uint64_t)octets[5]);
+    }
+
+    /* I/G bit: multicast and broadcast addresses. */
+    constexpr bool IsGroup() const { return octets[0] & 0x01; }
+
+    /* U/L bit: locally administered addresses. */
+    constexpr bool IsLocal() const { return octets[0] & 0x02; }
+
+    constexpr bool operator==(const MacAddress& other) const { return ToU64() == other.ToU64(); }
+    constexpr bool operator!=(const MacAddress& other) const { return ToU64() != other.ToU64(); }
+
+    uint8_t* data() { return octets; }
+    const uint8_t* data() const { return octets; }
+};
+
+static_assert(sizeof(MacAddress) == 6, "MacAddress must be exactly six octets.");
+static_assert(MacAddress::FromU64(0x01005E0000FFULL).octets[0] == 0x01, "MacAddress packs big-endian.");
+static_assert(MacAddress::FromU64(0xC001CA70FFFFULL).ToU64() == 0xC001CA70FFFFULL, "MacAddress round trip.");
+
+
+/*
+ * The 64-bit interface identifier of a VBA: the one's complement of the iteration
+ *   count in the top 16 bits, followed by the low 48 bits of the KDF output.
+ */
+struct VbaSuffix
+{
+    uint64_t value;
+
+    static constexpr VbaSuffix Build(uint16_t iterations, uint64_t hash_result)
+    {
+        return VbaSuffix{ ((uint64_t)(uint16_t)~iterations << 48) | (0x0000FFFFFFFFFFFFULL & hash_result) };
+    }
+
+    constexpr uint16_t Iterations() const { return (uint16_t)~(value >> 48); }
+    constexpr uint64_t Hash() const { return value & 0x0000FFFFFFFFFFFFULL; }
+
+    constexpr bool operator==(const VbaSuffix& other) const { return value == other.value; }
+    constexpr bool operator!=(const VbaSuffix& other) const { return value != other.value; }
+};
+
+static_assert(sizeof(VbaSuffix) == 8, "VbaSuffix must be exactly 64 bits.");
+static_assert(VbaSuffix::Build(0x0001, 0).value == 0xFFFE000000000000ULL, "VbaSuffix iteration encoding.");
+static_assert(VbaSuffix::Build(0xFFFE, 0x1234).Iterations() == 0xFFFE, "VbaSuffix round trip.");
+
+
+static inline VbaSuffix
+derive_address_suffix(const uint8_t* voucher_seed,
+                      vba_salt_template_t* salt,
+                      const MacAddress& mac_address,
+                      uint16_t iterations,
+                      VbaAlgorithm algorithm)
+{
+    return VbaSuffix::Build(iterations,
+                            compute_address_hash_suffix_salted(voucher_seed,
+                                                               salt,
+                                                               mac_address.octets,
+                                                               iterations,
+                                                               algorithm));
+}
+
+
+#endif /* _VBA_TYPES_H_ */
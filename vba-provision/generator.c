@@ -0,0 +1,96 @@
+#include "generator.h"
+
+
+static xoshiro128p_t s;
+static int s_seeded = 0;
+
+uint64_t
+Xoshiro128p__next_bounded(uint64_t low, uint64_t high)
+{
+    const uint64_t range = 1 + high - low;
+    const uint64_t result = Xoshiro128p__next( &s );
+
+    return (
+        ( high > low )
+        * (
+            (
+                result
+                % (
+                    (
+                        ( ( 0 == range ) * 1 )
+                        + range
+                    )
+                )
+            )
+            + low
+        )
+    );
+}
+
+uint64_t Xoshiro128p__next_bounded_any()
+{
+    return Xoshiro128p__next_bounded(0, UINT64_MAX - 1);
+}
+
+void
+Xoshiro128p__jump(xoshiro128p_t *state)
+{
+    /* From the reference xoroshiro128+ (24, 16, 37) implementation. */
+    static const uint64_t JUMP[] = { 0xdf900294d8f554a5, 0x170865df4b3201fc };
+    uint64_t s0 = 0, s1 = 0;
+
+    for (int i = 0; i < 2; ++i) {
+        for (int b = 0; b < 64; ++b) {
+            if (JUMP[i] & (UINT64_C(1) << b)) {
+                s0 ^= state->s[0];
+                s1 ^= state->s[1];
+            }
+            Xoshiro128p__next( state );
+        }
+    }
+
+    state->s[0] = s0;
+    state->s[1] = s1;
+}
+
+void
+Xoshiro128p__split(xoshiro128p_t *stream)
+{
+    *stream = s;
+    Xoshiro128p__jump( &s );
+}
+
+void
+Xoshiro128p__fill(xoshiro128p_t *state, uint64_t *out, size_t count)
+{
+    /* A local copy keeps the state in registers rather than stored back per output. */
+    xoshiro128p_t local = *state;
+
+    for (size_t i = 0; i < count; ++i)
+        out[i] = Xoshiro128p__next( &local );
+
+    *state = local;
+}
+
+void
+Xoshiro128p__init()
+{
+    uint64_t seed_value;
+    unsigned int lo, hi;
+    tinymt64_t* p_prng_init;
+
+    // Get the amount of cycles since the processor was powered on.
+    //   This should act as a sufficient non-time-based PRNG seed.
+    __asm__ __volatile__ (  "rdtsc" : "=a" (lo), "=d" (hi)  );
+    seed_value = ( ((uint64_t)hi << 32) | lo );
+
+    p_prng_init = (tinymt64_t*)calloc( 1, sizeof(tinymt64_t) );
+    tinymt64_init( p_prng_init, seed_value );
+
+    // Seed Xoshiro128+.
+    s.s[0] = tinymt64_generate_uint64( p_prng_init );
+    s.s[1] = tinymt64_generate_uint64( p_prng_init );
+
+    free( p_prng_init );
+    s_seeded = 1;
+}
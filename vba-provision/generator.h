@@ -0,0 +1,61 @@
+#ifndef _GENERATOR_H_
+#define _GENERATOR_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tinymt64.h"
+
+
+/*
+ * One xoroshiro128+ stream. The 'Xoshiro128p__' functions without a state argument
+ *   all share one global stream, which is not safe to use from several threads at
+ *   once; threads should each take their own with 'Xoshiro128p__split'.
+ */
+typedef struct _xoshiro128p {
+    uint64_t s[2];
+} xoshiro128p_t;
+
+
+static inline uint64_t _xoshiro128p_rotl(const uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t Xoshiro128p__next(xoshiro128p_t *state)
+{
+    const uint64_t s0 = state->s[0];
+    uint64_t s1 = state->s[1];
+    const uint64_t result = s0 + s1;
+
+    s1 ^= s0;
+    state->s[0] = _xoshiro128p_rotl(s0, 24) ^ s1 ^ (s1 << 16);
+    state->s[1] = _xoshiro128p_rotl(s1, 37);
+
+    return result;
+}
+
+
+void Xoshiro128p__init();
+
+uint64_t Xoshiro128p__next_bounded(uint64_t low, uint64_t high);
+uint64_t Xoshiro128p__next_bounded_any();
+
+/* Advances 'state' by 2^64 outputs, as if that many were drawn. */
+void Xoshiro128p__jump(xoshiro128p_t *state);
+
+/*
+ * Hands out the global stream's next 2^64 outputs as a stream of their own and
+ *   jumps the global stream past them, so no two streams ever overlap. Call it from
+ *   one thread, e.g. before starting the others.
+ */
+void Xoshiro128p__split(xoshiro128p_t *stream);
+
+/* 'count' raw outputs of 'state' into 'out'. */
+void Xoshiro128p__fill(xoshiro128p_t *state, uint64_t *out, size_t count);
+
+
+#endif /* _GENERATOR_H_ */
@@ -0,0 +1,737 @@
+#include <chrono>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/evp.h>
+#include <openssl/opensslv.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30200000L
+#include <openssl/core_names.h>
+#include <openssl/kdf.h>
+#include <openssl/params.h>
+#endif
+
+#include "kdf_backends.h"
+#include "pbkdf2_sha256.h"
+
+
+typedef enum _kdf_self_test {
+    KDF_SELF_TEST_FAILED = 0,
+    KDF_SELF_TEST_PASSED,
+    KDF_SELF_TEST_UNSUPPORTED,   /* Never run: 'is_supported' said no. */
+} kdf_self_test_t;
+
+typedef struct _kdf_registry_entry {
+    kdf_backend_t backend;
+    int verified;
+    int supported;
+} kdf_registry_entry_t;
+
+typedef struct _kdf_registry {
+    kdf_registry_entry_t entries[KDF_MAX_BACKENDS];
+    size_t count;
+    size_t active;
+    int forced;
+} kdf_registry_t;
+
+static kdf_registry_t _registry[VBA_ALGORITHM_SLOTS];
+static pthread_once_t _registry_once = PTHREAD_ONCE_INIT;
+
+static int _force_backends_from_string(const char *spec);
+
+
+/* ===== Built-in backends ===== */
+
+static int _pbkdf2_openssl(const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                           uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    return 1 == PKCS5_PBKDF2_HMAC((const char*)voucher_seed,
+                                  16,
+                                  salt,
+                                  salt_len,
+                                  iterations * ITERATIONS_FACTOR,
+                                  EVP_sha256(),
+                                  out_len,
+                                  out) ? 0 : -1;
+}
+
+static int _pbkdf2_intree(const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                          uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    if (32 != out_len) return -1;
+
+    return pbkdf2_sha256_32(sha256_compress_portable,
+                            voucher_seed, 16,
+                            salt, salt_len,
+                            (uint32_t)iterations * ITERATIONS_FACTOR,
+                            out);
+}
+
+static int _pbkdf2_avx2_x8(size_t count, const uint8_t *const *voucher_seeds,
+                           const uint8_t *const *salts, size_t salt_len,
+                           uint16_t iterations, uint8_t *const *outs, size_t out_len)
+{
+    if (32 != out_len) return -1;
+
+    for (size_t done = 0; done < count; done += PBKDF2_SHA256_X8_LANES) {
+        size_t lanes = count - done < PBKDF2_SHA256_X8_LANES ? count - done : PBKDF2_SHA256_X8_LANES;
+
+        if (0 != pbkdf2_sha256_32_x8(lanes,
+                                     &voucher_seeds[done], 16,
+                                     &salts[done], salt_len,
+                                     (uint32_t)iterations * ITERATIONS_FACTOR,
+                                     &outs[done]))
+            return -1;
+    }
+
+    return 0;
+}
+
+static int _pbkdf2_shani(const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                         uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    if (32 != out_len) return -1;
+
+    return pbkdf2_sha256_32_shani(voucher_seed, 16,
+                                  salt, salt_len,
+                                  (uint32_t)iterations * ITERATIONS_FACTOR,
+                                  out);
+}
+
+static int _pbkdf2_shani_x2(size_t count, const uint8_t *const *voucher_seeds,
+                            const uint8_t *const *salts, size_t salt_len,
+                            uint16_t iterations, uint8_t *const *outs, size_t out_len)
+{
+    if (32 != out_len) return -1;
+
+    size_t done = 0;
+    for (; done + 2 <= count; done += 2)
+        if (0 != pbkdf2_sha256_32_shani_x2(&voucher_seeds[done], 16,
+                                           &salts[done], salt_len,
+                                           (uint32_t)iterations * ITERATIONS_FACTOR,
+                                           &outs[done]))
+            return -1;
+
+    if (done < count)
+        return _pbkdf2_shani(voucher_seeds[done], salts[done], salt_len, iterations, outs[done], out_len);
+
+    return 0;
+}
+
+/*
+ * Per-thread Argon2 memory. Each thread keeps the largest buffer it has needed and
+ *   writes it once when it allocates it, so the pages are faulted in on the node that
+ *   thread runs on (the kernel's first-touch policy) and stay there for every later
+ *   hash instead of being mapped and unmapped each time.
+ */
+typedef struct _kdf_arena {
+    uint8_t *memory;
+    size_t size;
+    int busy;
+} kdf_arena_t;
+
+static int _use_thread_arenas = 0;
+static pthread_key_t _arena_key;
+static pthread_once_t _arena_once = PTHREAD_ONCE_INIT;
+
+static void _arena_free(void *arena)
+{
+    free(((kdf_arena_t *)arena)->memory);
+    free(arena);
+}
+
+static void _arena_key_create(void)
+{
+    pthread_key_create(&_arena_key, _arena_free);
+}
+
+static int _arena_allocate(uint8_t **memory, size_t bytes)
+{
+    kdf_arena_t *arena = (kdf_arena_t *)pthread_getspecific(_arena_key);
+    if (!arena) {
+        arena = (kdf_arena_t *)calloc(1, sizeof(kdf_arena_t));
+        if (!arena || 0 != pthread_setspecific(_arena_key, arena)) {
+            free(arena);
+            return -1;
+        }
+    }
+
+    /* Not reentrant; a nested request gets ordinary memory. */
+    if (arena->busy) {
+        *memory = (uint8_t *)malloc(bytes);
+        return *memory ? 0 : -1;
+    }
+
+    if (arena->size < bytes) {
+        void *grown = NULL;
+        if (0 != posix_memalign(&grown, 4096, bytes)) return -1;
+
+        memset(grown, 0, bytes);
+        free(arena->memory);
+        arena->memory = (uint8_t *)grown;
+        arena->size = bytes;
+    }
+
+    arena->busy = 1;
+    *memory = arena->memory;
+    return 0;
+}
+
+static void _arena_deallocate(uint8_t *memory, size_t bytes)
+{
+    kdf_arena_t *arena = (kdf_arena_t *)pthread_getspecific(_arena_key);
+    (void)bytes;
+
+    if (arena && memory == arena->memory) arena->busy = 0;
+    else free(memory);
+}
+
+void kdf_use_thread_arenas(int enabled)
+{
+    pthread_once(&_arena_once, _arena_key_create);
+    _use_thread_arenas = enabled;
+}
+
+
+/* libargon2 fills each lane on its own thread when 'threads' > 1. */
+static inline int _argon2_libargon2_ctx(argon2_type type, uint32_t lanes,
+                                        const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                                        uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    argon2_context context;
+    memset(&context, 0, sizeof(context));
+
+    context.out = out;
+    context.outlen = (uint32_t)out_len;
+    context.pwd = (uint8_t *)voucher_seed;
+    context.pwdlen = 16;
+    context.salt = (uint8_t *)salt;
+    context.saltlen = (uint32_t)salt_len;
+    context.t_cost = iterations;
+    context.m_cost = get_argon2_parameters().memory_kib;   /* 128 KiB by default */
+    context.lanes = lanes;
+    context.threads = lanes;
+    context.version = ARGON2_VERSION_13;
+    context.flags = ARGON2_DEFAULT_FLAGS;
+
+    if (_use_thread_arenas) {
+        context.allocate_cbk = _arena_allocate;
+        context.free_cbk = _arena_deallocate;
+    }
+
+    return argon2_ctx(&context, type);
+}
+
+static int _argon2_libargon2(const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                             uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    return _argon2_libargon2_ctx(Argon2_d, 1, voucher_seed, salt, salt_len, iterations, out, out_len);
+}
+
+static int _argon2id_libargon2(const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                               uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    return _argon2_libargon2_ctx(Argon2_id, 1, voucher_seed, salt, salt_len, iterations, out, out_len);
+}
+
+static int _argon2d_libargon2_lanes(const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                                    uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    return _argon2_libargon2_ctx(Argon2_d, get_argon2_parameters().lanes,
+                                 voucher_seed, salt, salt_len, iterations, out, out_len);
+}
+
+static int _argon2id_libargon2_lanes(const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                                     uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    return _argon2_libargon2_ctx(Argon2_id, get_argon2_parameters().lanes,
+                                 voucher_seed, salt, salt_len, iterations, out, out_len);
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30200000L
+static int _argon2_openssl_supported(void)
+{
+    EVP_KDF *kdf = EVP_KDF_fetch(NULL, "ARGON2D", NULL);
+    EVP_KDF_free(kdf);
+    return NULL != kdf;
+}
+
+/* Single-lane only; OpenSSL needs an explicit thread pool before it will run lanes in parallel. */
+static inline int _argon2_openssl_derive(const char *variant,
+                                         const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                                         uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    uint32_t iter = iterations, memcost = get_argon2_parameters().memory_kib, lanes = 1;
+    int result = -1;
+
+    EVP_KDF *kdf = EVP_KDF_fetch(NULL, variant, NULL);
+    if (!kdf) return -1;
+
+    EVP_KDF_CTX *ctx = EVP_KDF_CTX_new(kdf);
+    EVP_KDF_free(kdf);
+    if (!ctx) return -1;
+
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_PASSWORD, (void *)voucher_seed, 16),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT, (void *)salt, salt_len),
+        OSSL_PARAM_construct_uint32(OSSL_KDF_PARAM_ITER, &iter),
+        OSSL_PARAM_construct_uint32(OSSL_KDF_PARAM_ARGON2_MEMCOST, &memcost),
+        OSSL_PARAM_construct_uint32(OSSL_KDF_PARAM_ARGON2_LANES, &lanes),
+        OSSL_PARAM_construct_end(),
+    };
+
+    if (1 == EVP_KDF_derive(ctx, out, out_len, params)) result = 0;
+
+    EVP_KDF_CTX_free(ctx);
+    return result;
+}
+
+static int _argon2_openssl(const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                           uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    return _argon2_openssl_derive("ARGON2D", voucher_seed, salt, salt_len, iterations, out, out_len);
+}
+
+static int _argon2id_openssl(const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                             uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    return _argon2_openssl_derive("ARGON2ID", voucher_seed, salt, salt_len, iterations, out, out_len);
+}
+#endif
+
+static int _scrypt_libscrypt(const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                             uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    /* https://www.tarsnap.com/scrypt.html */
+    /* https://words.filippo.io/the-scrypt-parameters/ */
+    return libscrypt_scrypt(voucher_seed,
+                            16,
+                            salt,
+                            salt_len,
+                            128,   /* N */
+                            iterations,   /* r */
+                            1,   /* p */
+                            out,
+                            out_len);
+}
+
+static int _scrypt_tarsnap(const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                           uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    return scrypt_kdf(voucher_seed, 16, salt, salt_len, 128, iterations, 1, out, out_len);
+}
+
+static int _scrypt_openssl(const uint8_t *voucher_seed, const uint8_t *salt, size_t salt_len,
+                           uint16_t iterations, uint8_t *out, size_t out_len)
+{
+    /* 128 * r * N bytes of scratch, plus headroom; OpenSSL refuses anything over 'maxmem'. */
+    uint64_t maxmem = 2ULL * 128 * iterations * 128 + (1ULL << 20);
+
+    return 1 == EVP_PBE_scrypt((const char *)voucher_seed, 16,
+                               salt, salt_len,
+                               128, iterations, 1,
+                               maxmem,
+                               out, out_len) ? 0 : -1;
+}
+
+
+static const kdf_backend_t _builtin_backends[] = {
+    /* The first backend of each algorithm is its reference implementation. */
+    { "openssl",    PBKDF2, NULL, _pbkdf2_openssl },
+    { "intree",     PBKDF2, NULL, _pbkdf2_intree },
+    { "avx2-x8",    PBKDF2, pbkdf2_sha256_32_x8_supported, _pbkdf2_intree, _pbkdf2_avx2_x8 },
+    { "sha-ni",     PBKDF2, pbkdf2_sha256_shani_supported, _pbkdf2_shani, _pbkdf2_shani_x2 },
+    { "libargon2",  ARGON2, NULL, _argon2_libargon2 },
+#if OPENSSL_VERSION_NUMBER >= 0x30200000L
+    { "openssl",    ARGON2, _argon2_openssl_supported, _argon2_openssl },
+#endif
+    { "libargon2",  ARGON2ID, NULL, _argon2id_libargon2 },
+#if OPENSSL_VERSION_NUMBER >= 0x30200000L
+    { "openssl",    ARGON2ID, _argon2_openssl_supported, _argon2id_openssl },
+#endif
+    { "libargon2",  ARGON2D_LANES, NULL, _argon2d_libargon2_lanes },
+    { "libargon2",  ARGON2ID_LANES, NULL, _argon2id_libargon2_lanes },
+    { "libscrypt",  SCRYPT, NULL, _scrypt_libscrypt },
+    { "scrypt-kdf", SCRYPT, NULL, _scrypt_tarsnap },
+    { "openssl",    SCRYPT, NULL, _scrypt_openssl },
+};
+
+
+/* ===== Registry ===== */
+
+static inline kdf_registry_t *_registry_for(enum VbaAlgorithm algorithm)
+{
+    if (algorithm <= 0 || algorithm >= VBA_ALGORITHM_SLOTS) return NULL;
+    return &_registry[algorithm];
+}
+
+/*
+ * Checks a backend against its algorithm's reference on fixed inputs at a couple of
+ *   iteration counts. The reference only has to run without error. A batched kernel
+ *   is checked on a short group with distinct seeds.
+ */
+static kdf_self_test_t _self_test(const kdf_registry_t *registry, const kdf_backend_t *backend)
+{
+    static const uint16_t test_iterations[2] = { 1, 3 };
+
+    uint8_t seed[16], salt[VBA_SALT_LENGTH];
+    vba_salt_template_t tmpl;
+    init_salt_template(&tmpl, NULL);
+    memcpy(salt, tmpl.bytes, sizeof(salt));
+
+    for (int i = 0; i < 16; ++i) seed[i] = (uint8_t)(0xA5 ^ (i * 17));
+    memcpy(salt, "\x02\x00\x5e\x10\x00\x01", 6);
+
+    if (backend->is_supported && !backend->is_supported()) return KDF_SELF_TEST_UNSUPPORTED;
+
+    const kdf_backend_t *reference = &registry->entries[0].backend;
+
+    for (int i = 0; i < 2; ++i) {
+        uint8_t expected[32] = {0}, actual[32] = {0};
+
+        if (0 != reference->derive(seed, salt, sizeof(salt), test_iterations[i], expected, sizeof(expected)))
+            return KDF_SELF_TEST_FAILED;
+        if (reference == backend) continue;
+
+        if (0 != backend->derive(seed, salt, sizeof(salt), test_iterations[i], actual, sizeof(actual)))
+            return KDF_SELF_TEST_FAILED;
+        if (0 != memcmp(expected, actual, sizeof(expected)))
+            return KDF_SELF_TEST_FAILED;
+    }
+
+    if (backend->derive_batch) {
+        enum { TEST_GROUP = 3 };
+
+        uint8_t seeds[TEST_GROUP][16], expected[TEST_GROUP][32], actual[TEST_GROUP][32];
+        const uint8_t *seed_ptrs[TEST_GROUP], *salt_ptrs[TEST_GROUP];
+        uint8_t *out_ptrs[TEST_GROUP];
+
+        for (int j = 0; j < TEST_GROUP; ++j) {
+            memcpy(seeds[j], seed, sizeof(seed));
+            seeds[j][0] ^= (uint8_t)(j + 1);
+
+            if (0 != reference->derive(seeds[j], salt, sizeof(salt), test_iterations[1], expected[j], 32))
+                return KDF_SELF_TEST_FAILED;
+
+            seed_ptrs[j] = seeds[j];
+            salt_ptrs[j] = salt;
+            out_ptrs[j] = actual[j];
+        }
+
+        if (0 != backend->derive_batch(TEST_GROUP, seed_ptrs, salt_ptrs, sizeof(salt),
+                                       test_iterations[1], out_ptrs, 32))
+            return KDF_SELF_TEST_FAILED;
+        if (0 != memcmp(expected, actual, sizeof(expected)))
+            return KDF_SELF_TEST_FAILED;
+    }
+
+    return KDF_SELF_TEST_PASSED;
+}
+
+static int _register_backend(const kdf_backend_t *backend)
+{
+    kdf_registry_t *registry = _registry_for(backend->algorithm);
+    if (!registry || registry->count >= KDF_MAX_BACKENDS) return -1;
+
+    size_t slot = registry->count++;
+    registry->entries[slot].backend = *backend;
+    kdf_self_test_t result = _self_test(registry, &registry->entries[slot].backend);
+    registry->entries[slot].verified = KDF_SELF_TEST_PASSED == result;
+    registry->entries[slot].supported = KDF_SELF_TEST_UNSUPPORTED != result;
+
+    /* Missing CPU features are expected; only a wrong answer is worth a word. */
+    if (KDF_SELF_TEST_FAILED == result)
+        fprintf(stderr, "KDF backend '%s' (algorithm %s) failed its self-test and is disabled.\n",
+                backend->name, vba_algorithm_name(backend->algorithm));
+
+    return (int)slot;
+}
+
+int kdf_register_backend(const kdf_backend_t *backend)
+{
+    kdf_backends_init();
+    return _register_backend(backend);
+}
+
+static void _init_once(void)
+{
+    for (size_t i = 0; i < sizeof(_builtin_backends) / sizeof(_builtin_backends[0]); ++i)
+        _register_backend(&_builtin_backends[i]);
+
+    const char *spec = getenv(KDF_BACKEND_ENV);
+    if (spec && *spec) _force_backends_from_string(spec);
+}
+
+void kdf_backends_init()
+{
+    pthread_once(&_registry_once, _init_once);
+}
+
+
+const kdf_backend_t *kdf_active_backend(enum VbaAlgorithm algorithm)
+{
+    kdf_backends_init();
+
+    kdf_registry_t *registry = _registry_for(algorithm);
+    if (!registry || !registry->count) return NULL;
+
+    return &registry->entries[registry->active].backend;
+}
+
+static int _force_backend(enum VbaAlgorithm algorithm, const char *name)
+{
+    kdf_registry_t *registry = _registry_for(algorithm);
+    if (!registry) return -1;
+
+    for (size_t i = 0; i < registry->count; ++i) {
+        if (registry->entries[i].verified && 0 == strcmp(registry->entries[i].backend.name, name)) {
+            registry->active = i;
+            registry->forced = 1;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static int _force_backends_from_string(const char *spec)
+{
+    char buffer[256];
+    int applied = 0;
+
+    strncpy(buffer, spec, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+
+    char *save = NULL;
+    for (char *pair = strtok_r(buffer, ",", &save); pair; pair = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(pair, '=');
+        if (!eq) continue;
+        *eq = '\0';
+
+        enum VbaAlgorithm algorithm = vba_algorithm_from_name(pair);
+        if (0 == _force_backend(algorithm, eq + 1)) {
+            ++applied;
+        } else {
+            fprintf(stderr, "Cannot force KDF backend '%s' for '%s'.\n", eq + 1, pair);
+        }
+    }
+
+    return applied;
+}
+
+int kdf_force_backend(enum VbaAlgorithm algorithm, const char *name)
+{
+    kdf_backends_init();
+    return _force_backend(algorithm, name);
+}
+
+void kdf_release_backend(enum VbaAlgorithm algorithm)
+{
+    kdf_backends_init();
+
+    kdf_registry_t *registry = _registry_for(algorithm);
+    if (registry) registry->forced = 0;
+}
+
+int kdf_backend_is_forced(enum VbaAlgorithm algorithm)
+{
+    kdf_backends_init();
+
+    kdf_registry_t *registry = _registry_for(algorithm);
+    return registry ? registry->forced : 0;
+}
+
+int kdf_force_backends_from_string(const char *spec)
+{
+    kdf_backends_init();
+    return _force_backends_from_string(spec);
+}
+
+size_t kdf_list_backends(enum VbaAlgorithm algorithm, const kdf_backend_t **out, size_t max)
+{
+    kdf_backends_init();
+
+    kdf_registry_t *registry = _registry_for(algorithm);
+    if (!registry) return 0;
+
+    size_t n = registry->count < max ? registry->count : max;
+    for (size_t i = 0; i < n; ++i)
+        out[i] = &registry->entries[i].backend;
+
+    return n;
+}
+
+static const kdf_registry_entry_t *_entry_for(const kdf_backend_t *backend)
+{
+    kdf_registry_t *registry = _registry_for(backend->algorithm);
+    if (!registry) return NULL;
+
+    for (size_t i = 0; i < registry->count; ++i)
+        if (&registry->entries[i].backend == backend)
+            return &registry->entries[i];
+
+    return NULL;
+}
+
+int kdf_backend_verified(const kdf_backend_t *backend)
+{
+    const kdf_registry_entry_t *entry = _entry_for(backend);
+    return entry ? entry->verified : 0;
+}
+
+int kdf_backend_supported(const kdf_backend_t *backend)
+{
+    const kdf_registry_entry_t *entry = _entry_for(backend);
+    return entry ? entry->supported : 0;
+}
+
+
+uint64_t kdf_backends_autoselect(enum VbaAlgorithm algorithm, uint16_t iterations, int verbose)
+{
+    kdf_backends_init();
+
+    kdf_registry_t *registry = _registry_for(algorithm);
+    if (!registry || !registry->count) return 0;
+
+    uint8_t seed[16] = {0}, out[32];
+    vba_salt_template_t salt;
+    init_salt_template(&salt, NULL);
+
+    uint64_t best_ns = UINT64_MAX;
+    size_t best = registry->active;
+
+    for (size_t i = 0; i < registry->count; ++i) {
+        const kdf_backend_t *backend = &registry->entries[i].backend;
+        if (!registry->entries[i].verified) continue;
+
+        /* One warm-up call, then best of three. */
+        backend->derive(seed, salt.bytes, VBA_SALT_LENGTH, iterations, out, sizeof(out));
+
+        uint64_t fastest = UINT64_MAX;
+        for (int run = 0; run < 3; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            backend->derive(seed, salt.bytes, VBA_SALT_LENGTH, iterations, out, sizeof(out));
+            auto end = std::chrono::steady_clock::now();
+
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+            if (ns < fastest) fastest = ns;
+        }
+
+        if (verbose)
+            printf("\t%-8s %-12s %14lu ns at '0x%04x' iterations\n",
+                   vba_algorithm_name(algorithm), backend->name, fastest, iterations);
+
+        if (fastest < best_ns) {
+            best_ns = fastest;
+            best = i;
+        }
+    }
+
+    /* An explicit override always wins over measurements. */
+    if (!registry->forced) registry->active = best;
+
+    if (verbose)
+        printf("\t%-8s -> using '%s'%s\n",
+               vba_algorithm_name(algorithm),
+               registry->entries[registry->active].backend.name,
+               registry->forced ? " (forced)" : "");
+
+    return best_ns;
+}
+
+
+const kdf_backend_t *kdf_active_batch_backend(enum VbaAlgorithm algorithm)
+{
+    kdf_backends_init();
+
+    kdf_registry_t *registry = _registry_for(algorithm);
+    if (!registry || !registry->count) return NULL;
+
+    if (registry->entries[registry->active].backend.derive_batch)
+        return &registry->entries[registry->active].backend;
+
+    /* A forced backend without a batched kernel keeps batches on that backend too. */
+    if (registry->forced) return NULL;
+
+    for (size_t i = 0; i < registry->count; ++i)
+        if (registry->entries[i].verified && registry->entries[i].backend.derive_batch)
+            return &registry->entries[i].backend;
+
+    return NULL;
+}
+
+static kdf_trace_hooks_t _trace_hooks = { NULL, NULL };
+
+void kdf_set_trace_hooks(const kdf_trace_hooks_t *hooks)
+{
+    if (hooks && hooks->begin && hooks->end)
+        _trace_hooks = *hooks;
+    else
+        _trace_hooks.begin = NULL, _trace_hooks.end = NULL;
+}
+
+
+int kdf_derive(enum VbaAlgorithm algorithm,
+               const uint8_t *voucher_seed,
+               const uint8_t *salt,
+               size_t salt_len,
+               uint16_t iterations,
+               uint8_t *out,
+               size_t out_len)
+{
+    const kdf_backend_t *backend = kdf_active_backend(algorithm);
+    if (!backend) return -1;
+
+    if (!_trace_hooks.begin)
+        return backend->derive(voucher_seed, salt, salt_len, iterations, out, out_len);
+
+    uint64_t mark = _trace_hooks.begin();
+    int result = backend->derive(voucher_seed, salt, salt_len, iterations, out, out_len);
+    _trace_hooks.end(algorithm, iterations, 1, mark);
+
+    return result;
+}
+
+static int _derive_batch(enum VbaAlgorithm algorithm,
+                         size_t count,
+                         const uint8_t *const *voucher_seeds,
+                         const uint8_t *const *salts,
+                         size_t salt_len,
+                         uint16_t iterations,
+                         uint8_t *const *outs,
+                         size_t out_len)
+{
+    const kdf_backend_t *batch = kdf_active_batch_backend(algorithm);
+    if (batch)
+        return batch->derive_batch(count, voucher_seeds, salts, salt_len, iterations, outs, out_len);
+
+    const kdf_backend_t *backend = kdf_active_backend(algorithm);
+    if (!backend) return -1;
+
+    int result = 0;
+    for (size_t i = 0; i < count; ++i)
+        if (0 != backend->derive(voucher_seeds[i], salts[i], salt_len, iterations, outs[i], out_len))
+            result = -1;
+
+    return result;
+}
+
+int kdf_derive_batch(enum VbaAlgorithm algorithm,
+                     size_t count,
+                     const uint8_t *const *voucher_seeds,
+                     const uint8_t *const *salts,
+                     size_t salt_len,
+                     uint16_t iterations,
+                     uint8_t *const *outs,
+                     size_t out_len)
+{
+    if (!_trace_hooks.begin)
+        return _derive_batch(algorithm, count, voucher_seeds, salts, salt_len, iterations, outs, out_len);
+
+    uint64_t mark = _trace_hooks.begin();
+    int result = _derive_batch(algorithm, count, voucher_seeds, salts, salt_len, iterations, outs, out_len);
+    _trace_hooks.end(algorithm, iterations, count, mark);
+
+    return result;
+}
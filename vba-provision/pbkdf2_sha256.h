@@ -0,0 +1,67 @@
+#ifndef _PBKDF2_SHA256_H_
+#define _PBKDF2_SHA256_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/*
+ * An in-tree PBKDF2-HMAC-SHA256 specialized for what VBA derivation actually asks
+ *   of it: a password shorter than one block, a salt short enough that the first
+ *   HMAC message fits in one block, and exactly one 32-byte output block.
+ *
+ * The HMAC inner and outer keys are absorbed once up front, and every later
+ *   iteration hashes a 32-byte message whose padding never changes, so each
+ *   iteration is exactly two compression-function calls with no buffering.
+ */
+
+typedef void (*sha256_compress_fn)(uint32_t state[8], const uint8_t block[64]);
+
+#define PBKDF2_SHA256_X8_LANES  8
+
+void sha256_compress_portable(uint32_t state[8], const uint8_t block[64]);
+
+/* Returns 0 on success, -1 if the inputs are outside what this variant supports. */
+int pbkdf2_sha256_32(sha256_compress_fn compress,
+                     const uint8_t *password, size_t password_len,
+                     const uint8_t *salt, size_t salt_len,
+                     uint32_t rounds,
+                     uint8_t out[32]);
+
+/*
+ * Multi-buffer variant: up to eight independent derivations that share a password
+ *   length, salt length and round count run side by side in the 32-bit lanes of
+ *   AVX2 registers. Only the key set-up and the first HMAC are done per lane.
+ */
+int pbkdf2_sha256_32_x8_supported(void);
+
+int pbkdf2_sha256_32_x8(size_t count,
+                        const uint8_t *const *passwords, size_t password_len,
+                        const uint8_t *const *salts, size_t salt_len,
+                        uint32_t rounds,
+                        uint8_t *const *outs);
+
+/*
+ * SHA extensions (SHA-NI) variant. The iteration loop never leaves SSE registers:
+ *   the key states are kept in the instructions' ABEF/CDGH layout and the constant
+ *   half of each digest block's message schedule is built in. Callers must check
+ *   'pbkdf2_sha256_shani_supported' first.
+ */
+int pbkdf2_sha256_shani_supported(void);
+
+void sha256_compress_shani(uint32_t state[8], const uint8_t block[64]);
+
+int pbkdf2_sha256_32_shani(const uint8_t *password, size_t password_len,
+                           const uint8_t *salt, size_t salt_len,
+                           uint32_t rounds,
+                           uint8_t out[32]);
+
+/* Exactly two independent derivations, interleaved to hide instruction latency. */
+int pbkdf2_sha256_32_shani_x2(const uint8_t *const *passwords, size_t password_len,
+                              const uint8_t *const *salts, size_t salt_len,
+                              uint32_t rounds,
+                              uint8_t *const *outs);
+
+
+#endif /* _PBKDF2_SHA256_H_ */
@@ -0,0 +1,498 @@
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "provision.hpp"
+#include "vba_types.hpp"
+#include "kdf_backends.h"
+
+
+#define PROVISION_BATCH_UNIT  8
+
+typedef struct _provision_record {
+    MacAddress mac;
+    uint8_t voucher_seed[16];
+    uint16_t iterations;
+    uint64_t suffix;
+    int status;   /* 0 once derived. */
+} provision_record_t;
+
+typedef struct _provision_checkpoint {
+    long input_offset;
+    uint64_t lines;
+    uint64_t records;
+    long output_size;
+    /* The settings the output was written with; a resume must use the same ones. */
+    int format;
+    int algorithm;
+    unsigned int iterations;
+    uint64_t seed_hash;   /* Zero without a default seed. */
+} provision_checkpoint_t;
+
+
+/* ===== Input ===== */
+
+static inline int _hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    c = (char)tolower((unsigned char)c);
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/* Accepts 001122334455, 00:11:22:33:44:55 and 00-11-22-33-44-55. */
+static bool _parse_mac(const char* text, MacAddress* mac)
+{
+    int octet = 0;
+
+    while (*text && octet < 6) {
+        int high = _hex_nibble(text[0]);
+        int low = high < 0 ? -1 : _hex_nibble(text[1]);
+        if (low < 0) return false;
+
+        mac->octets[octet++] = (uint8_t)((high << 4) | low);
+        text += 2;
+
+        if (octet < 6 && (':' == *text || '-' == *text)) ++text;
+    }
+
+    return 6 == octet && !*text;
+}
+
+static bool _parse_seed(const char* text, uint8_t seed[16])
+{
+    if (32 != strlen(text)) return false;
+
+    for (int i = 0; i < 16; ++i) {
+        int high = _hex_nibble(text[i * 2]), low = _hex_nibble(text[i * 2 + 1]);
+        if (high < 0 || low < 0) return false;
+        seed[i] = (uint8_t)((high << 4) | low);
+    }
+
+    return true;
+}
+
+static char* _trim(char* text)
+{
+    while (isspace((unsigned char)*text)) ++text;
+
+    char* end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) *--end = '\0';
+
+    return text;
+}
+
+/* Returns 1 for a device, 0 for a blank or comment line, -1 for a malformed one. */
+static int _parse_line(char* line, const provision_config_t& config, provision_record_t* record)
+{
+    line = _trim(line);
+    if (!*line || '#' == *line) return 0;
+
+    char* fields[3] = { line, NULL, NULL };
+    for (int f = 1; f < 3; ++f) {
+        char* comma = fields[f - 1] ? strchr(fields[f - 1], ',') : NULL;
+        if (!comma) break;
+        *comma = '\0';
+        fields[f] = _trim(comma + 1);
+    }
+
+    memset(record, 0, sizeof(*record));
+    record->status = -1;
+
+    if (!_parse_mac(_trim(fields[0]), &record->mac)) return -1;
+
+    /* A group address can never be a neighbour's own; provisioning one is a mistake. */
+    if (record->mac.IsGroup() || !record->mac.ToU64()) return -1;
+
+    if (fields[1] && *fields[1]) {
+        if (!_parse_seed(fields[1], record->voucher_seed)) return -1;
+    } else if (config.have_seed) {
+        memcpy(record->voucher_seed, config.voucher_seed, 16);
+    } else {
+        return -1;
+    }
+
+    record->iterations = config.iterations;
+    if (fields[2] && *fields[2]) {
+        char* end = NULL;
+        errno = 0;
+        unsigned long iterations = strtoul(fields[2], &end, 0);
+        if (errno || *end || iterations < 1 || iterations > 0xFFFE) return -1;
+        record->iterations = (uint16_t)iterations;
+    }
+
+    return 1;
+}
+
+
+/* ===== Derivation ===== */
+
+typedef struct _provision_unit {
+    size_t first;
+    size_t count;
+    uint64_t cost;
+} provision_unit_t;
+
+static void _derive_unit(const provision_unit_t& unit,
+                         const std::vector<size_t>& order,
+                         std::vector<provision_record_t>& records,
+                         VbaAlgorithm algorithm)
+{
+    vba_salt_template_t salts[PROVISION_BATCH_UNIT];
+    uint8_t digests[PROVISION_BATCH_UNIT][32];
+    const uint8_t *seed_ptrs[PROVISION_BATCH_UNIT], *salt_ptrs[PROVISION_BATCH_UNIT];
+    uint8_t* out_ptrs[PROVISION_BATCH_UNIT];
+
+    for (size_t i = 0; i < unit.count; ++i) {
+        provision_record_t& record = records[order[unit.first + i]];
+
+        init_salt_template(&salts[i], NULL);
+        memcpy(&salts[i].bytes[0], record.mac.octets, 6);
+
+        seed_ptrs[i] = record.voucher_seed;
+        salt_ptrs[i] = salts[i].bytes;
+        out_ptrs[i] = digests[i];
+    }
+
+    uint16_t iterations = records[order[unit.first]].iterations;
+    int status = kdf_derive_batch(algorithm, unit.count, seed_ptrs, salt_ptrs, VBA_SALT_LENGTH,
+                                  iterations, out_ptrs, 32);
+
+    for (size_t i = 0; i < unit.count; ++i) {
+        provision_record_t& record = records[order[unit.first + i]];
+
+        record.status = status;
+        record.suffix = VbaSuffix::Build(iterations, *((uint64_t*)&digests[i][0])).value;
+    }
+}
+
+/* Groups the chunk by iteration count, cuts batch-sized units, and spreads them over the threads. */
+static void _derive_chunk(std::vector<provision_record_t>& records, VbaAlgorithm algorithm, unsigned int threads)
+{
+    if (records.empty()) return;
+
+    std::vector<size_t> order(records.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return records[a].iterations < records[b].iterations;
+    });
+
+    std::vector<provision_unit_t> units;
+    for (size_t start = 0; start < order.size(); ) {
+        size_t end = start;
+        while (end < order.size() && end - start < PROVISION_BATCH_UNIT
+               && records[order[end]].iterations == records[order[start]].iterations)
+            ++end;
+
+        units.push_back({ start, end - start, estimate_address_cost(records[order[start]].iterations, algorithm) });
+        start = end;
+    }
+
+    /* Longest units first so the chunk does not wait on one straggler. */
+    std::stable_sort(units.begin(), units.end(), [](const provision_unit_t& a, const provision_unit_t& b) {
+        return a.cost > b.cost;
+    });
+
+    if (threads > units.size()) threads = (unsigned int)units.size();
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t u = next.fetch_add(1); u < units.size(); u = next.fetch_add(1))
+            _derive_unit(units[u], order, records, algorithm);
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+
+    worker();
+
+    for (auto& thread : pool)
+        thread.join();
+}
+
+
+/* ===== Output and checkpoints ===== */
+
+static void _write_header(FILE* out, ProvisionFormat format)
+{
+    if (PROVISION_CSV == format) {
+        fputs("mac,algorithm,iterations,address\n", out);
+        return;
+    }
+
+    uint8_t header[16] = {0};
+    memcpy(header, PROVISION_BINARY_MAGIC, 8);
+    header[8] = (uint8_t)sizeof(provision_binary_record_t);
+    fwrite(header, 1, sizeof(header), out);
+}
+
+static void _write_record(FILE* out, ProvisionFormat format, VbaAlgorithm algorithm, const provision_record_t& record)
+{
+    if (PROVISION_BINARY == format) {
+        provision_binary_record_t binary;
+        memcpy(binary.mac_address, record.mac.octets, 6);
+        binary.algorithm = (uint8_t)algorithm;
+        binary.reserved = 0;
+        for (int i = 0; i < 8; ++i)
+            ((uint8_t*)&binary.suffix)[i] = (uint8_t)(record.suffix >> (i * 8));
+
+        fwrite(&binary, 1, sizeof(binary), out);
+        return;
+    }
+
+    char address[VBA_LLADDR_MAX_LENGTH + 1];
+    format_lladdr(record.suffix, address, sizeof(address));
+
+    const uint8_t* m = record.mac.octets;
+    fprintf(out, "%02x:%02x:%02x:%02x:%02x:%02x,%s,0x%04x,%s\n",
+            m[0], m[1], m[2], m[3], m[4], m[5],
+            vba_algorithm_name(algorithm), record.iterations, address);
+}
+
+/* FNV-1a, so the checkpoint can tell seeds apart without holding one. */
+static uint64_t _seed_hash(const provision_config_t& config)
+{
+    if (!config.have_seed) return 0;
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 16; ++i) {
+        hash ^= config.voucher_seed[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash ? hash : 1;
+}
+
+static void _checkpoint_settings(const provision_config_t& config, provision_checkpoint_t* checkpoint)
+{
+    checkpoint->format = config.format;
+    checkpoint->algorithm = config.algorithm;
+    checkpoint->iterations = config.iterations;
+    checkpoint->seed_hash = _seed_hash(config);
+}
+
+/* Returns 1 when read, 0 when there is none, -1 when it is unreadable. */
+static int _read_checkpoint(const char* path, provision_checkpoint_t* checkpoint)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) return 0;
+
+    bool ok = 8 == fscanf(file, "%ld %lu %lu %ld %d %d %x %lx",
+                          &checkpoint->input_offset, &checkpoint->lines,
+                          &checkpoint->records, &checkpoint->output_size,
+                          &checkpoint->format, &checkpoint->algorithm,
+                          &checkpoint->iterations, &checkpoint->seed_hash);
+    fclose(file);
+    return ok ? 1 : -1;
+}
+
+/* Appending with other settings would leave a file of mixed records; say which differs. */
+static bool _can_resume(const provision_config_t& config, const provision_checkpoint_t& checkpoint, FILE* out)
+{
+    provision_checkpoint_t now;
+    _checkpoint_settings(config, &now);
+
+    const char* differs = NULL;
+    if (now.format != checkpoint.format) differs = "--format";
+    else if (now.algorithm != checkpoint.algorithm) differs = "--algorithm";
+    else if (now.iterations != checkpoint.iterations) differs = "--iterations";
+    else if (now.seed_hash != checkpoint.seed_hash) differs = "--seed";
+
+    if (differs) {
+        fprintf(stderr, "The output was started with another %s; resume with the original options.\n", differs);
+        return false;
+    }
+
+    if (PROVISION_BINARY == config.format) {
+        char magic[8];
+        if (0 != fseek(out, 0, SEEK_SET) || 1 != fread(magic, sizeof(magic), 1, out)
+            || 0 != memcmp(magic, PROVISION_BINARY_MAGIC, sizeof(magic))) {
+            fprintf(stderr, "The output does not start with a '" PROVISION_BINARY_MAGIC "' header.\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Written beside the old one and renamed over it, so a crash leaves one or the other. */
+static bool _write_checkpoint(const char* path, const provision_checkpoint_t& checkpoint)
+{
+    std::string tmp_path = std::string(path) + ".new";
+
+    FILE* file = fopen(tmp_path.c_str(), "w");
+    if (!file) return false;
+
+    fprintf(file, "%ld %lu %lu %ld %d %d %x %lx\n",
+            checkpoint.input_offset, checkpoint.lines, checkpoint.records, checkpoint.output_size,
+            checkpoint.format, checkpoint.algorithm, checkpoint.iterations, checkpoint.seed_hash);
+
+    bool ok = 0 == fflush(file) && 0 == fsync(fileno(file));
+    ok = 0 == fclose(file) && ok;
+
+    return ok && 0 == rename(tmp_path.c_str(), path);
+}
+
+
+int run_provisioning(const provision_config_t& config)
+{
+    bool from_stdin = 0 == strcmp(config.input_path, "-");
+    std::string checkpoint_path = std::string(config.output_path) + PROVISION_CHECKPOINT_SUFFIX;
+
+    if (config.resume && from_stdin) {
+        fprintf(stderr, "Cannot resume from standard input.\n");
+        return -1;
+    }
+
+    FILE* in = from_stdin ? stdin : fopen(config.input_path, "r");
+    if (!in) {
+        fprintf(stderr, "Cannot open input '%s'.\n", config.input_path);
+        return -1;
+    }
+
+    long input_size = 0;
+    if (!from_stdin) {
+        fseek(in, 0, SEEK_END);
+        input_size = ftell(in);
+        fseek(in, 0, SEEK_SET);
+    }
+
+    provision_checkpoint_t checkpoint = {};
+    FILE* out = NULL;
+
+    int found = config.resume ? _read_checkpoint(checkpoint_path.c_str(), &checkpoint) : 0;
+    if (found < 0) {
+        fprintf(stderr, "Checkpoint '%s' is unreadable; remove it to start over.\n", checkpoint_path.c_str());
+        if (!from_stdin) fclose(in);
+        return -1;
+    }
+
+    if (found) {
+        /* Anything written after the last checkpoint is dropped and derived again. */
+        out = fopen(config.output_path, "r+");
+        if (!out || !_can_resume(config, checkpoint, out)
+            || 0 != ftruncate(fileno(out), checkpoint.output_size)
+            || 0 != fseek(out, checkpoint.output_size, SEEK_SET)
+            || 0 != fseek(in, checkpoint.input_offset, SEEK_SET)) {
+            fprintf(stderr, "Cannot resume '%s' from its checkpoint.\n", config.output_path);
+            if (out) fclose(out);
+            if (!from_stdin) fclose(in);
+            return -1;
+        }
+
+        fprintf(stderr, "Resuming after %lu lines (%lu addresses).\n", checkpoint.lines, checkpoint.records);
+    } else {
+        if (config.resume)
+            fprintf(stderr, "No checkpoint for '%s'; starting from the beginning.\n", config.output_path);
+
+        out = fopen(config.output_path, "w");
+        if (!out) {
+            fprintf(stderr, "Cannot create output '%s'.\n", config.output_path);
+            if (!from_stdin) fclose(in);
+            return -1;
+        }
+
+        _write_header(out, config.format);
+        fflush(out);
+        checkpoint.output_size = ftell(out);
+        _checkpoint_settings(config, &checkpoint);
+    }
+
+    unsigned int threads = config.threads ? config.threads : std::thread::hardware_concurrency();
+    if (!threads) threads = 1;
+
+    std::vector<provision_record_t> records;
+    records.reserve(PROVISION_CHUNK_LINES);
+
+    uint64_t rejected = 0, run_records = 0;
+    auto started = std::chrono::steady_clock::now();
+    auto last_report = started;
+    char line[512];
+    bool at_end = false;
+    int result = 0;
+
+    while (!at_end) {
+        records.clear();
+        uint64_t chunk_lines = 0;
+
+        while (records.size() < PROVISION_CHUNK_LINES) {
+            if (!fgets(line, sizeof(line), in)) {
+                at_end = true;
+                break;
+            }
+            ++chunk_lines;
+
+            provision_record_t record;
+            int parsed = _parse_line(line, config, &record);
+            if (parsed > 0) {
+                records.push_back(record);
+            } else if (parsed < 0) {
+                ++rejected;
+                fprintf(stderr, "Line %lu: not a usable 'mac[,seed[,iterations]]' entry; skipped.\n",
+                        checkpoint.lines + chunk_lines);
+            }
+        }
+
+        _derive_chunk(records, config.algorithm, threads);
+
+        uint64_t written = 0;
+        for (const auto& record : records) {
+            if (0 == record.status) {
+                _write_record(out, config.format, config.algorithm, record);
+                ++written;
+            } else {
+                ++rejected;
+                fprintf(stderr, "Derivation failed for one device in the chunk ending at line %lu.\n",
+                        checkpoint.lines + chunk_lines);
+            }
+        }
+
+        if (0 != fflush(out) || 0 != fsync(fileno(out))) {
+            fprintf(stderr, "Writing '%s' failed.\n", config.output_path);
+            result = -1;
+            break;
+        }
+
+        checkpoint.lines += chunk_lines;
+        checkpoint.records += written;
+        checkpoint.output_size = ftell(out);
+        if (!from_stdin) checkpoint.input_offset = ftell(in);
+        run_records += written;
+
+        if (!from_stdin && !_write_checkpoint(checkpoint_path.c_str(), checkpoint))
+            fprintf(stderr, "Cannot write checkpoint '%s'.\n", checkpoint_path.c_str());
+
+        auto now = std::chrono::steady_clock::now();
+        if (config.progress && (at_end || now - last_report >= std::chrono::seconds(1))) {
+            double seconds = std::chrono::duration<double>(now - started).count();
+            double rate = seconds > 0 ? run_records / seconds : 0;
+
+            fprintf(stderr, "\r%lu addresses  %.0f/s", checkpoint.records, rate);
+            if (input_size > 0)
+                fprintf(stderr, "  %5.1f%% of input", 100.0 * checkpoint.input_offset / input_size);
+            if (at_end) fprintf(stderr, "\n");
+
+            last_report = now;
+        }
+    }
+
+    fclose(out);
+    if (!from_stdin) fclose(in);
+
+    fprintf(stderr, "%lu addresses written, %lu lines rejected.\n", checkpoint.records, rejected);
+
+    /* A finished run needs no checkpoint; one left behind would resume into a complete file. */
+    if (0 == result && !from_stdin) unlink(checkpoint_path.c_str());
+
+    return result;
+}
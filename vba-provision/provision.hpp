@@ -0,0 +1,65 @@
+#ifndef _PROVISION_H_
+#define _PROVISION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vba.h"
+
+
+#define PROVISION_CHUNK_LINES       4096
+#define PROVISION_BINARY_MAGIC      "VBAPROV1"
+#define PROVISION_CHECKPOINT_SUFFIX ".checkpoint"
+
+
+enum ProvisionFormat
+{
+    PROVISION_CSV = 0,
+    PROVISION_BINARY = 1,
+};
+
+typedef struct _provision_config {
+    const char* input_path;    /* "-" reads standard input (no resume). */
+    const char* output_path;
+    ProvisionFormat format;
+    VbaAlgorithm algorithm;
+    /* Defaults for lines that do not carry their own seed or iteration count. */
+    uint16_t iterations;
+    uint8_t voucher_seed[16];
+    bool have_seed;
+    /* Zero means 'std::thread::hardware_concurrency'. */
+    unsigned int threads;
+    bool resume;
+    bool progress;
+} provision_config_t;
+
+/*
+ * The binary output is a 16-byte header (magic, record size, reserved) followed by
+ *   one of these per device. The iteration count is not stored separately since
+ *   every suffix already encodes it.
+ */
+#pragma pack(push, 1)
+typedef struct _provision_binary_record {
+    uint8_t mac_address[6];
+    uint8_t algorithm;
+    uint8_t reserved;
+    uint64_t suffix;   /* Little-endian. */
+} provision_binary_record_t;
+#pragma pack(pop)
+
+static_assert(sizeof(provision_binary_record_t) == 16, "Binary provisioning record layout.");
+
+
+/*
+ * Streams "mac[,seed[,iterations]]" lines from the input, derives every address with
+ *   the algorithm's batched KDF kernel across a pool of threads, and appends the
+ *   results in input order. After each chunk the output is flushed and a
+ *   checkpoint recording how far both files got is written beside the output, so
+ *   a run interrupted at any point continues with 'resume' set and the same format,
+ *   algorithm and defaults. Malformed lines are reported and skipped. Returns 0 on
+ *   success.
+ */
+int run_provisioning(const provision_config_t& config);
+
+
+#endif /* _PROVISION_H_ */
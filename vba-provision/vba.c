@@ -0,0 +1,437 @@
+#include "vba.h"
+#include "generator.h"
+#include "kdf_backends.h"
+
+
+unsigned char global_voucher_seed[16] = {0};
+uint16_t _fixed_iter[FIXED_ITERS_COUNT] = {
+        0x0001,
+        0x0010,
+        0x0100,
+        0x0500,
+        0x1000,
+        0x7000,
+        0x8500,
+        0x8000,
+        0x8500,
+        0x9000,
+        0xF000,
+        0xF500,
+        0xFE00,
+        0xFEE0,
+        0xFFFE,
+};
+uint16_t _fixed_iter_step = 0x100;
+
+static vba_argon2_params_t _argon2_params = { ARGON2_DEFAULT_MEMORY_KIB, ARGON2_DEFAULT_LANES };
+
+
+void rotate_voucher_seed()
+{
+    for (unsigned int i = 0; i < sizeof(global_voucher_seed) / sizeof(uint64_t); ++i)
+        *(((uint64_t *)&global_voucher_seed) + i) = Xoshiro128p__next_bounded_any();
+}
+
+
+/*
+ * The 'password' is always the voucher seed. The salt is a combination
+ *   of MAC + 'vba' + the 64-bit subnet prefix (or left-most 64 bits of the
+ *   unicast address that will be built). This example application uses "fe80::".
+ */
+static const uint8_t _default_salt[VBA_SALT_LENGTH] = {
+    0, 0, 0, 0, 0, 0, 'v', 'b', 'a', 0xFE, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+
+static inline uint64_t _derive_address_hash(const uint8_t *voucher_seed,
+                                            const uint8_t *salt,
+                                            uint16_t iterations,
+                                            enum VbaAlgorithm algorithm)
+{
+    size_t res_buffer_size = 32;
+    uint8_t res_buffer[32] = {0};
+    size_t salt_len = VBA_SALT_LENGTH;
+
+    /* The implementation of each algorithm is chosen at startup; see kdf_backends.c. */
+    if (0 != kdf_derive(algorithm, voucher_seed, salt, salt_len, iterations, res_buffer, res_buffer_size)
+        && !kdf_active_backend(algorithm)) {
+        fprintf(stderr, "Address suffix computation called for an unknown algorithm type.\n");
+        return -1;
+    }
+
+    /* Always use the first 8 bytes (64 bits) of the resulting hash. */
+    return *((uint64_t *)&res_buffer[0]);
+}
+
+
+void init_salt_template(vba_salt_template_t *salt, const uint8_t *subnet_prefix)
+{
+    memcpy(salt->bytes, _default_salt, VBA_SALT_LENGTH);
+
+    if (subnet_prefix)
+        memcpy(&salt->bytes[VBA_SALT_PREFIX_OFFSET], subnet_prefix, 8);
+}
+
+uint64_t compute_address_hash_suffix_salted(const uint8_t *voucher_seed,
+                                            vba_salt_template_t *salt,
+                                            const uint8_t *mac_address,
+                                            uint16_t iterations,
+                                            enum VbaAlgorithm algorithm)
+{
+    /* Only the MAC changes between calls; the rest of the template stays put. */
+    memcpy(&salt->bytes[0], mac_address, 6);
+
+    return _derive_address_hash(voucher_seed, salt->bytes, iterations, algorithm);
+}
+
+uint64_t compute_address_hash_suffix(uint8_t *voucher_seed,
+                                     uint8_t *mac_address,
+                                     uint16_t iterations,
+                                     enum VbaAlgorithm algorithm)
+{
+    vba_salt_template_t salt;
+    init_salt_template(&salt, NULL);
+
+    return compute_address_hash_suffix_salted(voucher_seed, &salt, mac_address, iterations, algorithm);
+}
+
+uint64_t build_address_suffix(uint16_t iterations, uint64_t hash_result)
+{
+    return ((uint64_t)(~iterations) << 48) | (0x0000FFFFFFFFFFFF & hash_result);
+}
+
+void print_lladdr_from_suffix(uint64_t suffix)
+{
+    char text[VBA_LLADDR_FIXED_LENGTH + 1];
+
+    format_lladdr_fixed(suffix, text, sizeof(text));
+    fputs(text, stdout);
+}
+
+
+/* Two lower-case hex digits for every byte value. */
+static const char _hex_pairs[512 + 1] =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+static inline void _hex_group(char *out, uint16_t group)
+{
+    memcpy(&out[0], &_hex_pairs[(group >> 8) * 2], 2);
+    memcpy(&out[2], &_hex_pairs[(group & 0xFF) * 2], 2);
+}
+
+/* Fixed layout, so every store lands at a constant offset. */
+static inline void _format_fixed(uint64_t suffix, char *out)
+{
+    memcpy(out, "fe80::", 6);
+    _hex_group(&out[6], (uint16_t)(suffix >> 48));
+    out[10] = ':';
+    _hex_group(&out[11], (uint16_t)(suffix >> 32));
+    out[15] = ':';
+    _hex_group(&out[16], (uint16_t)(suffix >> 16));
+    out[20] = ':';
+    _hex_group(&out[21], (uint16_t)suffix);
+}
+
+size_t format_lladdr_fixed(uint64_t suffix, char *out, size_t size)
+{
+    if (size < VBA_LLADDR_FIXED_LENGTH + 1) return 0;
+
+    _format_fixed(suffix, out);
+    out[VBA_LLADDR_FIXED_LENGTH] = '\0';
+    return VBA_LLADDR_FIXED_LENGTH;
+}
+
+/* Writes the RFC 5952 text, unterminated, into 'out', which needs VBA_LLADDR_MAX_LENGTH bytes. */
+static inline size_t _format_canonical(uint64_t suffix, char *out)
+{
+    uint16_t groups[8] = {
+        0xfe80, 0, 0, 0,
+        (uint16_t)(suffix >> 48), (uint16_t)(suffix >> 32), (uint16_t)(suffix >> 16), (uint16_t)suffix
+    };
+
+    /* Longest run of two or more zero groups; the first one wins a tie. */
+    int run_start = -1, run_length = 1;
+    for (int i = 0, start = 0, length = 0; i < 8; ++i) {
+        length = groups[i] ? 0 : length + 1;
+        start = length == 1 ? i : start;
+        if (length > run_length) {
+            run_start = start;
+            run_length = length;
+        }
+    }
+
+    char *p = out;
+    for (int i = 0; i < 8; ++i) {
+        if (i == run_start) {
+            *p++ = ':';
+            if (0 == i) *p++ = ':';
+            i += run_length - 1;
+            continue;
+        }
+
+        /* Format all four digits, then copy only the significant ones. */
+        char digits[4];
+        _hex_group(digits, groups[i]);
+
+        int significant = (35 - __builtin_clz((uint32_t)groups[i] | 1)) >> 2;
+        memcpy(p, &digits[4 - significant], significant);
+        p += significant;
+
+        if (i < 7) *p++ = ':';
+    }
+
+    return (size_t)(p - out);
+}
+
+size_t format_lladdr(uint64_t suffix, char *out, size_t size)
+{
+    char text[VBA_LLADDR_MAX_LENGTH + 8];
+    size_t length = _format_canonical(suffix, text);
+
+    if (size < length + 1) return 0;
+
+    memcpy(out, text, length);
+    out[length] = '\0';
+    return length;
+}
+
+size_t format_lladdrs_fixed(const uint64_t *suffixes, size_t count, char *out, size_t size)
+{
+    const size_t stride = VBA_LLADDR_FIXED_LENGTH + 1;
+    if (count > size / stride) count = size / stride;
+
+    for (size_t i = 0; i < count; ++i) {
+        _format_fixed(suffixes[i], &out[i * stride]);
+        out[i * stride + VBA_LLADDR_FIXED_LENGTH] = '\n';
+    }
+
+    return count * stride;
+}
+
+size_t format_lladdrs(const uint64_t *suffixes, size_t count, char *out, size_t size)
+{
+    size_t used = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        /* Format straight into the output while there is worst-case room to spare. */
+        if (size - used >= VBA_LLADDR_MAX_LENGTH + 8) {
+            used += _format_canonical(suffixes[i], &out[used]);
+            out[used++] = '\n';
+            continue;
+        }
+
+        char text[VBA_LLADDR_MAX_LENGTH + 8];
+        size_t length = _format_canonical(suffixes[i], text);
+        if (size - used < length + 1) break;
+
+        memcpy(&out[used], text, length);
+        used += length;
+        out[used++] = '\n';
+    }
+
+    return used;
+}
+
+
+static inline int _hex_value(unsigned char c)
+{
+    unsigned int digit = (unsigned int)c - '0';
+    unsigned int letter = (unsigned int)(c | 0x20) - 'a';
+
+    if (digit < 10) return (int)digit;
+    if (letter < 6) return (int)letter + 10;
+    return -1;
+}
+
+/* Exactly four decimal octets ("1.2.3.4") spanning all of 'length'. */
+static int _parse_dotted_quad(const char *text, size_t length, uint32_t *value)
+{
+    uint32_t result = 0;
+    size_t i = 0;
+
+    for (int octet = 0; octet < 4; ++octet) {
+        if (octet) {
+            if (i >= length || '.' != text[i]) return -1;
+            ++i;
+        }
+
+        unsigned int number = 0;
+        size_t digits = 0;
+        for (; i < length && text[i] >= '0' && text[i] <= '9'; ++i) {
+            number = number * 10 + (unsigned int)(text[i] - '0');
+            if (++digits > 3) return -1;
+        }
+        if (!digits || number > 255) return -1;
+
+        result = (result << 8) | number;
+    }
+
+    if (i != length) return -1;
+
+    *value = result;
+    return 0;
+}
+
+int parse_lladdr(const char *text, size_t length, uint64_t *suffix)
+{
+    uint16_t head[8], tail[8];
+    int head_count = 0, tail_count = 0;
+    int compressed = 0;
+    size_t i = 0;
+
+    /* A zone index ("%eth0") only says which link; it is not part of the address. */
+    const char *zone = (const char *)memchr(text, '%', length);
+    if (zone) length = (size_t)(zone - text);
+
+    if (length >= 2 && ':' == text[0]) {
+        if (':' != text[1]) return -1;
+        compressed = 1;
+        i = 2;
+    }
+
+    while (i < length) {
+        if (':' == text[i]) {
+            /* "::" may appear once; a lone ':' here means an empty group. */
+            if (compressed || (i + 1 < length && ':' == text[i + 1])) return -1;
+            compressed = 1;
+            ++i;
+            continue;
+        }
+
+        unsigned int group = 0;
+        size_t digits = 0, start = i;
+        for (int v; i < length && (v = _hex_value((unsigned char)text[i])) >= 0; ++i) {
+            group = (group << 4) | (unsigned int)v;
+            if (++digits > 4) return -1;
+        }
+        if (!digits) return -1;
+
+        /* The last 32 bits may be written as a dotted quad, which then ends the text. */
+        if (i < length && '.' == text[i]) {
+            uint32_t ipv4;
+            if (0 != _parse_dotted_quad(&text[start], length - start, &ipv4)) return -1;
+            if (head_count + tail_count + 2 > 8) return -1;
+
+            uint16_t *groups = compressed ? tail : head;
+            int *count = compressed ? &tail_count : &head_count;
+            groups[(*count)++] = (uint16_t)(ipv4 >> 16);
+            groups[(*count)++] = (uint16_t)ipv4;
+            break;
+        }
+
+        if (head_count + tail_count >= 8) return -1;
+        if (compressed) tail[tail_count++] = (uint16_t)group;
+        else head[head_count++] = (uint16_t)group;
+
+        if (i < length) {
+            if (':' != text[i]) return -1;
+            ++i;
+            /* A trailing single ':' after a group is malformed; "x::" is handled above. */
+            if (i == length) return -1;
+        }
+    }
+
+    int total = head_count + tail_count;
+    if (compressed ? total > 7 : total != 8) return -1;
+
+    uint16_t groups[8] = {0};
+    memcpy(groups, head, head_count * sizeof(uint16_t));
+    memcpy(&groups[8 - tail_count], tail, tail_count * sizeof(uint16_t));
+
+    if (0xfe80 != groups[0] || groups[1] || groups[2] || groups[3]) return -1;
+
+    *suffix = ((uint64_t)groups[4] << 48) | ((uint64_t)groups[5] << 32)
+            | ((uint64_t)groups[6] << 16) | (uint64_t)groups[7];
+    return 0;
+}
+
+const char *vba_algorithm_name(enum VbaAlgorithm algorithm)
+{
+    switch (algorithm) {
+        case PBKDF2: return "pbkdf2";
+        case ARGON2: return "argon2";
+        case SCRYPT: return "scrypt";
+        case ARGON2ID: return "argon2id";
+        case ARGON2D_LANES: return "argon2d-lanes";
+        case ARGON2ID_LANES: return "argon2id-lanes";
+        default:     return "unknown";
+    }
+}
+
+enum VbaAlgorithm vba_algorithm_from_name(const char *name)
+{
+    for (int i = 1; i < VBA_ALGORITHM_SLOTS; ++i)
+        if (0 == strcasecmp(name, vba_algorithm_name((enum VbaAlgorithm)i)))
+            return (enum VbaAlgorithm)i;
+
+    return (enum VbaAlgorithm)0;
+}
+
+void set_argon2_parameters(uint32_t memory_kib, uint32_t lanes)
+{
+    if (!lanes) lanes = 1;
+    if (memory_kib < 8 * lanes) memory_kib = 8 * lanes;
+
+    _argon2_params.memory_kib = memory_kib;
+    _argon2_params.lanes = lanes;
+}
+
+vba_argon2_params_t get_argon2_parameters()
+{
+    return _argon2_params;
+}
+
+uint16_t get_suffix_iterations(uint64_t suffix)
+{
+    return (uint16_t)((~suffix >> 48) & 0xFFFF);
+}
+
+/*
+ * A rough, relative estimate of the work needed to derive one address suffix,
+ *   measured in SHA-256 compression-function equivalents. It is only meant for
+ *   comparing requests against one another (scheduling, budgets); actual costs
+ *   on a given host come from measuring.
+ */
+uint64_t estimate_address_cost(uint16_t iterations, VbaAlgorithm algorithm)
+{
+    switch (algorithm) {
+        case PBKDF2:
+            /* Two compressions (inner and outer HMAC) per PBKDF2 iteration. */
+            return (uint64_t)iterations * ITERATIONS_FACTOR * 2;
+        case ARGON2:
+        case ARGON2ID:
+        case ARGON2D_LANES:
+        case ARGON2ID_LANES:
+            /* One pass over every 1-KiB block per iteration; ~8 compressions each. */
+            /*   Lanes split the same work across threads, so they do not change it. */
+            return (uint64_t)iterations * _argon2_params.memory_kib * 8;
+        case SCRYPT:
+            /* 2 * N BlockMix rounds of 2r Salsa20/8 cores; ~1/2 compression each. */
+            return (uint64_t)iterations * 128 * 2;
+        default:
+            return UINT64_MAX;
+    }
+}
+
+bool verify_address_suffix(uint64_t suffix,
+                           uint8_t* voucher_seed,
+                           uint8_t* mac_address,
+                           VbaAlgorithm algorithm) {
+    uint16_t iterations = get_suffix_iterations(suffix);
+
+    uint64_t hash_result = compute_address_hash_suffix(voucher_seed,
+                                                       mac_address,
+                                                       iterations,
+                                                       algorithm);
+
+    uint64_t computed_suffix = build_address_suffix(iterations, hash_result);
+
+    return computed_suffix == suffix;
+}
\ No newline at end of file
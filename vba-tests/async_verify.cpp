@@ -0,0 +1,245 @@
+#include <string.h>
+
+#include "async_verify.hpp"
+
+
+async_verifier_config_t async_verifier_default_config()
+{
+    async_verifier_config_t config;
+
+    config.worker_count = 0;
+    config.max_queue_depth = 1024;
+    config.max_queued_cost = 0;
+    config.expensive_cost = estimate_address_cost(0x0100, PBKDF2);
+    config.reserved_cheap_workers = 1;
+    config.fifo = false;
+
+    return config;
+}
+
+
+AsyncVerifier::AsyncVerifier(const async_verifier_config_t& config, VerificationCache* cache)
+    : config(config), cache(cache),
+      queued_cost(0), virtual_time(0), sequence(0),
+      running(0), running_expensive(0), stopping(false), worker_count(0),
+      completed(0), rejected(0)
+{
+    unsigned int count = config.worker_count;
+    if (!count) count = std::thread::hardware_concurrency();
+    if (!count) count = 1;
+
+    /* With a single worker there is nothing to reserve; expensive work must still run. */
+    if (this->config.reserved_cheap_workers >= count)
+        this->config.reserved_cheap_workers = count - 1;
+
+    worker_count = count;
+    for (unsigned int i = 0; i < count; ++i)
+        workers.emplace_back(&AsyncVerifier::_Worker, this);
+}
+
+AsyncVerifier::~AsyncVerifier()
+{
+    Shutdown();
+}
+
+
+std::future<async_verify_result_t> AsyncVerifier::Submit(uint64_t suffix,
+                                                         const uint8_t* voucher_seed,
+                                                         const uint8_t* mac_address,
+                                                         VbaAlgorithm algorithm)
+{
+    auto promise = std::make_shared<std::promise<async_verify_result_t>>();
+    std::future<async_verify_result_t> future = promise->get_future();
+
+    Submit(suffix, voucher_seed, mac_address, algorithm,
+           [promise](const async_verify_result_t& result) { promise->set_value(result); });
+
+    return future;
+}
+
+bool AsyncVerifier::Submit(uint64_t suffix,
+                           const uint8_t* voucher_seed,
+                           const uint8_t* mac_address,
+                           VbaAlgorithm algorithm,
+                           async_verify_callback_t callback)
+{
+    uint16_t iterations = get_suffix_iterations(suffix);
+    async_verify_result_t result = { VERIFY_REJECTED, algorithm, iterations, 0, 0 };
+
+    if (algorithm <= 0 || algorithm >= VBA_ALGORITHM_SLOTS) {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        callback(result);
+        return false;
+    }
+
+    /* Cached outcomes never touch the pool. */
+    if (cache) {
+        bool cached = false;
+        verification_key_t key = VerificationCache::MakeKey(suffix, voucher_seed, mac_address, algorithm);
+
+        if (cache->Lookup(key, &cached)) {
+            result.status = cached ? VERIFY_OK : VERIFY_FAILED;
+            completed.fetch_add(1, std::memory_order_relaxed);
+            callback(result);
+            return true;
+        }
+    }
+
+    Request* request = new Request;
+    request->suffix = suffix;
+    memcpy(request->voucher_seed, voucher_seed, sizeof(request->voucher_seed));
+    memcpy(request->mac_address, mac_address, sizeof(request->mac_address));
+    request->algorithm = algorithm;
+    request->iterations = iterations;
+    request->cost = estimate_address_cost(iterations, algorithm);
+    request->callback = callback;
+
+    request_queue_t* queue = queues[algorithm];
+    bool expensive = request->cost >= config.expensive_cost;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        bool admit = !stopping
+            && queue[0].size() + queue[1].size() < config.max_queue_depth
+            && (!config.max_queued_cost || queued_cost + request->cost <= config.max_queued_cost);
+
+        if (admit) {
+            request->sequence = sequence++;
+            request->tag = config.fifo ? request->sequence : virtual_time + request->cost;
+            request->submitted = std::chrono::steady_clock::now();
+
+            queued_cost += request->cost;
+            queue[expensive].push(request);
+            work_ready.notify_one();
+            return true;
+        }
+    }
+
+    delete request;
+    rejected.fetch_add(1, std::memory_order_relaxed);
+    callback(result);
+    return false;
+}
+
+
+/* Must be called with 'lock' held. Returns NULL when nothing is eligible right now. */
+AsyncVerifier::Request* AsyncVerifier::_Pick()
+{
+    bool expensive_allowed = running_expensive < worker_count - config.reserved_cheap_workers;
+    request_queue_t* best = NULL;
+
+    for (int i = 0; i < VBA_ALGORITHM_SLOTS; ++i) {
+        for (int expensive = 0; expensive <= expensive_allowed; ++expensive) {
+            request_queue_t* queue = &queues[i][expensive];
+            if (queue->empty()) continue;
+
+            if (!best || LaterTag()(best->top(), queue->top()))
+                best = queue;
+        }
+    }
+
+    if (!best) return NULL;
+
+    Request* request = best->top();
+    best->pop();
+
+    queued_cost -= request->cost;
+    if (!config.fifo) virtual_time += request->cost;
+
+    return request;
+}
+
+/* Must be called with 'lock' held. */
+bool AsyncVerifier::_Empty() const
+{
+    for (int i = 0; i < VBA_ALGORITHM_SLOTS; ++i)
+        if (!queues[i][0].empty() || !queues[i][1].empty()) return false;
+    return true;
+}
+
+void AsyncVerifier::_Worker()
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (true) {
+        Request* request = _Pick();
+
+        if (!request) {
+            if (stopping && _Empty()) break;
+
+            work_ready.wait(guard);
+            continue;
+        }
+
+        bool expensive = request->cost >= config.expensive_cost;
+        ++running;
+        if (expensive) ++running_expensive;
+
+        guard.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+
+        bool verified = verify_address_suffix(request->suffix,
+                                              request->voucher_seed,
+                                              request->mac_address,
+                                              request->algorithm);
+
+        auto end = std::chrono::steady_clock::now();
+
+        if (cache) {
+            cache->Insert(VerificationCache::MakeKey(request->suffix,
+                                                     request->voucher_seed,
+                                                     request->mac_address,
+                                                     request->algorithm),
+                          verified);
+        }
+
+        async_verify_result_t result = {
+            verified ? VERIFY_OK : VERIFY_FAILED,
+            request->algorithm,
+            request->iterations,
+            (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(start - request->submitted).count(),
+            (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+        };
+
+        request->callback(result);
+        delete request;
+        completed.fetch_add(1, std::memory_order_relaxed);
+
+        guard.lock();
+
+        --running;
+        if (expensive) {
+            --running_expensive;
+            /* An expensive slot opened up; an expensive request may be waiting for it. */
+            work_ready.notify_all();
+        }
+
+        if (!running) idle.notify_all();
+    }
+}
+
+
+void AsyncVerifier::Drain()
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    idle.wait(guard, [this]() { return !running && _Empty(); });
+}
+
+void AsyncVerifier::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (stopping && workers.empty()) return;
+        stopping = true;
+    }
+
+    work_ready.notify_all();
+
+    for (auto& worker : workers)
+        if (worker.joinable()) worker.join();
+
+    workers.clear();
+}
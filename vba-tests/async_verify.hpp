@@ -0,0 +1,146 @@
+#ifndef _ASYNC_VERIFY_H_
+#define _ASYNC_VERIFY_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+#include "vba.h"
+#include "verify_cache.hpp"
+
+
+enum VerifyStatus
+{
+    VERIFY_OK = 0,
+    VERIFY_FAILED = 1,
+    VERIFY_REJECTED = 2,   /* Never ran: refused by admission control or shutdown. */
+};
+
+typedef struct _async_verify_result {
+    VerifyStatus status;
+    VbaAlgorithm algorithm;
+    uint16_t iterations;
+    uint64_t queue_nanoseconds;
+    uint64_t service_nanoseconds;
+} async_verify_result_t;
+
+typedef std::function<void(const async_verify_result_t&)> async_verify_callback_t;
+
+typedef struct _async_verifier_config {
+    /* Worker threads running KDFs. Zero means 'std::thread::hardware_concurrency'. */
+    unsigned int worker_count;
+    /* Requests allowed to wait in each per-algorithm queue. */
+    size_t max_queue_depth;
+    /* Ceiling on the summed 'estimate_address_cost' of queued requests. Zero disables. */
+    uint64_t max_queued_cost;
+    /* Requests at or above this cost are 'expensive' and may not occupy every worker. */
+    uint64_t expensive_cost;
+    /* Workers held back from expensive requests so cheap ones always have somewhere to run. */
+    unsigned int reserved_cheap_workers;
+    /* Plain first-come, first-served dispatch; only useful as a benchmark baseline. */
+    bool fifo;
+} async_verifier_config_t;
+
+async_verifier_config_t async_verifier_default_config();
+
+
+/*
+ * A front end to 'verify_address_suffix' that never blocks the caller on a KDF.
+ *
+ * Requests are queued per algorithm and dispatched by virtual finish time: each
+ *   request is tagged with the amount of work served so far plus its own estimated
+ *   cost, and workers always take the smallest tag across the queues. Cheap
+ *   requests therefore overtake expensive ones that arrived just before them, while
+ *   an expensive request still runs after at most its own cost worth of newer work.
+ *   On top of that a few workers can be reserved for cheap requests only, so a
+ *   burst of 0xFFFE-iteration suffixes cannot occupy the whole pool. Each algorithm
+ *   keeps its cheap and expensive requests apart, so an expensive one waiting for a
+ *   slot never holds up cheap ones behind it.
+ */
+class AsyncVerifier
+{
+public:
+    AsyncVerifier(const async_verifier_config_t& config = async_verifier_default_config(),
+                  VerificationCache* cache = NULL);
+    ~AsyncVerifier();
+
+    std::future<async_verify_result_t> Submit(uint64_t suffix,
+                                              const uint8_t* voucher_seed,
+                                              const uint8_t* mac_address,
+                                              VbaAlgorithm algorithm);
+
+    /* The callback runs on a worker thread, or inline when the request is not queued.
+     *   Returns false when the request was rejected. */
+    bool Submit(uint64_t suffix,
+                const uint8_t* voucher_seed,
+                const uint8_t* mac_address,
+                VbaAlgorithm algorithm,
+                async_verify_callback_t callback);
+
+    /* Blocks until every accepted request has completed. */
+    void Drain();
+
+    /* Stops accepting work, finishes what is queued and joins the workers. */
+    void Shutdown();
+
+    unsigned int WorkerCount() const { return worker_count; }
+    uint64_t Completed() const { return completed.load(std::memory_order_relaxed); }
+    uint64_t Rejected() const { return rejected.load(std::memory_order_relaxed); }
+
+private:
+    struct Request {
+        uint64_t suffix;
+        uint8_t voucher_seed[16];
+        uint8_t mac_address[6];
+        VbaAlgorithm algorithm;
+        uint16_t iterations;
+        uint64_t cost;
+        uint64_t tag;
+        uint64_t sequence;
+        std::chrono::steady_clock::time_point submitted;
+        async_verify_callback_t callback;
+    };
+
+    struct LaterTag {
+        bool operator()(const Request* a, const Request* b) const
+        {
+            return a->tag != b->tag ? a->tag > b->tag : a->sequence > b->sequence;
+        }
+    };
+
+    typedef std::priority_queue<Request*, std::vector<Request*>, LaterTag> request_queue_t;
+
+    Request* _Pick();
+    bool _Empty() const;
+    void _Worker();
+
+    async_verifier_config_t config;
+    VerificationCache* cache;
+
+    std::mutex lock;
+    std::condition_variable work_ready;
+    std::condition_variable idle;
+
+    request_queue_t queues[VBA_ALGORITHM_SLOTS][2];   /* Cheap, then expensive. */
+    uint64_t queued_cost;
+    uint64_t virtual_time;
+    uint64_t sequence;
+    unsigned int running;
+    unsigned int running_expensive;
+    bool stopping;
+
+    unsigned int worker_count;
+    std::vector<std::thread> workers;
+
+    std::atomic<uint64_t> completed;
+    std::atomic<uint64_t> rejected;
+};
+
+
+#endif /* _ASYNC_VERIFY_H_ */
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <x86intrin.h>
+
+#include "bench_runner.hpp"
+
+
+extern unsigned char global_voucher_seed[16];
+
+
+bench_runner_config_t bench_runner_default_config()
+{
+    bench_runner_config_t config;
+    config.warmup = 2;
+    config.repetitions = 31;
+    config.min_repetitions = 5;
+    config.point_budget_ns = 3ULL * 1000 * 1000 * 1000;
+    config.cpu = -1;
+    config.confidence = 0.95;
+
+    const char* value;
+    if ((value = getenv("VBA_BENCH_WARMUP"))) config.warmup = (unsigned int)strtoul(value, NULL, 0);
+    if ((value = getenv("VBA_BENCH_REPETITIONS"))) config.repetitions = (unsigned int)strtoul(value, NULL, 0);
+    if ((value = getenv("VBA_BENCH_CPU"))) config.cpu = atoi(value);
+    if ((value = getenv("VBA_BENCH_CONFIDENCE"))) config.confidence = atof(value);
+
+    if (config.repetitions < config.min_repetitions) config.min_repetitions = config.repetitions;
+    if (!config.repetitions) config.repetitions = config.min_repetitions = 1;
+
+    return config;
+}
+
+uint64_t bench_bytes_processed(VbaAlgorithm algorithm, uint16_t iterations)
+{
+    switch (algorithm) {
+        case PBKDF2:
+            /* Two 64-byte compressions per HMAC round. */
+            return (uint64_t)iterations * ITERATIONS_FACTOR * 2 * 64;
+        case ARGON2:
+        case ARGON2ID:
+        case ARGON2D_LANES:
+        case ARGON2ID_LANES:
+            return (uint64_t)iterations * get_argon2_parameters().memory_kib * 1024;
+        case SCRYPT:
+            /* N = 128 blocks of 128 * r bytes, each written once and read once. */
+            return 2ULL * 128 * 128 * iterations;
+        default:
+            return 0;
+    }
+}
+
+
+BenchmarkRunner::BenchmarkRunner(const bench_runner_config_t& config)
+    : config(config), cycle_fd(-1), pinned(false)
+{
+    /* CPU_SET does not check its index; one past the set would write beyond it. */
+    if (this->config.cpu >= CPU_SETSIZE) {
+        fprintf(stderr, "Cannot pin the benchmark to CPU %d (at most %d); running unpinned.\n",
+                this->config.cpu, CPU_SETSIZE - 1);
+    } else if (this->config.cpu >= 0
+               && 0 == pthread_getaffinity_np(pthread_self(), sizeof(saved_affinity), &saved_affinity)) {
+        cpu_set_t target;
+        CPU_ZERO(&target);
+        CPU_SET(this->config.cpu, &target);
+
+        pinned = 0 == pthread_setaffinity_np(pthread_self(), sizeof(target), &target);
+        if (!pinned)
+            fprintf(stderr, "Cannot pin the benchmark to CPU %d; running unpinned.\n", this->config.cpu);
+    }
+
+    /* Core cycles for this thread only; often refused in containers, hence the TSC fallback. */
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    cycle_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+BenchmarkRunner::~BenchmarkRunner()
+{
+    if (cycle_fd >= 0) close(cycle_fd);
+    if (pinned) pthread_setaffinity_np(pthread_self(), sizeof(saved_affinity), &saved_affinity);
+}
+
+uint64_t BenchmarkRunner::_ReadCycles() const
+{
+    if (cycle_fd >= 0) {
+        uint64_t count = 0;
+        if (sizeof(count) == read(cycle_fd, &count, sizeof(count))) return count;
+    }
+
+    return __rdtsc();
+}
+
+
+static inline double _median_sorted(const std::vector<double>& sorted)
+{
+    size_t n = sorted.size();
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+static inline double _z_for(double confidence)
+{
+    if (confidence >= 0.99) return 2.576;
+    if (confidence >= 0.95) return 1.960;
+    return 1.645;
+}
+
+bench_point_stats_t BenchmarkRunner::Measure(VbaAlgorithm algorithm, uint16_t iterations)
+{
+    uint8_t mac_address[6] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+    std::vector<double> ns, cycles;
+    ns.reserve(config.repetitions);
+    cycles.reserve(config.repetitions);
+
+    for (unsigned int w = 0; w < config.warmup; ++w)
+        compute_address_hash_suffix(global_voucher_seed, mac_address, iterations, algorithm);
+
+    auto point_start = std::chrono::steady_clock::now();
+
+    for (unsigned int r = 0; r < config.repetitions; ++r) {
+        uint64_t c0 = _ReadCycles();
+        auto start = std::chrono::steady_clock::now();
+
+        compute_address_hash_suffix(global_voucher_seed, mac_address, iterations, algorithm);
+
+        auto end = std::chrono::steady_clock::now();
+        uint64_t c1 = _ReadCycles();
+
+        ns.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        cycles.push_back((double)(c1 - c0));
+
+        uint64_t spent = std::chrono::duration_cast<std::chrono::nanoseconds>(end - point_start).count();
+        if (r + 1 >= config.min_repetitions && spent >= config.point_budget_ns) break;
+    }
+
+    bench_point_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.algorithm = algorithm;
+    stats.iterations = iterations;
+    stats.samples = (unsigned int)ns.size();
+
+    std::sort(ns.begin(), ns.end());
+    std::sort(cycles.begin(), cycles.end());
+
+    size_t n = ns.size();
+    stats.median_ns = _median_sorted(ns);
+    stats.min_ns = ns.front();
+    stats.max_ns = ns.back();
+
+    std::vector<double> deviations(n);
+    for (size_t i = 0; i < n; ++i) deviations[i] = fabs(ns[i] - stats.median_ns);
+    std::sort(deviations.begin(), deviations.end());
+    stats.mad_ns = _median_sorted(deviations);
+
+    /* Ranks n/2 -+ z*sqrt(n)/2 bound the median with roughly the requested confidence. */
+    double half_width = _z_for(config.confidence) * sqrt((double)n) / 2;
+    long low = (long)floor(n / 2.0 - half_width);
+    long high = (long)ceil(n / 2.0 + half_width);
+    stats.ci_low_ns = ns[low < 0 ? 0 : low];
+    stats.ci_high_ns = ns[high >= (long)n ? n - 1 : high];
+
+    stats.median_cycles = _median_sorted(cycles);
+    stats.cycles_per_iteration = stats.median_cycles / iterations;
+
+    uint64_t bytes = bench_bytes_processed(algorithm, iterations);
+    stats.cycles_per_byte = bytes ? stats.median_cycles / bytes : 0;
+
+    return stats;
+}
+
+
+void BenchmarkRunner::PrintHeader()
+{
+    printf("%-14s %8s %5s %14s %12s %27s %16s %14s %10s\n",
+           "algorithm", "iters", "n", "median (us)", "MAD (us)", "CI (us)",
+           "cycles", "cycles/iter", "cycles/B");
+}
+
+void BenchmarkRunner::PrintPoint(const bench_point_stats_t& stats)
+{
+    printf("%-14s  0x%04x %5u %14.1f %12.1f  [%11.1f, %11.1f] %16.0f %14.0f %10.2f\n",
+           vba_algorithm_name(stats.algorithm), stats.iterations, stats.samples,
+           stats.median_ns / 1000, stats.mad_ns / 1000,
+           stats.ci_low_ns / 1000, stats.ci_high_ns / 1000,
+           stats.median_cycles, stats.cycles_per_iteration, stats.cycles_per_byte);
+}
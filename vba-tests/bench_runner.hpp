@@ -0,0 +1,81 @@
+#ifndef _BENCH_RUNNER_H_
+#define _BENCH_RUNNER_H_
+
+#include <sched.h>
+#include <stdint.h>
+#include <vector>
+
+#include "vba.h"
+
+
+typedef struct _bench_runner_config {
+    /* Untimed calls before sampling, to settle caches, allocators and clocks. */
+    unsigned int warmup;
+    /* Timed calls per point, unless the time budget runs out first. */
+    unsigned int repetitions;
+    /* Never fewer samples than this, whatever the budget says. */
+    unsigned int min_repetitions;
+    /* Wall-clock budget per point; keeps expensive points from running for hours. */
+    uint64_t point_budget_ns;
+    /* Pin the measuring thread to this CPU for the runner's lifetime; -1 leaves it. */
+    int cpu;
+    /* Two-sided confidence level for the interval around the median: 0.90, 0.95 or 0.99. */
+    double confidence;
+} bench_runner_config_t;
+
+/* Defaults, overridden by VBA_BENCH_WARMUP, _REPETITIONS, _CPU and _CONFIDENCE. */
+bench_runner_config_t bench_runner_default_config();
+
+typedef struct _bench_point_stats {
+    VbaAlgorithm algorithm;
+    uint16_t iterations;
+    unsigned int samples;
+    double median_ns;
+    double mad_ns;        /* Median absolute deviation, unscaled. */
+    double ci_low_ns;     /* Distribution-free interval for the median, from order statistics. */
+    double ci_high_ns;
+    double min_ns;
+    double max_ns;
+    double median_cycles;
+    double cycles_per_iteration;
+    double cycles_per_byte;   /* See 'bench_bytes_processed'. */
+} bench_point_stats_t;
+
+/*
+ * Bytes the KDF moves through its core for one derivation: compressed SHA-256 input
+ *   for PBKDF2, memory filled for Argon2, and scratch written plus read for scrypt.
+ */
+uint64_t bench_bytes_processed(VbaAlgorithm algorithm, uint16_t iterations);
+
+
+/*
+ * Measures 'compute_address_hash_suffix' at one (algorithm, iterations) point at a
+ *   time. Nothing is printed while sampling. Cycles come from the hardware cycle
+ *   counter when perf events are available, and from the TSC (reference cycles)
+ *   otherwise; 'CycleSource' says which.
+ */
+class BenchmarkRunner
+{
+public:
+    explicit BenchmarkRunner(const bench_runner_config_t& config);
+    ~BenchmarkRunner();
+
+    bench_point_stats_t Measure(VbaAlgorithm algorithm, uint16_t iterations);
+
+    const char* CycleSource() const { return cycle_fd >= 0 ? "cpu-cycles" : "tsc"; }
+    bool Pinned() const { return pinned; }
+
+    static void PrintHeader();
+    static void PrintPoint(const bench_point_stats_t& stats);
+
+private:
+    uint64_t _ReadCycles() const;
+
+    bench_runner_config_t config;
+    int cycle_fd;
+    bool pinned;
+    cpu_set_t saved_affinity;
+};
+
+
+#endif /* _BENCH_RUNNER_H_ */
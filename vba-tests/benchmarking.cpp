@@ -1,11 +1,24 @@
 #include <vector>
+#include <algorithm>
+#include <mutex>
+#include <thread>
 #include <chrono>
 #include <string>
 #include <stdlib.h>
+#include <math.h>
 
 #include "benchmarking.hpp"
 #include "timing.hpp"
 #include "vba.h"
+#include "vba_types.hpp"
+#include "kdf_backends.h"
+#include "generator.h"
+#include "verify_cache.hpp"
+#include "async_verify.hpp"
+#include "verify_policy.hpp"
+#include "verify_batch.hpp"
+#include "calibration.h"
+#include "bench_runner.hpp"
 
 
 extern unsigned char global_voucher_seed[16];
@@ -16,6 +29,47 @@ extern uint16_t _fixed_iter_step;
 static inline void _benchmark_algo(VbaAlgorithm);
 
 
+#define CACHE_WORKLOAD_ADDRESSES   512
+#define CACHE_WORKLOAD_REQUESTS    20000
+#define CACHE_WORKLOAD_UNCACHED    2000
+#define CACHE_WORKLOAD_ZIPF_S      1.1
+#define CACHE_WORKLOAD_BOGUS_PCT   10
+
+#define ASYNC_LOAD_SECONDS         2
+#define ASYNC_LOAD_CHEAP_PER_SEC   200
+#define ASYNC_LOAD_COSTLY_PER_SEC  4
+#define ASYNC_LOAD_CHEAP_ITERS     0x0001
+#define ASYNC_LOAD_COSTLY_ITERS    0x0400
+#define ASYNC_BACKLOG_COSTLY       8
+
+#define FLOOD_CEILING              0x0100
+#define FLOOD_LEGIT_REQUESTS       64
+#define FLOOD_HOSTILE_REQUESTS     512
+
+#define KDF_INPUT_BUILD_ROUNDS     (1 << 24)
+#define KDF_INPUT_DERIVE_ROUNDS    20000
+
+#define BACKEND_COMPARE_POINTS     4
+
+#define LANES_MEMORY_KIB           (16 * 1024)
+#define LANES_ITERATIONS           0x0002
+#define LANES_MAX                  16
+
+#define BATCH_NEIGHBOURS           256
+#define BATCH_BOGUS_PCT            10
+
+#define LLADDR_FORMAT_COUNT        (1 << 20)
+
+#define STATS_MAX_ITERATIONS       0x0500
+
+#define TIMING_OVERHEAD_EVENTS     (1 << 22)
+#define TIMING_OVERHEAD_LEGACY     (1 << 16)
+
+#define CALIBRATION_TARGET_NS      (100ULL * 1000 * 1000)
+#define CALIBRATION_ATTACKER_RATE  1e9
+#define CALIBRATION_ATTACK_SECONDS (365.0 * 24 * 3600)
+
+
 void
 benchmark_pbkdf2()
 {
@@ -33,6 +87,859 @@ void benchmark_scrypt()
     return _benchmark_algo(SCRYPT);
 }
 
+void benchmark_argon2id()
+{
+    return _benchmark_algo(ARGON2ID);
+}
+
+
+/*
+ * Replay a skewed neighbour-verification workload against the verification cache.
+ *   Neighbour popularity follows a Zipf distribution (a few hosts are re-checked all
+ *   the time, most rarely), and a slice of the requests carry bogus suffixes to
+ *   exercise the negative cache the way a re-verification flood would.
+ */
+void benchmark_verify_cache()
+{
+    const uint16_t iterations = 0x0010;
+    const VbaAlgorithm algorithm = PBKDF2;
+
+    std::vector<uint64_t> suffixes(CACHE_WORKLOAD_ADDRESSES);
+    std::vector<uint64_t> macs(CACHE_WORKLOAD_ADDRESSES);
+    std::vector<double> cdf(CACHE_WORKLOAD_ADDRESSES);
+
+    double total_weight = 0.0;
+    for (int i = 0; i < CACHE_WORKLOAD_ADDRESSES; ++i) {
+        total_weight += 1.0 / pow((double)(i + 1), CACHE_WORKLOAD_ZIPF_S);
+        cdf[i] = total_weight;
+    }
+
+    printf("Deriving %d neighbour addresses at '0x%04x' iterations...\n",
+           CACHE_WORKLOAD_ADDRESSES, iterations);
+
+    for (int i = 0; i < CACHE_WORKLOAD_ADDRESSES; ++i) {
+        macs[i] = Xoshiro128p__next_bounded_any();
+        suffixes[i] = build_address_suffix(iterations,
+                                           compute_address_hash_suffix(global_voucher_seed,
+                                                                       (uint8_t *)&macs[i],
+                                                                       iterations,
+                                                                       algorithm));
+    }
+
+    /* Build the request stream up front so both passes replay the exact same trace. */
+    std::vector<uint32_t> picks(CACHE_WORKLOAD_REQUESTS);
+    std::vector<uint64_t> requested(CACHE_WORKLOAD_REQUESTS);
+    for (int i = 0; i < CACHE_WORKLOAD_REQUESTS; ++i) {
+        double u = (double)Xoshiro128p__next_bounded(0, 1ULL << 52) / (double)(1ULL << 52) * total_weight;
+        picks[i] = (uint32_t)(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+        if (picks[i] >= CACHE_WORKLOAD_ADDRESSES) picks[i] = CACHE_WORKLOAD_ADDRESSES - 1;
+
+        requested[i] = suffixes[picks[i]];
+        if (Xoshiro128p__next_bounded(0, 99) < CACHE_WORKLOAD_BOGUS_PCT)
+            requested[i] ^= 1ULL + (Xoshiro128p__next_bounded(0, 0xFF) % 0x7F);
+    }
+
+    /* Uncached baseline over a prefix of the trace; the full trace would take too long. */
+    auto start_uncached = std::chrono::high_resolution_clock::now();
+    int uncached_ok = 0;
+    for (int i = 0; i < CACHE_WORKLOAD_UNCACHED; ++i)
+        uncached_ok += verify_address_suffix(requested[i],
+                                             global_voucher_seed,
+                                             (uint8_t *)&macs[picks[i]],
+                                             algorithm);
+    auto end_uncached = std::chrono::high_resolution_clock::now();
+
+    VerificationCache cache(VERIFY_CACHE_DEFAULT_SHARDS,
+                            CACHE_WORKLOAD_ADDRESSES / 2,
+                            CACHE_WORKLOAD_ADDRESSES / 8);
+
+    auto start_cached = std::chrono::high_resolution_clock::now();
+    int cached_ok = 0, cached_prefix_ok = 0;
+    for (int i = 0; i < CACHE_WORKLOAD_REQUESTS; ++i) {
+        cached_ok += cache.Verify(requested[i],
+                                  global_voucher_seed,
+                                  (uint8_t *)&macs[picks[i]],
+                                  algorithm);
+        if (i == CACHE_WORKLOAD_UNCACHED - 1) cached_prefix_ok = cached_ok;
+    }
+    auto end_cached = std::chrono::high_resolution_clock::now();
+
+    uint64_t uncached_us = Timing::ConvertTimeToMicroseconds(start_uncached, end_uncached);
+    uint64_t cached_us = Timing::ConvertTimeToMicroseconds(start_cached, end_cached);
+
+    printf("Verification cache replay (%d requests, Zipf s=%.2f, %d%% bogus, capacity %d/%d):\n",
+           CACHE_WORKLOAD_REQUESTS, CACHE_WORKLOAD_ZIPF_S, CACHE_WORKLOAD_BOGUS_PCT,
+           CACHE_WORKLOAD_ADDRESSES / 2, CACHE_WORKLOAD_ADDRESSES / 8);
+    cache.PrintStats();
+    printf("\tUncached: %16f us/request  (%d requests)\n",
+           (double)uncached_us / CACHE_WORKLOAD_UNCACHED, CACHE_WORKLOAD_UNCACHED);
+    printf("\tCached:   %16f us/request  (%d requests)\n",
+           (double)cached_us / CACHE_WORKLOAD_REQUESTS, CACHE_WORKLOAD_REQUESTS);
+
+    if (uncached_ok != cached_prefix_ok)
+        printf("\tMISMATCH: cached and uncached passes disagree (%d vs %d verified).\n",
+               cached_prefix_ok, uncached_ok);
+
+    verification_cache_stats_t stats = cache.GetStats();
+    std::stringstream s_uncached, s_cached;
+    s_uncached << "Uncached verify x" << CACHE_WORKLOAD_UNCACHED;
+    s_cached << "Cached verify x" << CACHE_WORKLOAD_REQUESTS
+             << " / hit rate " << (stats.lookups ? 100.0 * (stats.hits + stats.negative_hits) / stats.lookups : 0.0);
+    Timing::RecordTiming(0, uncached_us, s_uncached.str());
+    Timing::RecordTiming(1, cached_us, s_cached.str());
+}
+
+
+static inline uint64_t _percentile(std::vector<uint64_t>& samples, double pct)
+{
+    if (samples.empty()) return 0;
+
+    size_t rank = (size_t)(pct / 100.0 * (samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+/*
+ * Open-loop load generator for the asynchronous verifier. A steady stream of cheap
+ *   verifications is mixed with a trickle of expensive ones, and the same schedule
+ *   is replayed against first-come-first-served dispatch and against cost-weighted
+ *   dispatch. What matters is the queueing latency of the cheap class.
+ */
+void benchmark_async_verify()
+{
+    const VbaAlgorithm algorithm = PBKDF2;
+    const int cheap_count = 8, costly_count = 4;
+
+    uint64_t cheap_macs[cheap_count], costly_macs[costly_count];
+    uint64_t cheap_suffixes[cheap_count], costly_suffixes[costly_count];
+
+    for (int i = 0; i < cheap_count; ++i) {
+        cheap_macs[i] = Xoshiro128p__next_bounded_any();
+        cheap_suffixes[i] = build_address_suffix(ASYNC_LOAD_CHEAP_ITERS,
+            compute_address_hash_suffix(global_voucher_seed, (uint8_t *)&cheap_macs[i],
+                                        ASYNC_LOAD_CHEAP_ITERS, algorithm));
+    }
+    for (int i = 0; i < costly_count; ++i) {
+        costly_macs[i] = Xoshiro128p__next_bounded_any();
+        costly_suffixes[i] = build_address_suffix(ASYNC_LOAD_COSTLY_ITERS,
+            compute_address_hash_suffix(global_voucher_seed, (uint8_t *)&costly_macs[i],
+                                        ASYNC_LOAD_COSTLY_ITERS, algorithm));
+    }
+
+    for (int pass = 0; pass < 2; ++pass) {
+        async_verifier_config_t config = async_verifier_default_config();
+        config.fifo = (0 == pass);
+        config.expensive_cost = estimate_address_cost(ASYNC_LOAD_COSTLY_ITERS, algorithm);
+
+        std::mutex samples_lock;
+        std::vector<uint64_t> cheap_queue, costly_queue;
+        uint64_t failures = 0;
+
+        AsyncVerifier verifier(config);
+
+        auto callback = [&](const async_verify_result_t& result) {
+            std::lock_guard<std::mutex> guard(samples_lock);
+            if (VERIFY_OK != result.status) ++failures;
+            (ASYNC_LOAD_COSTLY_ITERS == result.iterations ? costly_queue : cheap_queue)
+                .push_back(result.queue_nanoseconds);
+        };
+
+        const int total_cheap = ASYNC_LOAD_SECONDS * ASYNC_LOAD_CHEAP_PER_SEC;
+        const int costly_every = ASYNC_LOAD_CHEAP_PER_SEC / ASYNC_LOAD_COSTLY_PER_SEC;
+        const auto interval = std::chrono::microseconds(1000000 / ASYNC_LOAD_CHEAP_PER_SEC);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        auto next = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < total_cheap; ++i) {
+            if (0 == i % costly_every) {
+                int c = (i / costly_every) % costly_count;
+                verifier.Submit(costly_suffixes[c], global_voucher_seed,
+                                (uint8_t *)&costly_macs[c], algorithm, callback);
+            }
+
+            int c = i % cheap_count;
+            verifier.Submit(cheap_suffixes[c], global_voucher_seed,
+                            (uint8_t *)&cheap_macs[c], algorithm, callback);
+
+            next += interval;
+            std::this_thread::sleep_until(next);
+        }
+
+        verifier.Drain();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        uint64_t us = Timing::ConvertTimeToMicroseconds(start, end);
+        uint64_t done = verifier.Completed();
+
+        printf("Async verifier, %s dispatch (%u workers):\n",
+               config.fifo ? "FIFO" : "cost-weighted", verifier.WorkerCount());
+        printf("\tCompleted: %lu    Rejected: %lu    Failed: %lu    Throughput: %.1f verifications/s\n",
+               done, verifier.Rejected(), failures, us ? done * 1000000.0 / us : 0.0);
+        printf("\tCheap  ('0x%04x') queue latency:  p50 %10.1f us   p99 %10.1f us\n",
+               ASYNC_LOAD_CHEAP_ITERS,
+               _percentile(cheap_queue, 50) / 1000.0, _percentile(cheap_queue, 99) / 1000.0);
+        printf("\tCostly ('0x%04x') queue latency:  p50 %10.1f us   p99 %10.1f us\n\n",
+               ASYNC_LOAD_COSTLY_ITERS,
+               _percentile(costly_queue, 50) / 1000.0, _percentile(costly_queue, 99) / 1000.0);
+
+        std::stringstream s;
+        s << (config.fifo ? "FIFO" : "Cost-weighted")
+          << " / cheap p99 queue us " << _percentile(cheap_queue, 99) / 1000
+          << " / costly p99 queue us " << _percentile(costly_queue, 99) / 1000;
+        Timing::RecordTiming(pass, start, end, s.str());
+    }
+}
+
+
+/*
+ * Two workers, one of them reserved for cheap requests, are handed a backlog of
+ *   expensive verifications of the same algorithm, so every expensive slot stays busy
+ *   and an expensive request always waits at the front. Cheap requests arriving
+ *   meanwhile must still be served by the reserved worker rather than queue behind it.
+ */
+void benchmark_async_reserved()
+{
+    const VbaAlgorithm algorithm = PBKDF2;
+
+    uint64_t cheap_mac = Xoshiro128p__next_bounded_any(), costly_mac = Xoshiro128p__next_bounded_any();
+    uint64_t cheap_suffix = build_address_suffix(ASYNC_LOAD_CHEAP_ITERS,
+        compute_address_hash_suffix(global_voucher_seed, (uint8_t *)&cheap_mac, ASYNC_LOAD_CHEAP_ITERS, algorithm));
+    uint64_t costly_suffix = build_address_suffix(ASYNC_LOAD_COSTLY_ITERS,
+        compute_address_hash_suffix(global_voucher_seed, (uint8_t *)&costly_mac, ASYNC_LOAD_COSTLY_ITERS, algorithm));
+
+    async_verifier_config_t config = async_verifier_default_config();
+    config.worker_count = 2;
+    config.reserved_cheap_workers = 1;
+    config.expensive_cost = estimate_address_cost(ASYNC_LOAD_COSTLY_ITERS, algorithm);
+
+    std::mutex samples_lock;
+    std::vector<uint64_t> cheap_queue;
+    uint64_t failures = 0, cheap_during_backlog = 0;
+    int costly_done = 0;
+
+    AsyncVerifier verifier(config);
+
+    auto callback = [&](const async_verify_result_t& result) {
+        std::lock_guard<std::mutex> guard(samples_lock);
+        if (VERIFY_OK != result.status) ++failures;
+        if (ASYNC_LOAD_COSTLY_ITERS == result.iterations) {
+            ++costly_done;
+        } else {
+            cheap_queue.push_back(result.queue_nanoseconds);
+            if (costly_done < ASYNC_BACKLOG_COSTLY) ++cheap_during_backlog;
+        }
+    };
+
+    auto backlogged = [&]() {
+        std::lock_guard<std::mutex> guard(samples_lock);
+        return costly_done < ASYNC_BACKLOG_COSTLY;
+    };
+
+    const auto interval = std::chrono::microseconds(1000000 / ASYNC_LOAD_CHEAP_PER_SEC);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (int i = 0; i < ASYNC_BACKLOG_COSTLY; ++i)
+        verifier.Submit(costly_suffix, global_voucher_seed, (uint8_t *)&costly_mac, algorithm, callback);
+
+    uint64_t cheap_submitted = 0;
+    for (auto next = std::chrono::steady_clock::now(); backlogged(); ++cheap_submitted) {
+        verifier.Submit(cheap_suffix, global_voucher_seed, (uint8_t *)&cheap_mac, algorithm, callback);
+
+        next += interval;
+        std::this_thread::sleep_until(next);
+    }
+
+    verifier.Drain();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    printf("Async verifier, %d expensive requests backlogged (%u workers, %u reserved for cheap ones):\n",
+           ASYNC_BACKLOG_COSTLY, verifier.WorkerCount(), config.reserved_cheap_workers);
+    printf("\tCheap submitted meanwhile: %lu    Served before the backlog cleared: %lu    Failed: %lu\n",
+           cheap_submitted, cheap_during_backlog, failures);
+    printf("\tCheap  ('0x%04x') queue latency:  p50 %10.1f us   p99 %10.1f us\n\n",
+           ASYNC_LOAD_CHEAP_ITERS,
+           _percentile(cheap_queue, 50) / 1000.0, _percentile(cheap_queue, 99) / 1000.0);
+
+    std::stringstream s;
+    s << "Backlogged / cheap served " << cheap_during_backlog << " of " << cheap_submitted
+      << " / cheap p99 queue us " << _percentile(cheap_queue, 99) / 1000;
+    Timing::RecordTiming(0, start, end, s.str());
+}
+
+
+/*
+ * Synthetic flood against the verification policy. Two hostile sources send suffixes
+ *   with made-up hashes: one claims 0xFFFE iterations (the most expensive thing the
+ *   encoding allows), the other sits exactly at the configured ceiling and is only
+ *   stopped by its cost budget. Legitimate neighbours keep verifying cheap addresses
+ *   throughout. The unpoliced cost is projected from a measured per-iteration cost,
+ *   since actually running a flood of 0xFFFE PBKDF2 derivations would take hours.
+ */
+void benchmark_verify_policy()
+{
+    const VbaAlgorithm algorithm = PBKDF2;
+    const uint16_t legit_iterations = 0x0001;
+    const uint64_t hostile_sources[2] = { 0xBAD0, 0xBAD1 };
+    const uint16_t hostile_iterations[2] = { 0xFFFE, FLOOD_CEILING };
+
+    verification_policy_config_t config = verification_policy_default_config();
+    for (int i = 0; i < VBA_ALGORITHM_SLOTS; ++i)
+        if (config.max_iterations[i]) config.max_iterations[i] = FLOOD_CEILING;
+    config.source_budget = 2 * estimate_address_cost(FLOOD_CEILING, algorithm);
+    config.source_refill_per_second = estimate_address_cost(FLOOD_CEILING, algorithm);
+
+    VerificationPolicy policy(config);
+
+    /* Cost of a single iteration step, so the unpoliced total can be projected. */
+    uint64_t probe_mac = Xoshiro128p__next_bounded_any() & ~1ULL;
+    auto start_probe = std::chrono::high_resolution_clock::now();
+    compute_address_hash_suffix(global_voucher_seed, (uint8_t *)&probe_mac, 0x0010, algorithm);
+    auto end_probe = std::chrono::high_resolution_clock::now();
+    double us_per_iteration = Timing::ConvertTimeToMicroseconds(start_probe, end_probe) / (double)0x0010;
+
+    int total = FLOOD_LEGIT_REQUESTS + FLOOD_HOSTILE_REQUESTS;
+    std::vector<uint64_t> sources(total), suffixes(total), macs(total);
+    double projected_us = 0.0;
+
+    for (int i = 0; i < total; ++i) {
+        macs[i] = Xoshiro128p__next_bounded_any() & ~1ULL;
+
+        if (i % (total / FLOOD_LEGIT_REQUESTS) == 0) {
+            sources[i] = macs[i];
+            suffixes[i] = build_address_suffix(legit_iterations,
+                compute_address_hash_suffix(global_voucher_seed, (uint8_t *)&macs[i],
+                                            legit_iterations, algorithm));
+        } else {
+            int h = i & 1;
+            sources[i] = hostile_sources[h];
+            suffixes[i] = build_address_suffix(hostile_iterations[h], Xoshiro128p__next_bounded_any());
+        }
+
+        projected_us += us_per_iteration * get_suffix_iterations(suffixes[i]);
+    }
+
+    int legit_ok = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < total; ++i) {
+        bool verified = policy.Verify(sources[i], suffixes[i], global_voucher_seed,
+                                      (uint8_t *)&macs[i], algorithm);
+        if (verified) ++legit_ok;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    uint64_t policed_us = Timing::ConvertTimeToMicroseconds(start, end);
+
+    printf("Verification policy under flood (%d legitimate, %d hostile, ceiling '0x%04x'):\n",
+           FLOOD_LEGIT_REQUESTS, FLOOD_HOSTILE_REQUESTS, FLOOD_CEILING);
+    policy.PrintStats();
+    printf("\tLegitimate verified: %d / %d\n", legit_ok, FLOOD_LEGIT_REQUESTS);
+    printf("\tPoliced: %16lu us    Unpoliced (projected): %16.0f us    Saved: %.4f%%\n",
+           policed_us, projected_us,
+           projected_us > 0 ? 100.0 * (1.0 - policed_us / projected_us) : 0.0);
+
+    std::stringstream s_policed, s_projected;
+    s_policed << "Policed flood x" << total;
+    s_projected << "Unpoliced flood x" << total << " (projected)";
+    Timing::RecordTiming(0, policed_us, s_policed.str());
+    Timing::RecordTiming(1, (uint64_t)projected_us, s_projected.str());
+}
+
+
+/* The pre-template input path: roll a MAC byte by byte, then rebuild the whole salt. */
+static inline void _legacy_kdf_input(uint8_t* salt_out, uint64_t rand)
+{
+    uint8_t mac_address[6];
+    mac_address[0] = *(((uint8_t *)&rand) + 0);
+    mac_address[1] = *(((uint8_t *)&rand) + 1);
+    mac_address[2] = *(((uint8_t *)&rand) + 2);
+    mac_address[3] = *(((uint8_t *)&rand) + 3);
+    mac_address[4] = *(((uint8_t *)&rand) + 4);
+    mac_address[5] = *(((uint8_t *)&rand) + 5);
+
+    uint8_t salt[17] = { 0, 0, 0, 0, 0, 0, 'v', 'b', 'a', 0xFE, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    memcpy(&salt[0], mac_address, 6);
+    memcpy(salt_out, salt, sizeof(salt));
+}
+
+/*
+ * Per-call overhead of building KDF input. First the input construction alone, so
+ *   the difference is not lost in the noise, then whole derivations at iteration
+ *   count 1 where that overhead is the largest share of a call it will ever be.
+ */
+void benchmark_kdf_input()
+{
+    vba_salt_template_t salt;
+    init_salt_template(&salt, NULL);
+
+    volatile uint8_t sink = 0;
+    uint64_t x = Xoshiro128p__next_bounded_any();
+
+    auto start_legacy = std::chrono::high_resolution_clock::now();
+    for (uint64_t i = 0; i < KDF_INPUT_BUILD_ROUNDS; ++i) {
+        _legacy_kdf_input(salt.bytes, x + i);
+        sink = sink + salt.bytes[i % 6];
+    }
+    auto end_legacy = std::chrono::high_resolution_clock::now();
+
+    auto start_template = std::chrono::high_resolution_clock::now();
+    for (uint64_t i = 0; i < KDF_INPUT_BUILD_ROUNDS; ++i) {
+        MacAddress mac = MacAddress::FromU64(x + i);
+        memcpy(&salt.bytes[0], mac.octets, 6);
+        sink = sink + salt.bytes[i % 6];
+    }
+    auto end_template = std::chrono::high_resolution_clock::now();
+
+    const uint16_t iterations = 0x0001;
+    uint64_t legacy_sum = 0, template_sum = 0;
+
+    auto start_derive_legacy = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < KDF_INPUT_DERIVE_ROUNDS; ++i) {
+        MacAddress mac = MacAddress::FromU64(x + i);
+        legacy_sum += build_address_suffix(iterations,
+                                           compute_address_hash_suffix(global_voucher_seed,
+                                                                       mac.octets,
+                                                                       iterations,
+                                                                       PBKDF2));
+    }
+    auto end_derive_legacy = std::chrono::high_resolution_clock::now();
+
+    auto start_derive_template = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < KDF_INPUT_DERIVE_ROUNDS; ++i)
+        template_sum += derive_address_suffix(global_voucher_seed,
+                                              &salt,
+                                              MacAddress::FromU64(x + i),
+                                              iterations,
+                                              PBKDF2).value;
+    auto end_derive_template = std::chrono::high_resolution_clock::now();
+
+    double legacy_ns = std::chrono::duration<double, std::nano>(end_legacy - start_legacy).count() / KDF_INPUT_BUILD_ROUNDS;
+    double template_ns = std::chrono::duration<double, std::nano>(end_template - start_template).count() / KDF_INPUT_BUILD_ROUNDS;
+    uint64_t derive_legacy_us = Timing::ConvertTimeToMicroseconds(start_derive_legacy, end_derive_legacy);
+    uint64_t derive_template_us = Timing::ConvertTimeToMicroseconds(start_derive_template, end_derive_template);
+
+    printf("KDF input construction (%d rounds):\n", KDF_INPUT_BUILD_ROUNDS);
+    printf("\tRolled MAC + full salt:   %8.3f ns/call\n", legacy_ns);
+    printf("\tMacAddress + template:    %8.3f ns/call\n", template_ns);
+    printf("Whole derivation, PBKDF2 at '0x%04x' (%d rounds):\n", iterations, KDF_INPUT_DERIVE_ROUNDS);
+    printf("\tcompute_address_hash_suffix:        %10.3f us/call\n", (double)derive_legacy_us / KDF_INPUT_DERIVE_ROUNDS);
+    printf("\tcompute_address_hash_suffix_salted: %10.3f us/call\n", (double)derive_template_us / KDF_INPUT_DERIVE_ROUNDS);
+
+    if (legacy_sum != template_sum)
+        printf("\tMISMATCH: template derivations disagree with the reference path.\n");
+
+    std::stringstream s_legacy, s_template;
+    s_legacy << "Legacy input x" << KDF_INPUT_DERIVE_ROUNDS << " / build ns " << legacy_ns;
+    s_template << "Template input x" << KDF_INPUT_DERIVE_ROUNDS << " / build ns " << template_ns;
+    Timing::RecordTiming(0, derive_legacy_us, s_legacy.str());
+    Timing::RecordTiming(1, derive_template_us, s_template.str());
+}
+
+
+/*
+ * Force each verified KDF backend in turn and time it at a few iteration counts, so
+ *   implementations of the same algorithm can be compared side by side. Whatever
+ *   was active beforehand (autoselected or forced) is restored afterwards.
+ */
+void benchmark_kdf_backends()
+{
+    static const uint16_t points[BACKEND_COMPARE_POINTS] = { 0x0001, 0x0010, 0x0040, 0x0100 };
+    MacAddress mac = MacAddress::FromU64(0x112233445566ULL);
+    int slot = 0;
+
+    for (int a = 1; a < VBA_ALGORITHM_SLOTS; ++a) {
+        VbaAlgorithm algorithm = (VbaAlgorithm)a;
+        const kdf_backend_t* backends[KDF_MAX_BACKENDS];
+        size_t count = kdf_list_backends(algorithm, backends, KDF_MAX_BACKENDS);
+        const char* previous = kdf_active_backend(algorithm)->name;
+        int was_forced = kdf_backend_is_forced(algorithm);
+
+        for (size_t b = 0; b < count; ++b) {
+            if (!kdf_backend_verified(backends[b])) {
+                printf("%-8s %-12s  (%s; skipped)\n",
+                       vba_algorithm_name(algorithm), backends[b]->name,
+                       kdf_backend_supported(backends[b]) ? "failed self-test" : "unsupported");
+                continue;
+            }
+
+            kdf_force_backend(algorithm, backends[b]->name);
+
+            for (int p = 0; p < BACKEND_COMPARE_POINTS; ++p) {
+                auto start = std::chrono::high_resolution_clock::now();
+
+                uint64_t result = compute_address_hash_suffix(global_voucher_seed,
+                                                              mac.octets,
+                                                              points[p],
+                                                              algorithm);
+
+                auto end = std::chrono::high_resolution_clock::now();
+                auto us = Timing::ConvertTimeToMicroseconds(start, end);
+
+                printf("%-8s %-12s '0x%04x'  %12lu us   Result: 0x%016lx\n",
+                       vba_algorithm_name(algorithm), backends[b]->name, points[p], us, result);
+
+                std::stringstream s;
+                s << vba_algorithm_name(algorithm) << "/" << backends[b]->name << " / Iterations " << points[p];
+                Timing::RecordTiming(slot++, start, end, s.str());
+            }
+        }
+
+        kdf_force_backend(algorithm, previous);
+        if (!was_forced) kdf_release_backend(algorithm);
+    }
+}
+
+
+/*
+ * Latency of one Argon2id derivation as the lane count grows, at a fixed memory
+ *   cost large enough that each lane has real work to do. Total work is the same
+ *   at every point; only how many threads share it changes. Note that the lane
+ *   count is a derivation input, so every point yields a different hash.
+ */
+void benchmark_argon2_lanes()
+{
+    vba_argon2_params_t saved = get_argon2_parameters();
+    MacAddress mac = MacAddress::FromU64(0x112233445566ULL);
+    uint64_t single_lane_us = 0;
+    int slot = 0;
+
+    printf("Argon2id, %u KiB, '0x%04x' iterations, %u hardware threads:\n",
+           LANES_MEMORY_KIB, LANES_ITERATIONS, std::thread::hardware_concurrency());
+
+    for (uint32_t lanes = 1; lanes <= LANES_MAX; lanes *= 2) {
+        set_argon2_parameters(LANES_MEMORY_KIB, lanes);
+
+        /* Warm the allocator and thread start-up once, then take the best of three. */
+        compute_address_hash_suffix(global_voucher_seed, mac.octets, LANES_ITERATIONS, ARGON2ID_LANES);
+
+        uint64_t best_us = UINT64_MAX;
+        std::chrono::high_resolution_clock::time_point best_start, best_end;
+        for (int run = 0; run < 3; ++run) {
+            auto start = std::chrono::high_resolution_clock::now();
+            compute_address_hash_suffix(global_voucher_seed, mac.octets, LANES_ITERATIONS, ARGON2ID_LANES);
+            auto end = std::chrono::high_resolution_clock::now();
+
+            uint64_t us = Timing::ConvertTimeToMicroseconds(start, end);
+            if (us < best_us) {
+                best_us = us;
+                best_start = start;
+                best_end = end;
+            }
+        }
+
+        if (1 == lanes) single_lane_us = best_us;
+
+        printf("\tLanes %2u: %12lu us   (speed-up x%.2f)\n",
+               lanes, best_us, best_us ? (double)single_lane_us / best_us : 0.0);
+
+        std::stringstream s;
+        s << "Argon2id lanes " << lanes << " / " << LANES_MEMORY_KIB << " KiB";
+        Timing::RecordTiming(slot++, best_start, best_end, s.str());
+    }
+
+    set_argon2_parameters(saved.memory_kib, saved.lanes);
+}
+
+
+/*
+ * A neighbour-table refresh: every cached neighbour re-verified at once, first with
+ *   'verify_address_suffix' in a loop and then as one 'verify_address_suffix_batch'.
+ *   The table mixes a few PBKDF2 iteration counts with some scrypt entries, and a
+ *   share of the suffixes are corrupted so both paths have failures to agree on.
+ */
+void benchmark_verify_batch()
+{
+    static const uint16_t pbkdf2_iters[3] = { 0x0004, 0x0010, 0x0040 };
+
+    std::vector<uint64_t> suffixes(BATCH_NEIGHBOURS);
+    std::vector<uint8_t> macs(BATCH_NEIGHBOURS * 6), seeds(BATCH_NEIGHBOURS * 16);
+    std::vector<VbaAlgorithm> algorithms(BATCH_NEIGHBOURS);
+
+    for (size_t i = 0; i < BATCH_NEIGHBOURS; ++i) {
+        MacAddress mac = MacAddress::FromU64(0x020000000000ULL | (Xoshiro128p__next_bounded_any() & 0xFFFFFFFFFFULL));
+        memcpy(&macs[i * 6], mac.octets, 6);
+
+        rotate_voucher_seed();
+        memcpy(&seeds[i * 16], global_voucher_seed, 16);
+
+        uint16_t iterations;
+        if (i % 8 == 7) {
+            algorithms[i] = SCRYPT;
+            iterations = 0x0002;
+        } else {
+            algorithms[i] = PBKDF2;
+            iterations = pbkdf2_iters[i % 3];
+        }
+
+        suffixes[i] = build_address_suffix(iterations,
+                                           compute_address_hash_suffix(&seeds[i * 16], &macs[i * 6],
+                                                                       iterations, algorithms[i]));
+        if ((Xoshiro128p__next_bounded_any() % 100) < BATCH_BOGUS_PCT)
+            suffixes[i] ^= 0x1;
+    }
+
+    bool sequential[BATCH_NEIGHBOURS], batched[BATCH_NEIGHBOURS];
+    size_t sequential_ok = 0;
+
+    auto seq_start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < BATCH_NEIGHBOURS; ++i) {
+        sequential[i] = verify_address_suffix(suffixes[i], &seeds[i * 16], &macs[i * 6], algorithms[i]);
+        sequential_ok += sequential[i] ? 1 : 0;
+    }
+    auto seq_end = std::chrono::high_resolution_clock::now();
+
+    auto batch_start = std::chrono::high_resolution_clock::now();
+    size_t batched_ok = verify_address_suffix_batch(BATCH_NEIGHBOURS, suffixes.data(), macs.data(),
+                                                    seeds.data(), algorithms.data(), batched);
+    auto batch_end = std::chrono::high_resolution_clock::now();
+
+    size_t disagreements = 0;
+    for (size_t i = 0; i < BATCH_NEIGHBOURS; ++i)
+        disagreements += sequential[i] != batched[i] ? 1 : 0;
+
+    uint64_t seq_us = Timing::ConvertTimeToMicroseconds(seq_start, seq_end);
+    uint64_t batch_us = Timing::ConvertTimeToMicroseconds(batch_start, batch_end);
+    const kdf_backend_t* batch_backend = kdf_active_batch_backend(PBKDF2);
+
+    printf("%d neighbours, %u hardware threads, PBKDF2 batch backend '%s':\n",
+           BATCH_NEIGHBOURS, std::thread::hardware_concurrency(),
+           batch_backend ? batch_backend->name : "(none)");
+    printf("\tSequential: %12lu us   %zu verified\n", seq_us, sequential_ok);
+    printf("\tBatched:    %12lu us   %zu verified   (speed-up x%.2f)\n",
+           batch_us, batched_ok, batch_us ? (double)seq_us / batch_us : 0.0);
+    if (disagreements)
+        printf("\tWARNING: %zu results differ between the two paths!\n", disagreements);
+
+    std::stringstream s_seq, s_batch;
+    s_seq << "Neighbour refresh sequential / " << BATCH_NEIGHBOURS << " addresses";
+    s_batch << "Neighbour refresh batched / " << BATCH_NEIGHBOURS << " addresses";
+    Timing::RecordTiming(0, seq_start, seq_end, s_seq.str());
+    Timing::RecordTiming(1, batch_start, batch_end, s_batch.str());
+}
+
+
+/*
+ * Calibrates every algorithm on this host (bypassing the cache, so the timing is
+ *   real) and shows what 'select_iterations' would choose for a 100 ms generation
+ *   budget against an attacker doing a billion one-iteration derivations a second
+ *   who must be kept busy for a year. Each prediction is then checked against one
+ *   real derivation at the chosen count.
+ */
+void benchmark_calibration()
+{
+    MacAddress mac = MacAddress::FromU64(0x112233445566ULL);
+    int slot = 0;
+
+    printf("Target %llu ms, attacker %.0e derivations/s, %.0f days:\n",
+           CALIBRATION_TARGET_NS / 1000000, CALIBRATION_ATTACKER_RATE, CALIBRATION_ATTACK_SECONDS / 86400);
+
+    for (int a = 1; a < VBA_ALGORITHM_SLOTS; ++a) {
+        VbaAlgorithm algorithm = (VbaAlgorithm)a;
+        vba_calibration_t calibration;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        if (0 != get_calibration(algorithm, &calibration, 1)) continue;
+        auto end = std::chrono::high_resolution_clock::now();
+
+        vba_iteration_choice_t choice = select_iterations(&calibration,
+                                                          CALIBRATION_TARGET_NS,
+                                                          CALIBRATION_ATTACKER_RATE,
+                                                          CALIBRATION_ATTACK_SECONDS);
+
+        printf("\t%-14s %-10s %12.1f ns/iter  %10.0f ns fixed   secure >= 0x%04x  affordable <= 0x%04x",
+               vba_algorithm_name(algorithm), calibration.backend, calibration.ns_per_iteration,
+               calibration.fixed_ns, choice.min_secure, choice.max_affordable);
+
+        if (choice.iterations) {
+            auto check_start = std::chrono::high_resolution_clock::now();
+            compute_address_hash_suffix(global_voucher_seed, mac.octets, choice.iterations, algorithm);
+            auto check_end = std::chrono::high_resolution_clock::now();
+
+            printf("  -> 0x%04x (predicted %lu us, measured %lu us)\n",
+                   choice.iterations, choice.predicted_ns / 1000,
+                   Timing::ConvertTimeToMicroseconds(check_start, check_end));
+        } else {
+            printf("  -> no count meets both limits\n");
+        }
+
+        std::stringstream s;
+        s << "Calibrate " << vba_algorithm_name(algorithm) << " / " << calibration.backend;
+        Timing::RecordTiming(slot++, start, end, s.str());
+    }
+}
+
+
+/*
+ * An audit log's worth of addresses written as text: the old eight-printf layout
+ *   (into a buffer, so stdout is not what gets measured), the bulk fixed and
+ *   RFC 5952 formatters, and parsing the canonical text back.
+ */
+void benchmark_lladdr_format()
+{
+    std::vector<uint64_t> suffixes(LLADDR_FORMAT_COUNT);
+    for (auto& suffix : suffixes)
+        suffix = Xoshiro128p__next_bounded_any();
+
+    std::vector<char> text((VBA_LLADDR_MAX_LENGTH + 1) * LLADDR_FORMAT_COUNT + 64);
+    uint64_t checksum = 0;
+
+    auto printf_start = std::chrono::high_resolution_clock::now();
+    size_t used = 0;
+    for (size_t n = 0; n < LLADDR_FORMAT_COUNT; ++n) {
+        used += snprintf(&text[used], text.size() - used, "fe80::");
+        for (int i = 1; i < 9; ++i)
+            used += snprintf(&text[used], text.size() - used, "%02x%s",
+                             (uint8_t)(0xFF & (suffixes[n] >> (64 - (i * 8)))),
+                             (i - 1) % 2 && i < 8 ? ":" : "");
+        text[used++] = '\n';
+    }
+    auto printf_end = std::chrono::high_resolution_clock::now();
+    checksum += used;
+
+    auto fixed_start = std::chrono::high_resolution_clock::now();
+    checksum += format_lladdrs_fixed(suffixes.data(), LLADDR_FORMAT_COUNT, text.data(), text.size());
+    auto fixed_end = std::chrono::high_resolution_clock::now();
+
+    auto canonical_start = std::chrono::high_resolution_clock::now();
+    used = format_lladdrs(suffixes.data(), LLADDR_FORMAT_COUNT, text.data(), text.size());
+    auto canonical_end = std::chrono::high_resolution_clock::now();
+    checksum += used;
+
+    size_t mismatches = 0;
+    auto parse_start = std::chrono::high_resolution_clock::now();
+    for (size_t n = 0, line = 0; n < LLADDR_FORMAT_COUNT; ++n) {
+        const char* end = (const char*)memchr(&text[line], '\n', used - line);
+        uint64_t parsed = 0;
+
+        if (0 != parse_lladdr(&text[line], end - &text[line], &parsed) || parsed != suffixes[n])
+            ++mismatches;
+        line = end - text.data() + 1;
+    }
+    auto parse_end = std::chrono::high_resolution_clock::now();
+
+    struct { const char* name; std::chrono::high_resolution_clock::time_point start, end; } rows[4] = {
+        { "printf", printf_start, printf_end },
+        { "fixed (bulk)", fixed_start, fixed_end },
+        { "RFC 5952 (bulk)", canonical_start, canonical_end },
+        { "parse", parse_start, parse_end },
+    };
+
+    printf("%d addresses (checksum %lu):\n", LLADDR_FORMAT_COUNT, checksum);
+    for (int r = 0; r < 4; ++r) {
+        uint64_t us = Timing::ConvertTimeToMicroseconds(rows[r].start, rows[r].end);
+        printf("\t%-16s %10lu us   %6.1f ns/address\n",
+               rows[r].name, us, us * 1000.0 / LLADDR_FORMAT_COUNT);
+
+        std::stringstream s;
+        s << "lladdr " << rows[r].name << " / " << LLADDR_FORMAT_COUNT << " addresses";
+        Timing::RecordTiming(r, rows[r].start, rows[r].end, s.str());
+    }
+    if (mismatches)
+        printf("\tWARNING: %zu addresses did not parse back to their suffix!\n", mismatches);
+}
+
+
+/*
+ * Repeated, warmed-up measurements of every algorithm at each fixed iteration count
+ *   up to STATS_MAX_ITERATIONS, with the median, its spread and a confidence
+ *   interval per point. Results are only printed once all sampling is done.
+ *   Configure with VBA_BENCH_WARMUP, VBA_BENCH_REPETITIONS, VBA_BENCH_CPU and
+ *   VBA_BENCH_CONFIDENCE.
+ */
+void benchmark_kdf_statistics()
+{
+    bench_runner_config_t config = bench_runner_default_config();
+    std::vector<bench_point_stats_t> points;
+
+    {
+        BenchmarkRunner runner(config);
+
+        for (int a = 1; a < VBA_ALGORITHM_SLOTS; ++a)
+            for (int i = 0; i < FIXED_ITERS_COUNT; ++i)
+                if (_fixed_iter[i] <= STATS_MAX_ITERATIONS)
+                    points.push_back(runner.Measure((VbaAlgorithm)a, _fixed_iter[i]));
+
+        printf("Warm-up %u, up to %u repetitions, %.0f%% CI, CPU %s, cycles from %s:\n",
+               config.warmup, config.repetitions, config.confidence * 100,
+               runner.Pinned() ? std::to_string(config.cpu).c_str() : "unpinned", runner.CycleSource());
+    }
+
+    BenchmarkRunner::PrintHeader();
+    for (size_t p = 0; p < points.size(); ++p) {
+        BenchmarkRunner::PrintPoint(points[p]);
+
+        std::stringstream s;
+        s << vba_algorithm_name(points[p].algorithm) << " / Iterations " << points[p].iterations
+          << " / median of " << points[p].samples
+          << " / MAD " << (uint64_t)(points[p].mad_ns / 1000) << " us"
+          << " / CI " << (uint64_t)(points[p].ci_low_ns / 1000) << "-" << (uint64_t)(points[p].ci_high_ns / 1000) << " us";
+        Timing::RecordTiming(p, (uint64_t)(points[p].median_ns / 1000), s.str());
+    }
+}
+
+
+/*
+ * Cost per recorded event: the string-building 'RecordTiming' path against interned
+ *   labels with per-thread event blocks, on one thread and on every hardware thread
+ *   at once. The recorded events are discarded afterwards.
+ */
+void benchmark_timing_overhead()
+{
+    const uint32_t label = Timing::Intern("timing.overhead");
+    unsigned int threads = std::thread::hardware_concurrency();
+    if (!threads) threads = 1;
+
+    auto legacy_start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < TIMING_OVERHEAD_LEGACY; ++i) {
+        auto now = std::chrono::high_resolution_clock::now();
+        std::stringstream s;
+        s << "Iterations " << i;
+        Timing::RecordTiming(i, now, now, s.str());
+    }
+    auto legacy_end = std::chrono::high_resolution_clock::now();
+
+    std::stringstream discard;
+    Timing::DumpToCsv("discard", discard);
+
+    auto single_start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < TIMING_OVERHEAD_EVENTS; ++i) {
+        uint64_t start = Timing::Now();
+        Timing::Record(label, start, Timing::Now(), i);
+    }
+    auto single_end = std::chrono::high_resolution_clock::now();
+
+    auto threaded_start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned int t = 0; t < threads; ++t)
+        pool.emplace_back([label]() {
+            for (int i = 0; i < TIMING_OVERHEAD_EVENTS; ++i) {
+                uint64_t start = Timing::Now();
+                Timing::Record(label, start, Timing::Now(), i);
+            }
+        });
+    for (auto& thread : pool)
+        thread.join();
+    auto threaded_end = std::chrono::high_resolution_clock::now();
+
+    size_t recorded = Timing::EventCount();
+    Timing::ClearEvents();
+
+    uint64_t legacy_us = Timing::ConvertTimeToMicroseconds(legacy_start, legacy_end);
+    uint64_t single_us = Timing::ConvertTimeToMicroseconds(single_start, single_end);
+    uint64_t threaded_us = Timing::ConvertTimeToMicroseconds(threaded_start, threaded_end);
+
+    printf("Clock: %s, %zu events recorded:\n", Timing::TicksToNanoseconds(1000) == 1000 ? "steady_clock" : "TSC", recorded);
+    printf("\tRecordTiming + stringstream   %8.1f ns/event\n", legacy_us * 1000.0 / TIMING_OVERHEAD_LEGACY);
+    printf("\tRecord, 1 thread              %8.1f ns/event\n", single_us * 1000.0 / TIMING_OVERHEAD_EVENTS);
+    printf("\tRecord, %2u threads            %8.1f ns/event/thread\n",
+           threads, threaded_us * 1000.0 / TIMING_OVERHEAD_EVENTS);
+
+    Timing::RecordTiming(0, legacy_us, "RecordTiming with stringstream / " + std::to_string(TIMING_OVERHEAD_LEGACY));
+    Timing::RecordTiming(1, single_us, "Record single thread / " + std::to_string(TIMING_OVERHEAD_EVENTS));
+    Timing::RecordTiming(2, threaded_us, "Record " + std::to_string(threads) + " threads / "
+                                         + std::to_string(TIMING_OVERHEAD_EVENTS) + " each");
+}
+
 
 static inline void
 _benchmark_algo(VbaAlgorithm algorithm)
@@ -5,6 +5,20 @@
 void benchmark_pbkdf2();
 void benchmark_argon2();
 void benchmark_scrypt();
+void benchmark_argon2id();
+
+void benchmark_verify_cache();
+void benchmark_async_verify();
+void benchmark_async_reserved();
+void benchmark_verify_policy();
+void benchmark_kdf_input();
+void benchmark_kdf_backends();
+void benchmark_argon2_lanes();
+void benchmark_verify_batch();
+void benchmark_calibration();
+void benchmark_lladdr_format();
+void benchmark_kdf_statistics();
+void benchmark_timing_overhead();
 
 
 #endif /* _BENCHMARKING_H_ */
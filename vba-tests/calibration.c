@@ -0,0 +1,240 @@
+#include <chrono>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "calibration.h"
+#include "kdf_backends.h"
+
+
+#define _CALIBRATION_MAX_POINTS  17
+
+
+static uint64_t _time_derivation(enum VbaAlgorithm algorithm, uint16_t iterations)
+{
+    uint8_t seed[16] = {0};
+    uint8_t mac[6] = { 0x02, 0x00, 0x5e, 0x10, 0x00, 0x01 };
+    uint64_t fastest = UINT64_MAX;
+
+    /* Best of three; the first call also pays for any lazy set-up. */
+    for (int run = 0; run < 3; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        compute_address_hash_suffix(seed, mac, iterations, algorithm);
+        auto end = std::chrono::steady_clock::now();
+
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        if (ns < fastest) fastest = ns;
+    }
+
+    return fastest;
+}
+
+static void _stamp(vba_calibration_t *calibration, enum VbaAlgorithm algorithm)
+{
+    const kdf_backend_t *backend = kdf_active_backend(algorithm);
+    vba_argon2_params_t params = get_argon2_parameters();
+
+    calibration->algorithm = algorithm;
+    snprintf(calibration->backend, sizeof(calibration->backend), "%s", backend ? backend->name : "none");
+    calibration->argon2_memory_kib = params.memory_kib;
+    calibration->argon2_lanes = params.lanes;
+}
+
+int calibrate_algorithm(enum VbaAlgorithm algorithm, vba_calibration_t *out)
+{
+    if (!kdf_active_backend(algorithm)) return -1;
+
+    double xs[_CALIBRATION_MAX_POINTS], ys[_CALIBRATION_MAX_POINTS];
+    int points = 0;
+
+    /* Double the count until a single call is long enough to dwarf timer noise. */
+    for (uint32_t iterations = 1; points < _CALIBRATION_MAX_POINTS; iterations *= 2) {
+        if (iterations > CALIBRATION_MAX_ITERATIONS) iterations = CALIBRATION_MAX_ITERATIONS;
+
+        uint64_t ns = _time_derivation(algorithm, (uint16_t)iterations);
+        xs[points] = iterations;
+        ys[points] = (double)ns;
+        ++points;
+
+        if (ns >= CALIBRATION_SAMPLE_NS || CALIBRATION_MAX_ITERATIONS == iterations) break;
+    }
+
+    /* Least squares over all points; a single point is all slope. */
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (int i = 0; i < points; ++i) {
+        sx += xs[i]; sy += ys[i];
+        sxx += xs[i] * xs[i]; sxy += xs[i] * ys[i];
+    }
+
+    double denominator = points * sxx - sx * sx;
+    double slope = denominator > 0 ? (points * sxy - sx * sy) / denominator : ys[0] / xs[0];
+    double intercept = (sy - slope * sx) / points;
+
+    if (slope <= 0) {
+        slope = ys[points - 1] / xs[points - 1];
+        intercept = 0;
+    }
+
+    memset(out, 0, sizeof(*out));
+    _stamp(out, algorithm);
+    out->ns_per_iteration = slope;
+    out->fixed_ns = intercept > 0 ? intercept : 0;
+
+    return 0;
+}
+
+
+static void _cache_path(char *path, size_t size)
+{
+    const char *configured = getenv(CALIBRATION_CACHE_ENV);
+    if (configured && *configured) {
+        snprintf(path, size, "%s", configured);
+        return;
+    }
+
+    char host[64] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+
+    const char *home = getenv("HOME");
+    snprintf(path, size, "%s/.cache/vba-calibration-%s", home && *home ? home : "/tmp", host);
+}
+
+/* One line per algorithm: name backend memory_kib lanes ns_per_iteration fixed_ns. */
+static int _cache_read(enum VbaAlgorithm algorithm, vba_calibration_t *out)
+{
+    char path[512], line[256];
+    _cache_path(path, sizeof(path));
+
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+
+    vba_calibration_t current;
+    memset(&current, 0, sizeof(current));
+    _stamp(&current, algorithm);
+
+    int found = -1;
+    while (fgets(line, sizeof(line), file)) {
+        char name[32], backend[32];
+        vba_calibration_t entry;
+        memset(&entry, 0, sizeof(entry));
+
+        if (6 != sscanf(line, "%31s %31s %u %u %lf %lf", name, backend,
+                        &entry.argon2_memory_kib, &entry.argon2_lanes,
+                        &entry.ns_per_iteration, &entry.fixed_ns))
+            continue;
+
+        if (vba_algorithm_from_name(name) != algorithm || 0 != strcmp(backend, current.backend))
+            continue;
+
+        /* Argon2 cost depends on its parameters; other algorithms ignore them. */
+        if ((current.argon2_memory_kib != entry.argon2_memory_kib || current.argon2_lanes != entry.argon2_lanes)
+            && current.algorithm != PBKDF2 && current.algorithm != SCRYPT)
+            continue;
+
+        *out = current;
+        out->ns_per_iteration = entry.ns_per_iteration;
+        out->fixed_ns = entry.fixed_ns;
+        found = 0;
+    }
+
+    fclose(file);
+    return found;
+}
+
+/* Rewrites the cache, replacing any line for the same algorithm. */
+static void _cache_write(const vba_calibration_t *calibration)
+{
+    char path[512], tmp_path[520], line[256];
+    _cache_path(path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.new", path);
+
+    /* A fresh host may not have ~/.cache yet. */
+    char *slash = strrchr(path, '/');
+    if (slash && slash != path) {
+        *slash = '\0';
+        if (0 != mkdir(path, 0755) && EEXIST != errno)
+            fprintf(stderr, "Cannot create '%s': %s\n", path, strerror(errno));
+        *slash = '/';
+    }
+
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) {
+        fprintf(stderr, "Cannot write calibration cache '%s': %s\n", path, strerror(errno));
+        return;
+    }
+
+    FILE *in = fopen(path, "r");
+    if (in) {
+        while (fgets(line, sizeof(line), in)) {
+            char name[32];
+            if (1 == sscanf(line, "%31s", name) && vba_algorithm_from_name(name) == calibration->algorithm)
+                continue;
+            fputs(line, out);
+        }
+        fclose(in);
+    }
+
+    fprintf(out, "%s %s %u %u %.6f %.1f\n",
+            vba_algorithm_name(calibration->algorithm), calibration->backend,
+            calibration->argon2_memory_kib, calibration->argon2_lanes,
+            calibration->ns_per_iteration, calibration->fixed_ns);
+
+    if (0 != fclose(out) || 0 != rename(tmp_path, path)) {
+        unlink(tmp_path);
+        fprintf(stderr, "Cannot write calibration cache '%s'.\n", path);
+    }
+}
+
+int get_calibration(enum VbaAlgorithm algorithm, vba_calibration_t *out, int force_recalibrate)
+{
+    if (!force_recalibrate && 0 == _cache_read(algorithm, out)) return 0;
+
+    if (0 != calibrate_algorithm(algorithm, out)) return -1;
+
+    _cache_write(out);
+    return 0;
+}
+
+
+uint64_t calibration_predict_ns(const vba_calibration_t *calibration, uint16_t iterations)
+{
+    return (uint64_t)(calibration->fixed_ns + calibration->ns_per_iteration * iterations);
+}
+
+vba_iteration_choice_t select_iterations(const vba_calibration_t *calibration,
+                                         uint64_t target_latency_ns,
+                                         double attacker_derivations_per_second,
+                                         double required_attack_seconds)
+{
+    vba_iteration_choice_t choice;
+    memset(&choice, 0, sizeof(choice));
+
+    /* Largest count whose predicted latency fits the target. */
+    double affordable = calibration->ns_per_iteration > 0
+        ? floor((target_latency_ns - calibration->fixed_ns) / calibration->ns_per_iteration) : 0;
+    if (affordable > CALIBRATION_MAX_ITERATIONS) affordable = CALIBRATION_MAX_ITERATIONS;
+    choice.max_affordable = affordable >= 1 ? (uint16_t)affordable : 0;
+
+    /*
+     * The attacker's cost per candidate MAC scales with iterations just as ours does,
+     *   so their rate at 'n' iterations is their one-iteration rate over 'n'.
+     */
+    double secure = attacker_derivations_per_second > 0
+        ? ceil(required_attack_seconds * attacker_derivations_per_second / CALIBRATION_ATTACK_WORK) : 1;
+    if (secure < 1) secure = 1;
+    choice.min_secure = secure <= CALIBRATION_MAX_ITERATIONS ? (uint16_t)secure : 0;
+
+    if (choice.max_affordable && choice.min_secure && choice.min_secure <= choice.max_affordable)
+        choice.iterations = choice.max_affordable;
+
+    uint16_t reported = choice.iterations ? choice.iterations : choice.max_affordable;
+    choice.predicted_ns = calibration_predict_ns(calibration, reported);
+    choice.attack_seconds = attacker_derivations_per_second > 0
+        ? CALIBRATION_ATTACK_WORK * reported / attacker_derivations_per_second : INFINITY;
+
+    return choice;
+}
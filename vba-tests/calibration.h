@@ -0,0 +1,71 @@
+#ifndef _CALIBRATION_H_
+#define _CALIBRATION_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "vba.h"
+
+
+#define CALIBRATION_CACHE_ENV       "VBA_CALIBRATION_CACHE"
+#define CALIBRATION_SAMPLE_NS       (25ULL * 1000 * 1000)   /* Stop ramping once one call takes this long. */
+#define CALIBRATION_MAX_ITERATIONS  0xFFFE
+
+/* Expected derivations for an attacker to hit one given 48-bit suffix: half the space. */
+#define CALIBRATION_ATTACK_WORK     ((double)(1ULL << 47))
+
+
+/*
+ * Measured cost of 'compute_address_hash_suffix' for one algorithm on this host,
+ *   as a straight line: fixed_ns + iterations * ns_per_iteration. The backend name
+ *   and Argon2 parameters it was measured with are kept so a stale cache entry
+ *   is never used after either changes.
+ */
+typedef struct _vba_calibration {
+    enum VbaAlgorithm algorithm;
+    double ns_per_iteration;
+    double fixed_ns;
+    char backend[32];
+    uint32_t argon2_memory_kib;
+    uint32_t argon2_lanes;
+} vba_calibration_t;
+
+typedef struct _vba_iteration_choice {
+    /* What to pass to 'build_address_suffix'; 0 if no count meets both limits. */
+    uint16_t iterations;
+    /* Fewest iterations that keep the attacker busy for the required time. */
+    uint16_t min_secure;
+    /* Most iterations that stay within the generation latency target. */
+    uint16_t max_affordable;
+    uint64_t predicted_ns;
+    double attack_seconds;
+} vba_iteration_choice_t;
+
+
+/* Times the active backend over doubling iteration counts and fits a line. Returns 0 on success. */
+int calibrate_algorithm(enum VbaAlgorithm algorithm, vba_calibration_t *out);
+
+/*
+ * Like 'calibrate_algorithm', but reuses this host's cached result when it still
+ *   matches the active backend. The cache lives at '$VBA_CALIBRATION_CACHE', else
+ *   '$HOME/.cache/vba-calibration-<hostname>'.
+ */
+int get_calibration(enum VbaAlgorithm algorithm, vba_calibration_t *out, int force_recalibrate);
+
+uint64_t calibration_predict_ns(const vba_calibration_t *calibration, uint16_t iterations);
+
+/*
+ * Picks the iteration count to encode for a node on this host. 'target_latency_ns'
+ *   caps how long generating (and so verifying) one address may take here.
+ *   'attacker_derivations_per_second' is the attacker's rate at one iteration,
+ *   and 'required_attack_seconds' how long a collision search must take them.
+ *   The largest affordable count is chosen, since it can only make attacks slower.
+ */
+vba_iteration_choice_t select_iterations(const vba_calibration_t *calibration,
+                                         uint64_t target_latency_ns,
+                                         double attacker_derivations_per_second,
+                                         double required_attack_seconds);
+
+
+#endif /* _CALIBRATION_H_ */
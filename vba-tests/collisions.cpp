@@ -4,7 +4,9 @@
 #include "collisions.hpp"
 
 #include "vba.h"
+#include "vba_types.hpp"
 #include "generator.h"
+#include "derivation_store.h"
 #include "timing.hpp"
 
 
@@ -13,24 +15,11 @@ extern uint16_t _fixed_iter_step;
 
 static inline void _find_collisions(VbaAlgorithm, bool);
 
-static inline void _roll_mac_address(uint8_t* mac_address, uint64_t rand)
-{
-    /* Generate and use any random MAC address. Unrolled for speed. */
-    rand = UINT64_MAX == rand ? Xoshiro128p__next_bounded_any() : rand;
-
-    mac_address[0] = *(((uint8_t *)&rand) + 0);
-    mac_address[1] = *(((uint8_t *)&rand) + 1);
-    mac_address[2] = *(((uint8_t *)&rand) + 2);
-    mac_address[3] = *(((uint8_t *)&rand) + 3);
-    mac_address[4] = *(((uint8_t *)&rand) + 4);
-    mac_address[5] = *(((uint8_t *)&rand) + 5);
-}
-
-static uint8_t _stable_mac_address[6] = {
-    0xC0, 0x01, 0xCA, 0x70, 0xFF, 0xFF
-};
-static uint8_t _stable_voucher_seed[8] = {
-    0xDE, 0xAD, 0xBE, 0xEF, 0xCA, 0xFE, 0xF0, 0x0D
+static constexpr MacAddress _stable_mac_address = MacAddress::FromU64(0xC001CA70FFFFULL);
+/* Seeds are 16 bytes; the tail is spelled out rather than read from whatever follows. */
+static uint8_t _stable_voucher_seed[16] = {
+    0xDE, 0xAD, 0xBE, 0xEF, 0xCA, 0xFE, 0xF0, 0x0D,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
 
 
@@ -66,6 +55,26 @@ void find_collisions_scrypt()
 }
 
 
+/* Checked every this many attempts; a printf per attempt cost more than cheap derivations. */
+#define PROGRESS_CHECK_MASK  0xFF
+#define PROGRESS_EVERY       std::chrono::seconds(1)
+
+static void _report_progress(uint64_t done,
+                             uint64_t total,
+                             std::chrono::high_resolution_clock::time_point start,
+                             std::chrono::high_resolution_clock::time_point* next_report)
+{
+    auto now = std::chrono::high_resolution_clock::now();
+    if (now < *next_report) return;
+    *next_report = now + PROGRESS_EVERY;
+
+    double seconds = std::chrono::duration<double>(now - start).count();
+    double rate = seconds > 0 ? done / seconds : 0;
+
+    printf("\r\t\t%lu of %lu, %.0f MACs/s, ETA %.0f s   ", done, total, rate, rate > 0 ? (total - done) / rate : 0.0);
+    fflush(stdout);
+}
+
 /*
  * This is it. Attack the protocol and see how long it takes to find a collision.
  *   Since iteration counts are fixed into a node's address, that value must
@@ -85,21 +94,21 @@ void find_collisions_scrypt()
 static inline void
 _find_collisions(VbaAlgorithm algorithm, bool check_collisions)
 {
-    uint8_t fake_mac[6] = {0};
+    MacAddress fake_mac = {};
+    vba_salt_template_t salt;
+    init_salt_template(&salt, NULL);
 
     for (int i = 0, j = 0; i < FIXED_ITERS_COUNT; ++i, j += 2) {
         uint16_t iterations = _fixed_iter[i];
 
         printf("Computing address for '0x%04x' (%d) iterations.\n", iterations, iterations);
 
-        uint64_t legitimate_hash =
-            compute_address_hash_suffix(_stable_voucher_seed,
-                                        _stable_mac_address,
-                                        iterations,
-                                        algorithm);
-
-        uint64_t legitimate_suffix = build_address_suffix(iterations,
-                                                          legitimate_hash);
+        /* The target never changes between runs, so it is only ever derived once per store. */
+        uint64_t legitimate_suffix = derivation_store_get_suffix(derivation_store_default(),
+                                                                 _stable_voucher_seed,
+                                                                 _stable_mac_address.octets,
+                                                                 iterations,
+                                                                 algorithm);
         
         printf("\tGot address: ");
         print_lladdr_from_suffix(legitimate_suffix);
@@ -109,38 +118,36 @@ _find_collisions(VbaAlgorithm algorithm, bool check_collisions)
         printf("\n\tNow searching for a collision...\n\t\tRandom... \n");
 
         auto start_random = std::chrono::high_resolution_clock::now();
+        auto next_report = start_random + PROGRESS_EVERY;
 
         uint64_t fake_suffix = 0x0;
         uint64_t loop_breaker = 1ULL << 24;
         do {
-            _roll_mac_address(fake_mac, UINT64_MAX);
-
-            uint64_t fake_hash =
-                compute_address_hash_suffix(_stable_voucher_seed,
-                                            fake_mac,
-                                            iterations,
-                                            algorithm);
+            fake_mac = MacAddress::FromU64(Xoshiro128p__next_bounded_any());
 
-            fake_suffix = build_address_suffix(iterations, fake_hash);
+            fake_suffix = derive_address_suffix(_stable_voucher_seed,
+                                                &salt,
+                                                fake_mac,
+                                                iterations,
+                                                algorithm).value;
 
-            printf("\rattempt '%lu'; trying MAC ", loop_breaker);
-            for (int x = 0; x < 6; ++x)
-                printf("%02x%s", fake_mac[x], x != 5 ? "-" : "");
-            fflush(stdout);
+            if (!(loop_breaker & PROGRESS_CHECK_MASK))
+                _report_progress((1ULL << 24) - loop_breaker, 1ULL << 24, start_random, &next_report);
         } while (--loop_breaker && fake_suffix != legitimate_suffix);
 
         auto end_random = std::chrono::high_resolution_clock::now();
         
         if (!loop_breaker) {
-            printf("FAILURE: Loop broken; no matches");
+            printf("\n\t\tFAILURE: Loop broken; no matches");
         } else {
-            printf("SUCCESS: Impostor MAC is ");
+            printf("\n\t\tSUCCESS: Impostor MAC is ");
             for (int x = 0; x < 6; ++x)
-                printf("%02x%s", fake_mac[x], x != 5 ? "-" : "");
+                printf("%02x%s", fake_mac.octets[x], x != 5 ? "-" : "");
         }
 
         printf("\n\t\tOrdered... \n");
         auto start_ordered = std::chrono::high_resolution_clock::now();
+        next_report = start_ordered + PROGRESS_EVERY;
 
         fake_suffix = 0x0;
         uint64_t mac = 0x1;
@@ -157,30 +164,26 @@ _find_collisions(VbaAlgorithm algorithm, bool check_collisions)
             /* Reserved IPv6 multicast range: 33-33-00 through 33-33-FF. */
             if (0x0000333300000000 == mac) mac += 0x0000000100000000;
 
-            _roll_mac_address(fake_mac, mac);
-
-            uint64_t fake_hash =
-                compute_address_hash_suffix(_stable_voucher_seed,
-                                            fake_mac,
-                                            iterations,
-                                            algorithm);
+            fake_mac = MacAddress::FromU64(mac);
 
-            fake_suffix = build_address_suffix(iterations, fake_hash);
+            fake_suffix = derive_address_suffix(_stable_voucher_seed,
+                                                &salt,
+                                                fake_mac,
+                                                iterations,
+                                                algorithm).value;
 
-            printf("\rtrying MAC ");
-            for (int x = 0; x < 6; ++x)
-                printf("%02x%s", fake_mac[x], x != 5 ? "-" : "");
-            fflush(stdout);
+            if (!(mac & PROGRESS_CHECK_MASK))
+                _report_progress(mac, 0x0000FFFFFFFFFFFF, start_ordered, &next_report);
         } while (++mac < 0x0000FFFFFFFFFFFF && fake_suffix != legitimate_suffix);
 
         auto end_ordered = std::chrono::high_resolution_clock::now();
 
         if (mac >= 0x0000FFFFFFFFFFFF) {
-            printf("FAILURE: Maximum MACs exhausted; no matches");
+            printf("\n\t\tFAILURE: Maximum MACs exhausted; no matches");
         } else {
-            printf("SUCCESS: Impostor MAC is ");
+            printf("\n\t\tSUCCESS: Impostor MAC is ");
             for (int x = 0; x < 6; ++x)
-                printf("%02x%s", fake_mac[x], x != 5 ? "-" : "");
+                printf("%02x%s", fake_mac.octets[x], x != 5 ? "-" : "");
         }
 
         printf("\n\n");
@@ -0,0 +1,423 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "derivation_store.h"
+#include "kdf_backends.h"
+
+
+#define _STORE_MAGIC    0x524F545344414256ULL   /* "VBADSTOR" */
+#define _STORE_VERSION  1
+
+typedef struct _store_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t capacity;   /* Always a power of two. */
+    uint64_t count;
+} store_header_t;
+
+typedef struct _store_slot {
+    uint8_t voucher_seed[16];
+    uint8_t mac_address[6];
+    uint16_t iterations;
+    uint32_t parameters;   /* Argon2 memory/lanes fingerprint; 0 for other algorithms. */
+    uint8_t algorithm;
+    uint8_t used;
+    uint8_t reserved[2];
+    uint64_t suffix;
+} store_slot_t;
+
+struct _derivation_store {
+    pthread_mutex_t lock;
+    char *path;
+    int fd;
+    size_t mapped_size;
+    store_header_t *header;
+    store_slot_t *slots;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+
+static inline size_t _file_size(uint64_t capacity)
+{
+    return sizeof(store_header_t) + capacity * sizeof(store_slot_t);
+}
+
+static inline uint32_t _parameters_for(enum VbaAlgorithm algorithm)
+{
+    switch (algorithm) {
+        case ARGON2:
+        case ARGON2ID:
+        case ARGON2D_LANES:
+        case ARGON2ID_LANES: {
+            vba_argon2_params_t params = get_argon2_parameters();
+            return (params.memory_kib & 0x00FFFFFF) | (params.lanes << 24);
+        }
+        default:
+            return 0;
+    }
+}
+
+static inline void _make_key(store_slot_t *key,
+                             enum VbaAlgorithm algorithm,
+                             const uint8_t *voucher_seed,
+                             const uint8_t *mac_address,
+                             uint16_t iterations)
+{
+    memset(key, 0, sizeof(*key));
+    memcpy(key->voucher_seed, voucher_seed, 16);
+    memcpy(key->mac_address, mac_address, 6);
+    key->iterations = iterations;
+    key->parameters = _parameters_for(algorithm);
+    key->algorithm = (uint8_t)algorithm;
+}
+
+/* Everything before 'used' is the key. */
+#define _KEY_BYTES  offsetof(store_slot_t, used)
+
+static inline uint64_t _hash_key(const store_slot_t *key)
+{
+    /* FNV-1a, then a splitmix finalizer so the low bits are usable for the mask. */
+    const uint8_t *p = (const uint8_t *)key;
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < _KEY_BYTES; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+/* The key's slot, or the empty slot where it would go. */
+static store_slot_t *_probe(store_slot_t *slots, uint64_t capacity, const store_slot_t *key)
+{
+    uint64_t mask = capacity - 1;
+
+    for (uint64_t i = _hash_key(key) & mask; ; i = (i + 1) & mask) {
+        if (!slots[i].used || 0 == memcmp(&slots[i], key, _KEY_BYTES))
+            return &slots[i];
+    }
+}
+
+
+static int _map(derivation_store_t *store, int fd, size_t size)
+{
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == base) return -1;
+
+    store->fd = fd;
+    store->mapped_size = size;
+    store->header = (store_header_t *)base;
+    store->slots = (store_slot_t *)((uint8_t *)base + sizeof(store_header_t));
+    return 0;
+}
+
+static void _unmap(derivation_store_t *store)
+{
+    if (store->header) {
+        msync(store->header, store->mapped_size, MS_SYNC);
+        munmap(store->header, store->mapped_size);
+    }
+    if (store->fd >= 0) close(store->fd);
+
+    store->header = NULL;
+    store->slots = NULL;
+    store->fd = -1;
+}
+
+/* Creates an empty table file; fresh files read back as zeroes, i.e. all slots unused. */
+static int _create(const char *path, uint64_t capacity)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+
+    store_header_t header = { _STORE_MAGIC, _STORE_VERSION, sizeof(store_slot_t), capacity, 0 };
+
+    if (0 != ftruncate(fd, (off_t)_file_size(capacity))
+        || sizeof(header) != pwrite(fd, &header, sizeof(header), 0)) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Never more than three quarters full, so every probe sequence reaches an empty slot. */
+static inline int _within_load(uint64_t count, uint64_t capacity)
+{
+    return count <= capacity / 4 * 3;
+}
+
+static int _valid_header(const store_header_t *header, size_t file_size)
+{
+    return _STORE_MAGIC == header->magic
+        && _STORE_VERSION == header->version
+        && sizeof(store_slot_t) == header->slot_size
+        && header->capacity >= 4 && !(header->capacity & (header->capacity - 1))
+        && _file_size(header->capacity) == file_size
+        && _within_load(header->count, header->capacity);
+}
+
+/*
+ * The header's count cannot be trusted on its own: the slots decide how long probes
+ *   run. Recounts them, which also repairs a count torn off by a crash mid-insert.
+ */
+static int _valid_slots(derivation_store_t *store)
+{
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < store->header->capacity; ++i)
+        used += store->slots[i].used ? 1 : 0;
+
+    if (!_within_load(used, store->header->capacity)) return 0;
+
+    store->header->count = used;
+    return 1;
+}
+
+/* Rehashes into a table twice the size, written beside the old file and renamed over it. */
+static int _grow(derivation_store_t *store)
+{
+    uint64_t capacity = store->header->capacity * 2;
+
+    size_t tmp_len = strlen(store->path) + 5;
+    char *tmp_path = (char *)malloc(tmp_len);
+    if (!tmp_path) return -1;
+    snprintf(tmp_path, tmp_len, "%s.new", store->path);
+
+    int fd = _create(tmp_path, capacity);
+    if (fd < 0) {
+        free(tmp_path);
+        return -1;
+    }
+
+    derivation_store_t grown;
+    memset(&grown, 0, sizeof(grown));
+    grown.fd = -1;
+
+    if (0 != _map(&grown, fd, _file_size(capacity))) {
+        close(fd);
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+
+    for (uint64_t i = 0; i < store->header->capacity; ++i) {
+        if (!store->slots[i].used) continue;
+
+        *_probe(grown.slots, capacity, &store->slots[i]) = store->slots[i];
+        ++grown.header->count;
+    }
+
+    msync(grown.header, grown.mapped_size, MS_SYNC);
+
+    if (0 != rename(tmp_path, store->path)) {
+        _unmap(&grown);
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+    free(tmp_path);
+
+    _unmap(store);
+    store->fd = grown.fd;
+    store->mapped_size = grown.mapped_size;
+    store->header = grown.header;
+    store->slots = grown.slots;
+
+    return 0;
+}
+
+
+derivation_store_t *derivation_store_open(const char *path, size_t initial_capacity)
+{
+    uint64_t capacity = DERIVATION_STORE_MIN_CAPACITY;
+    while (capacity < initial_capacity) capacity <<= 1;
+
+    derivation_store_t *store = (derivation_store_t *)calloc(1, sizeof(derivation_store_t));
+    if (!store) return NULL;
+
+    store->fd = -1;
+    store->path = strdup(path);
+    pthread_mutex_init(&store->lock, NULL);
+
+    int fd = open(path, O_RDWR);
+    struct stat st;
+
+    if (fd >= 0 && 0 == fstat(fd, &st) && (size_t)st.st_size >= sizeof(store_header_t)
+        && 0 == _map(store, fd, (size_t)st.st_size)) {
+        if (_valid_header(store->header, (size_t)st.st_size) && _valid_slots(store))
+            return store;
+
+        /* Unknown layout or a torn write: start over rather than trust it. */
+        fprintf(stderr, "Derivation store '%s' is not usable; recreating it.\n", path);
+        _unmap(store);
+        fd = -1;
+    } else if (fd >= 0) {
+        close(fd);
+    }
+
+    fd = _create(path, capacity);
+    if (fd < 0 || 0 != _map(store, fd, _file_size(capacity))) {
+        if (fd >= 0) close(fd);
+        derivation_store_close(store);
+        return NULL;
+    }
+
+    return store;
+}
+
+void derivation_store_close(derivation_store_t *store)
+{
+    if (!store) return;
+
+    _unmap(store);
+    pthread_mutex_destroy(&store->lock);
+    free(store->path);
+    free(store);
+}
+
+
+static derivation_store_t *_default_store = NULL;
+static pthread_once_t _default_store_once = PTHREAD_ONCE_INIT;
+
+static void _close_default_store(void)
+{
+    derivation_store_close(_default_store);
+    _default_store = NULL;
+}
+
+static void _open_default_store(void)
+{
+    const char *path = getenv(DERIVATION_STORE_ENV);
+    if (!path) path = DERIVATION_STORE_DEFAULT_PATH;
+    if (!*path) return;
+
+    _default_store = derivation_store_open(path, DERIVATION_STORE_MIN_CAPACITY);
+    if (_default_store)
+        atexit(_close_default_store);
+    else
+        fprintf(stderr, "Cannot open derivation store '%s'; deriving everything.\n", path);
+}
+
+derivation_store_t *derivation_store_default()
+{
+    pthread_once(&_default_store_once, _open_default_store);
+    return _default_store;
+}
+
+
+int derivation_store_lookup(derivation_store_t *store,
+                            enum VbaAlgorithm algorithm,
+                            const uint8_t *voucher_seed,
+                            const uint8_t *mac_address,
+                            uint16_t iterations,
+                            uint64_t *suffix)
+{
+    store_slot_t key;
+    _make_key(&key, algorithm, voucher_seed, mac_address, iterations);
+
+    pthread_mutex_lock(&store->lock);
+
+    store_slot_t *slot = _probe(store->slots, store->header->capacity, &key);
+    int hit = slot->used;
+
+    if (hit) {
+        *suffix = slot->suffix;
+        ++store->hits;
+    } else {
+        ++store->misses;
+    }
+
+    pthread_mutex_unlock(&store->lock);
+    return hit;
+}
+
+int derivation_store_insert(derivation_store_t *store,
+                            enum VbaAlgorithm algorithm,
+                            const uint8_t *voucher_seed,
+                            const uint8_t *mac_address,
+                            uint16_t iterations,
+                            uint64_t suffix)
+{
+    store_slot_t key;
+    _make_key(&key, algorithm, voucher_seed, mac_address, iterations);
+
+    pthread_mutex_lock(&store->lock);
+
+    /* Keep at least a quarter of the slots free so probe sequences stay short. */
+    if (!_within_load(store->header->count + 1, store->header->capacity) && 0 != _grow(store)) {
+        pthread_mutex_unlock(&store->lock);
+        return -1;
+    }
+
+    store_slot_t *slot = _probe(store->slots, store->header->capacity, &key);
+    if (!slot->used) {
+        memcpy(slot, &key, _KEY_BYTES);
+        slot->suffix = suffix;
+        __atomic_store_n(&slot->used, 1, __ATOMIC_RELEASE);   /* Mark used only once the suffix is in. */
+        ++store->header->count;
+    } else {
+        slot->suffix = suffix;
+    }
+
+    pthread_mutex_unlock(&store->lock);
+    return 0;
+}
+
+uint64_t derivation_store_get_suffix(derivation_store_t *store,
+                                     const uint8_t *voucher_seed,
+                                     const uint8_t *mac_address,
+                                     uint16_t iterations,
+                                     enum VbaAlgorithm algorithm)
+{
+    uint64_t suffix;
+
+    if (store && derivation_store_lookup(store, algorithm, voucher_seed, mac_address, iterations, &suffix))
+        return suffix;
+
+    vba_salt_template_t salt;
+    init_salt_template(&salt, NULL);
+    memcpy(&salt.bytes[0], mac_address, 6);
+
+    /* A failed derivation (say Argon2 out of memory) must not become a lasting target. */
+    uint8_t hash[32] = {0};
+    int status = kdf_derive(algorithm, voucher_seed, salt.bytes, VBA_SALT_LENGTH, iterations, hash, sizeof(hash));
+
+    suffix = build_address_suffix(iterations, *((uint64_t *)&hash[0]));
+
+    if (store && 0 == status) derivation_store_insert(store, algorithm, voucher_seed, mac_address, iterations, suffix);
+
+    return suffix;
+}
+
+void derivation_store_stats(derivation_store_t *store,
+                            uint64_t *entries, uint64_t *hits, uint64_t *misses)
+{
+    if (entries) *entries = 0;
+    if (hits) *hits = 0;
+    if (misses) *misses = 0;
+    if (!store) return;
+
+    pthread_mutex_lock(&store->lock);
+    if (entries) *entries = store->header->count;
+    if (hits) *hits = store->hits;
+    if (misses) *misses = store->misses;
+    pthread_mutex_unlock(&store->lock);
+}
+
+void derivation_store_sync(derivation_store_t *store)
+{
+    pthread_mutex_lock(&store->lock);
+    msync(store->header, store->mapped_size, MS_ASYNC);
+    pthread_mutex_unlock(&store->lock);
+}
@@ -4,6 +4,7 @@
 #include "generate_verify.hpp"
 
 #include "vba.h"
+#include "vba_types.hpp"
 #include "generator.h"
 #include "timing.hpp"
 
@@ -14,19 +15,6 @@ extern uint16_t _fixed_iter_step;
 
 static inline void _generate_and_verify(VbaAlgorithm);
 
-static inline void _roll_mac_address(uint8_t* mac_address, uint64_t rand)
-{
-    /* Generate and use any random MAC address. Unrolled for speed. */
-    rand = UINT64_MAX == rand ? Xoshiro128p__next_bounded_any() : rand;
-
-    mac_address[0] = *(((uint8_t *)&rand) + 0);
-    mac_address[1] = *(((uint8_t *)&rand) + 1);
-    mac_address[2] = *(((uint8_t *)&rand) + 2);
-    mac_address[3] = *(((uint8_t *)&rand) + 3);
-    mac_address[4] = *(((uint8_t *)&rand) + 4);
-    mac_address[5] = *(((uint8_t *)&rand) + 5);
-}
-
 
 void generate_and_verify_pbkdf2()
 {
@@ -47,11 +35,16 @@ void generate_and_verify_scrypt()
 static inline void
 _generate_and_verify(VbaAlgorithm algorithm)
 {
-    uint8_t mac_address[6] = {0};
+    static const uint32_t generate_label = Timing::Intern("gnv.generate");
+    static const uint32_t verify_label = Timing::Intern("gnv.verify");
+
+    MacAddress mac_address = {};
+    vba_salt_template_t salt;
+    init_salt_template(&salt, NULL);
 
     for (int i = 0, j = 0; i < FIXED_ITERS_COUNT; ++i, j += 2) {
         uint16_t iterations = _fixed_iter[i];
-        _roll_mac_address(mac_address, UINT64_MAX);
+        mac_address = MacAddress::FromU64(Xoshiro128p__next_bounded_any());
 
         uint64_t true_iter = algorithm == PBKDF2 ? iterations * ITERATIONS_FACTOR : iterations;
         printf("GENERATE AND VERIFY #%d (Algorithm %d):\n  Generate.\n\t%lu iterations\n\tVoucher: ",
@@ -62,20 +55,19 @@ _generate_and_verify(VbaAlgorithm algorithm)
             printf("%02x", global_voucher_seed[x]);
         printf("\n\tMAC: ");
         for (int x = 0; x < 6; ++x)
-            printf("%02x%s", mac_address[x], x != 5 ? "-" : "");
+            printf("%02x%s", mac_address.octets[x], x != 5 ? "-" : "");
         fflush(stdout);
 
         auto start_generate = std::chrono::high_resolution_clock::now();
+        uint64_t span_start = Timing::Now();
 
-        uint64_t legitimate_hash =
-            compute_address_hash_suffix(global_voucher_seed,
-                                        mac_address,
-                                        iterations,
-                                        algorithm);
-
-        uint64_t legitimate_suffix = build_address_suffix(iterations,
-                                                          legitimate_hash);
+        uint64_t legitimate_suffix = derive_address_suffix(global_voucher_seed,
+                                                           &salt,
+                                                           mac_address,
+                                                           iterations,
+                                                           algorithm).value;
 
+        Timing::Record(generate_label, span_start, Timing::Now(), iterations);
         auto end_generate = std::chrono::high_resolution_clock::now();
 
         printf("\n\tAddress: ");
@@ -83,12 +75,14 @@ _generate_and_verify(VbaAlgorithm algorithm)
 
         printf("\n  Verify.\n\t");
         auto start_verify = std::chrono::high_resolution_clock::now();
+        span_start = Timing::Now();
 
         bool verified = verify_address_suffix(legitimate_suffix,
                                               global_voucher_seed,
-                                              mac_address,
+                                              mac_address.octets,
                                               algorithm);
 
+        Timing::Record(verify_label, span_start, Timing::Now(), iterations);
         auto end_verify = std::chrono::high_resolution_clock::now();
 
         if (verified)
@@ -1,26 +1,14 @@
 #include "generator.h"
 
 
-static inline uint64_t rotl( const uint64_t x, int k ) {
-    return ( (x << k) | (x >> (64 - k)) );
-}
-
-
-static uint64_t s[2];
+static xoshiro128p_t s;
 static int s_seeded = 0;
 
 uint64_t
 Xoshiro128p__next_bounded(uint64_t low, uint64_t high)
 {
     const uint64_t range = 1 + high - low;
-
-    const uint64_t s0 = s[0];
-    uint64_t s1 = s[1];
-    const uint64_t result = s0 + s1;
-
-    s1 ^= s0;
-    s[0] = rotl( s0, 24 ) ^ s1 ^ (s1 << 16);
-    s[1] = rotl( s1, 37 );
+    const uint64_t result = Xoshiro128p__next( &s );
 
     return (
         ( high > low )
@@ -44,6 +32,46 @@ uint64_t Xoshiro128p__next_bounded_any()
     return Xoshiro128p__next_bounded(0, UINT64_MAX - 1);
 }
 
+void
+Xoshiro128p__jump(xoshiro128p_t *state)
+{
+    /* From the reference xoroshiro128+ (24, 16, 37) implementation. */
+    static const uint64_t JUMP[] = { 0xdf900294d8f554a5, 0x170865df4b3201fc };
+    uint64_t s0 = 0, s1 = 0;
+
+    for (int i = 0; i < 2; ++i) {
+        for (int b = 0; b < 64; ++b) {
+            if (JUMP[i] & (UINT64_C(1) << b)) {
+                s0 ^= state->s[0];
+                s1 ^= state->s[1];
+            }
+            Xoshiro128p__next( state );
+        }
+    }
+
+    state->s[0] = s0;
+    state->s[1] = s1;
+}
+
+void
+Xoshiro128p__split(xoshiro128p_t *stream)
+{
+    *stream = s;
+    Xoshiro128p__jump( &s );
+}
+
+void
+Xoshiro128p__fill(xoshiro128p_t *state, uint64_t *out, size_t count)
+{
+    /* A local copy keeps the state in registers rather than stored back per output. */
+    xoshiro128p_t local = *state;
+
+    for (size_t i = 0; i < count; ++i)
+        out[i] = Xoshiro128p__next( &local );
+
+    *state = local;
+}
+
 void
 Xoshiro128p__init()
 {
@@ -60,8 +88,8 @@ Xoshiro128p__init()
     tinymt64_init( p_prng_init, seed_value );
 
     // Seed Xoshiro128+.
-    s[0] = tinymt64_generate_uint64( p_prng_init );
-    s[1] = tinymt64_generate_uint64( p_prng_init );
+    s.s[0] = tinymt64_generate_uint64( p_prng_init );
+    s.s[1] = tinymt64_generate_uint64( p_prng_init );
 
     free( p_prng_init );
     s_seeded = 1;
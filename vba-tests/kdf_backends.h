@@ -0,0 +1,131 @@
+#ifndef _KDF_BACKENDS_H_
+#define _KDF_BACKENDS_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "vba.h"
+
+
+#define KDF_MAX_BACKENDS        8
+#define KDF_BACKEND_ENV         "VBA_KDF_BACKEND"
+#define KDF_SELECT_ITERATIONS   0x0004
+
+
+/*
+ * One implementation of one VBA algorithm. 'derive' receives the 16-byte voucher
+ *   seed, the complete salt, and the iteration count exactly as encoded in the
+ *   address (PBKDF2 backends apply ITERATIONS_FACTOR themselves). Returns 0 on
+ *   success.
+ */
+typedef int (*kdf_derive_fn)(const uint8_t *voucher_seed,
+                             const uint8_t *salt,
+                             size_t salt_len,
+                             uint16_t iterations,
+                             uint8_t *out,
+                             size_t out_len);
+
+/*
+ * Optional multi-buffer form of 'derive': 'count' derivations that share a salt
+ *   length, iteration count and output length. Returns 0 only if all succeeded.
+ */
+typedef int (*kdf_derive_batch_fn)(size_t count,
+                                   const uint8_t *const *voucher_seeds,
+                                   const uint8_t *const *salts,
+                                   size_t salt_len,
+                                   uint16_t iterations,
+                                   uint8_t *const *outs,
+                                   size_t out_len);
+
+typedef int (*kdf_supported_fn)(void);
+
+typedef struct _kdf_backend {
+    const char *name;
+    enum VbaAlgorithm algorithm;
+    kdf_supported_fn is_supported;   /* NULL when the backend runs everywhere. */
+    kdf_derive_fn derive;
+    kdf_derive_batch_fn derive_batch;   /* NULL when the backend has no batched kernel. */
+} kdf_backend_t;
+
+
+/*
+ * Registers the built-in backends, self-tests each against the first (reference)
+ *   backend of its algorithm, and applies any 'VBA_KDF_BACKEND' override such as
+ *   "pbkdf2=intree,scrypt=openssl". Safe to call more than once.
+ */
+void kdf_backends_init();
+
+/* Returns the backend's slot, or -1 if the registry for that algorithm is full. */
+int kdf_register_backend(const kdf_backend_t *backend);
+
+/* The backend 'compute_address_hash_suffix' dispatches to; NULL for unknown algorithms. */
+const kdf_backend_t *kdf_active_backend(enum VbaAlgorithm algorithm);
+
+/* Returns 0 on success, -1 if no verified backend has that name. */
+int kdf_force_backend(enum VbaAlgorithm algorithm, const char *name);
+
+/* Lets 'kdf_backends_autoselect' choose for this algorithm again. */
+void kdf_release_backend(enum VbaAlgorithm algorithm);
+int kdf_backend_is_forced(enum VbaAlgorithm algorithm);
+
+/* Parses "algorithm=backend[,algorithm=backend...]". Returns the number of overrides applied. */
+int kdf_force_backends_from_string(const char *spec);
+
+/* Lists the registered backends of an algorithm, verified or not. */
+size_t kdf_list_backends(enum VbaAlgorithm algorithm, const kdf_backend_t **out, size_t max);
+int kdf_backend_verified(const kdf_backend_t *backend);
+/* False when the CPU lacks what the backend needs; it is then not verified either. */
+int kdf_backend_supported(const kdf_backend_t *backend);
+
+/*
+ * With arenas on, the libargon2 backends reuse one buffer per thread, first written
+ *   by that thread, instead of allocating per hash. A thread pinned to a NUMA node
+ *   thus keeps its Argon2 memory on that node. Set it before starting threads.
+ */
+void kdf_use_thread_arenas(int enabled);
+
+/* Times every verified backend and activates the fastest. Returns its nanoseconds per call. */
+uint64_t kdf_backends_autoselect(enum VbaAlgorithm algorithm, uint16_t iterations, int verbose);
+
+/*
+ * The backend 'kdf_derive_batch' hands whole groups to: the active backend if it
+ *   has a batched kernel, otherwise the first verified one that does. NULL if none.
+ */
+const kdf_backend_t *kdf_active_batch_backend(enum VbaAlgorithm algorithm);
+
+/* Derives once with the active backend. Returns -1 without one. */
+int kdf_derive(enum VbaAlgorithm algorithm,
+               const uint8_t *voucher_seed,
+               const uint8_t *salt,
+               size_t salt_len,
+               uint16_t iterations,
+               uint8_t *out,
+               size_t out_len);
+
+/* Runs a group through the batch backend, or the active backend one at a time without one. */
+int kdf_derive_batch(enum VbaAlgorithm algorithm,
+                     size_t count,
+                     const uint8_t *const *voucher_seeds,
+                     const uint8_t *const *salts,
+                     size_t salt_len,
+                     uint16_t iterations,
+                     uint8_t *const *outs,
+                     size_t out_len);
+
+
+/*
+ * Optional tracing around every 'kdf_derive' and 'kdf_derive_batch' call. 'begin'
+ *   returns an opaque mark that is handed back to 'end' on the same thread together
+ *   with what was derived. Install or remove hooks before any thread is deriving;
+ *   NULL removes them.
+ */
+typedef struct _kdf_trace_hooks {
+    uint64_t (*begin)(void);
+    void (*end)(enum VbaAlgorithm algorithm, uint16_t iterations, size_t count, uint64_t mark);
+} kdf_trace_hooks_t;
+
+void kdf_set_trace_hooks(const kdf_trace_hooks_t *hooks);
+
+
+#endif /* _KDF_BACKENDS_H_ */
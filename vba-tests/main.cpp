@@ -18,6 +18,7 @@
 #include <string>
 
 #include "vba.h"
+#include "kdf_backends.h"
 #include "timing.hpp"
 #include "generator.h"
 
@@ -28,7 +29,7 @@
 
 #define RECORD_TIMES(test_name, method) \
     rotate_voucher_seed(); \
-    (method)(); \
+    { TimingSpan phase(Timing::Intern(test_name)); (method)(); } \
     Timing::DumpToCsv(#test_name, csv);
 
 
@@ -40,11 +41,27 @@ int main()
     std::stringstream csv;
     csv << "Test,Slot,Microseconds,Milliseconds,Seconds,Comment" << std::endl;
 
+    /* Self-test the registered KDF backends and use the fastest correct one of each. */
+    /*   Set VBA_KDF_BACKEND (e.g. "pbkdf2=intree") to pin a backend instead. */
+    printf("KDF backends:\n");
+    for (int a = 1; a < VBA_ALGORITHM_SLOTS; ++a)
+        kdf_backends_autoselect((VbaAlgorithm)a, KDF_SELECT_ITERATIONS, 1);
+    printf("\n");
+
+    /* With VBA_TIMING_TRACE set, every phase and KDF call is kept as a span; */
+    /*   name the file "*.json" to open it in chrome://tracing or Perfetto. */
+    if (Timing::TraceRequested())
+        Timing::TraceKdfCalls();
+
     /* The first benchmarking is done on random voucher-seed values of a fixed length. */
     /*   Let it walk up the iteration count for each and see how it performs. */
     RECORD_TIMES("BENCH_PBKDF2", benchmark_pbkdf2);
     RECORD_TIMES("BENCH_ARGON2", benchmark_argon2);
     RECORD_TIMES("BENCH_SCRYPT", benchmark_scrypt);
+    RECORD_TIMES("BENCH_ARGON2ID", benchmark_argon2id);
+    RECORD_TIMES("BENCH_ARGON2_LANES", benchmark_argon2_lanes);
+    RECORD_TIMES("BENCH_KDF_BACKENDS", benchmark_kdf_backends);
+    RECORD_TIMES("BENCH_KDF_STATISTICS", benchmark_kdf_statistics);
 
     /* The next tests analyze the performance of recipient machines. */
     /*   By nature of the algorithm, receivers spend the same time as generators. */
@@ -53,6 +70,18 @@ int main()
     RECORD_TIMES("GNV_ARGON2", generate_and_verify_argon2);
     RECORD_TIMES("GNV_SCRYPT", generate_and_verify_scrypt);
 
+    /* Repeated verification of the same neighbours, as a router would see it, */
+    /*   replayed with and without the verification cache in front of the KDF. */
+    RECORD_TIMES("BENCH_VERIFY_CACHE", benchmark_verify_cache);
+    RECORD_TIMES("BENCH_ASYNC_VERIFY", benchmark_async_verify);
+    RECORD_TIMES("BENCH_ASYNC_RESERVED", benchmark_async_reserved);
+    RECORD_TIMES("BENCH_VERIFY_POLICY", benchmark_verify_policy);
+    RECORD_TIMES("BENCH_KDF_INPUT", benchmark_kdf_input);
+    RECORD_TIMES("BENCH_VERIFY_BATCH", benchmark_verify_batch);
+    RECORD_TIMES("BENCH_CALIBRATION", benchmark_calibration);
+    RECORD_TIMES("BENCH_LLADDR_FORMAT", benchmark_lladdr_format);
+    RECORD_TIMES("BENCH_TIMING_OVERHEAD", benchmark_timing_overhead);
+
     /* The next tests are more targeted towards the purpose of VBAs. */
     /*   A few different fixed iteration counts are compared for security. */
 //    RECORD_TIMES("COLLISIONS_PBKDF2", find_collisions_pbkdf2);
@@ -70,4 +99,6 @@ int main()
 
     /* Output the CSV to the console. This can be changed later to write to a file. */
     printf("\n\n=================================\nFinal Data:\n%s", csv.str().c_str());
+
+    Timing::DumpEventsIfRequested();
 }
@@ -0,0 +1,497 @@
+#include <string.h>
+#include <cpuid.h>
+#include <immintrin.h>
+
+#include "pbkdf2_sha256.h"
+
+
+static const uint32_t _sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t _sha256_h0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+
+static inline uint32_t _rotr32(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+static inline uint32_t _load_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void _store_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+
+void sha256_compress_portable(uint32_t state[8], const uint8_t block[64])
+{
+    uint32_t w[64];
+
+    for (int i = 0; i < 16; ++i)
+        w[i] = _load_be32(&block[i * 4]);
+
+    for (int i = 16; i < 64; ++i) {
+        uint32_t s0 = _rotr32(w[i - 15], 7) ^ _rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = _rotr32(w[i - 2], 17) ^ _rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; ++i) {
+        uint32_t t1 = h + (_rotr32(e, 6) ^ _rotr32(e, 11) ^ _rotr32(e, 25)) + ((e & f) ^ (~e & g)) + _sha256_k[i] + w[i];
+        uint32_t t2 = (_rotr32(a, 2) ^ _rotr32(a, 13) ^ _rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+
+/* Appends SHA-256 padding for a message of 'total_len' bytes whose tail of 'used' bytes is in 'block'. */
+static inline void _pad_block(uint8_t block[64], size_t used, uint64_t total_len)
+{
+    block[used] = 0x80;
+    memset(&block[used + 1], 0, 56 - (used + 1));
+
+    uint64_t bits = total_len * 8;
+    for (int i = 0; i < 8; ++i)
+        block[63 - i] = (uint8_t)(bits >> (i * 8));
+}
+
+
+/*
+ * Key set-up and U_1 = HMAC(P, S || INT(1)). Leaves the absorbed inner and outer key
+ *   states, and U_1 as state words, for the iteration loop to continue from.
+ */
+static void _pbkdf2_prepare(sha256_compress_fn compress,
+                            const uint8_t *password, size_t password_len,
+                            const uint8_t *salt, size_t salt_len,
+                            uint32_t istate[8], uint32_t ostate[8], uint32_t state[8])
+{
+    uint8_t pad[64];
+
+    /* Absorb the HMAC keys once; every iteration starts from these two states. */
+    memset(pad, 0x36, sizeof(pad));
+    for (size_t i = 0; i < password_len; ++i) pad[i] ^= password[i];
+    memcpy(istate, _sha256_h0, sizeof(_sha256_h0));
+    compress(istate, pad);
+
+    memset(pad, 0x5c, sizeof(pad));
+    for (size_t i = 0; i < password_len; ++i) pad[i] ^= password[i];
+    memcpy(ostate, _sha256_h0, sizeof(_sha256_h0));
+    compress(ostate, pad);
+
+    /* U_1 = HMAC(P, S || INT(1)). */
+    uint8_t inner[64], outer[64];
+    memcpy(inner, salt, salt_len);
+    _store_be32(&inner[salt_len], 1);
+    _pad_block(inner, salt_len + 4, 64 + salt_len + 4);
+
+    /* The outer message is the 32-byte inner digest. */
+    _pad_block(outer, 32, 64 + 32);
+
+    memcpy(state, istate, sizeof(_sha256_h0));
+    compress(state, inner);
+    for (int i = 0; i < 8; ++i) _store_be32(&outer[i * 4], state[i]);
+
+    memcpy(state, ostate, sizeof(_sha256_h0));
+    compress(state, outer);
+}
+
+int pbkdf2_sha256_32(sha256_compress_fn compress,
+                     const uint8_t *password, size_t password_len,
+                     const uint8_t *salt, size_t salt_len,
+                     uint32_t rounds,
+                     uint8_t out[32])
+{
+    if (password_len > 64 || salt_len + 4 > 55 || !rounds) return -1;
+
+    uint32_t istate[8], ostate[8], state[8];
+    uint8_t inner[64], outer[64];
+
+    _pbkdf2_prepare(compress, password, password_len, salt, salt_len, istate, ostate, state);
+
+    uint32_t t[8];
+    memcpy(t, state, sizeof(t));
+
+    /* Every later block is a 32-byte digest behind a 64-byte key block: fixed padding. */
+    _pad_block(inner, 32, 64 + 32);
+    _pad_block(outer, 32, 64 + 32);
+
+    /* U_j = HMAC(P, U_{j-1}), two compressions each. */
+    for (uint32_t r = 1; r < rounds; ++r) {
+        for (int i = 0; i < 8; ++i) _store_be32(&inner[i * 4], state[i]);
+        memcpy(state, istate, sizeof(state));
+        compress(state, inner);
+
+        for (int i = 0; i < 8; ++i) _store_be32(&outer[i * 4], state[i]);
+        memcpy(state, ostate, sizeof(state));
+        compress(state, outer);
+
+        for (int i = 0; i < 8; ++i) t[i] ^= state[i];
+    }
+
+    for (int i = 0; i < 8; ++i) _store_be32(&out[i * 4], t[i]);
+
+    return 0;
+}
+
+
+/* ===== AVX2 multi-buffer ===== */
+
+#define _X8_ROTR(x, n)  _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+
+/*
+ * Eight SHA-256 compressions at once, one per 32-bit lane, of a block that is a
+ *   32-byte digest followed by the fixed HMAC padding (message length 96 bytes).
+ *   Words 8..15 of every such block are constants, so only the first eight vary.
+ */
+__attribute__((target("avx2")))
+static inline void _sha256_x8_compress_digest(__m256i state[8], const __m256i digest[8])
+{
+    __m256i w[64];
+
+    for (int i = 0; i < 8; ++i) w[i] = digest[i];
+    w[8] = _mm256_set1_epi32((int)0x80000000);
+    for (int i = 9; i < 15; ++i) w[i] = _mm256_setzero_si256();
+    w[15] = _mm256_set1_epi32((64 + 32) * 8);
+
+    for (int i = 16; i < 64; ++i) {
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(_X8_ROTR(w[i - 15], 7), _X8_ROTR(w[i - 15], 18)),
+                                      _mm256_srli_epi32(w[i - 15], 3));
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(_X8_ROTR(w[i - 2], 17), _X8_ROTR(w[i - 2], 19)),
+                                      _mm256_srli_epi32(w[i - 2], 10));
+        w[i] = _mm256_add_epi32(_mm256_add_epi32(w[i - 16], s0), _mm256_add_epi32(w[i - 7], s1));
+    }
+
+    __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+    __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; ++i) {
+        __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(_X8_ROTR(e, 6), _X8_ROTR(e, 11)), _X8_ROTR(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, S1),
+                                      _mm256_add_epi32(_mm256_add_epi32(ch, _mm256_set1_epi32((int)_sha256_k[i])), w[i]));
+
+        __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(_X8_ROTR(a, 2), _X8_ROTR(a, 13)), _X8_ROTR(a, 22));
+        __m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)),
+                                       _mm256_and_si256(b, c));
+        __m256i t2 = _mm256_add_epi32(S0, maj);
+
+        h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+        d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+    }
+
+    state[0] = _mm256_add_epi32(state[0], a); state[1] = _mm256_add_epi32(state[1], b);
+    state[2] = _mm256_add_epi32(state[2], c); state[3] = _mm256_add_epi32(state[3], d);
+    state[4] = _mm256_add_epi32(state[4], e); state[5] = _mm256_add_epi32(state[5], f);
+    state[6] = _mm256_add_epi32(state[6], g); state[7] = _mm256_add_epi32(state[7], h);
+}
+
+int pbkdf2_sha256_32_x8_supported(void)
+{
+    return !!__builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+int pbkdf2_sha256_32_x8(size_t count,
+                        const uint8_t *const *passwords, size_t password_len,
+                        const uint8_t *const *salts, size_t salt_len,
+                        uint32_t rounds,
+                        uint8_t *const *outs)
+{
+    if (!count || count > PBKDF2_SHA256_X8_LANES) return -1;
+    if (password_len > 64 || salt_len + 4 > 55 || !rounds) return -1;
+
+    /* Lane-major scalar set-up; unused lanes just repeat lane 0. */
+    uint32_t istate[PBKDF2_SHA256_X8_LANES][8];
+    uint32_t ostate[PBKDF2_SHA256_X8_LANES][8];
+    uint32_t ustate[PBKDF2_SHA256_X8_LANES][8];
+
+    for (size_t lane = 0; lane < PBKDF2_SHA256_X8_LANES; ++lane) {
+        size_t src = lane < count ? lane : 0;
+        _pbkdf2_prepare(sha256_compress_portable,
+                        passwords[src], password_len,
+                        salts[src], salt_len,
+                        istate[lane], ostate[lane], ustate[lane]);
+    }
+
+    /* Transpose to word-major vectors: vector j holds word j of every lane. */
+    __m256i I[8], O[8], U[8], T[8], S[8];
+    for (int j = 0; j < 8; ++j) {
+        I[j] = _mm256_setr_epi32(istate[0][j], istate[1][j], istate[2][j], istate[3][j],
+                                 istate[4][j], istate[5][j], istate[6][j], istate[7][j]);
+        O[j] = _mm256_setr_epi32(ostate[0][j], ostate[1][j], ostate[2][j], ostate[3][j],
+                                 ostate[4][j], ostate[5][j], ostate[6][j], ostate[7][j]);
+        U[j] = _mm256_setr_epi32(ustate[0][j], ustate[1][j], ustate[2][j], ustate[3][j],
+                                 ustate[4][j], ustate[5][j], ustate[6][j], ustate[7][j]);
+        T[j] = U[j];
+    }
+
+    for (uint32_t r = 1; r < rounds; ++r) {
+        for (int j = 0; j < 8; ++j) S[j] = I[j];
+        _sha256_x8_compress_digest(S, U);
+
+        for (int j = 0; j < 8; ++j) U[j] = O[j];
+        _sha256_x8_compress_digest(U, S);
+
+        for (int j = 0; j < 8; ++j) T[j] = _mm256_xor_si256(T[j], U[j]);
+    }
+
+    uint32_t words[8][PBKDF2_SHA256_X8_LANES];
+    for (int j = 0; j < 8; ++j)
+        _mm256_storeu_si256((__m256i *)words[j], T[j]);
+
+    for (size_t lane = 0; lane < count; ++lane)
+        for (int j = 0; j < 8; ++j)
+            _store_be32(&outs[lane][j * 4], words[j][lane]);
+
+    return 0;
+}
+
+
+/* ===== SHA extensions (SHA-NI) ===== */
+
+#define _SHANI_TARGET  __attribute__((target("sha,sse4.1,ssse3")))
+
+/* Word-order vectors (lane 0 = A) to the ABEF/CDGH layout 'sha256rnds2' works on. */
+_SHANI_TARGET
+static inline void _shani_to_abef(__m128i lo, __m128i hi, __m128i *abef, __m128i *cdgh)
+{
+    __m128i cdab = _mm_shuffle_epi32(lo, 0xB1);
+    __m128i efgh = _mm_shuffle_epi32(hi, 0x1B);
+
+    *abef = _mm_alignr_epi8(cdab, efgh, 8);
+    *cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+}
+
+_SHANI_TARGET
+static inline void _shani_from_abef(__m128i abef, __m128i cdgh, __m128i *lo, __m128i *hi)
+{
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+
+    *lo = _mm_blend_epi16(feba, dchg, 0xF0);
+    *hi = _mm_alignr_epi8(dchg, feba, 8);
+}
+
+/* Four rounds on 'wk' = W[i..i+3] + K[i..i+3]. */
+#define _SHANI_QUAD(abef, cdgh, wk)                                 \
+    do {                                                            \
+        __m128i _wk = (wk);                                         \
+        cdgh = _mm_sha256rnds2_epu32(cdgh, abef, _wk);              \
+        abef = _mm_sha256rnds2_epu32(abef, cdgh,                    \
+                                     _mm_shuffle_epi32(_wk, 0x0E)); \
+    } while (0)
+
+/* W[i+16..i+19] from W[i..i+15], four words per vector. */
+#define _SHANI_SCHEDULE(w0, w1, w2, w3)                             \
+    _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(w0, w1), \
+                                       _mm_alignr_epi8(w3, w2, 4)), w3)
+
+/* All 64 rounds over message words already in native order, then the feed-forward. */
+_SHANI_TARGET
+static inline void _shani_compress(__m128i *abef, __m128i *cdgh,
+                                   __m128i w0, __m128i w1, __m128i w2, __m128i w3)
+{
+    const __m128i *k = (const __m128i *)_sha256_k;
+    __m128i a = *abef, c = *cdgh;
+
+    for (int i = 0; i < 12; ++i) {
+        _SHANI_QUAD(a, c, _mm_add_epi32(w0, _mm_loadu_si128(&k[i])));
+
+        __m128i next = _SHANI_SCHEDULE(w0, w1, w2, w3);
+        w0 = w1; w1 = w2; w2 = w3; w3 = next;
+    }
+
+    _SHANI_QUAD(a, c, _mm_add_epi32(w0, _mm_loadu_si128(&k[12])));
+    _SHANI_QUAD(a, c, _mm_add_epi32(w1, _mm_loadu_si128(&k[13])));
+    _SHANI_QUAD(a, c, _mm_add_epi32(w2, _mm_loadu_si128(&k[14])));
+    _SHANI_QUAD(a, c, _mm_add_epi32(w3, _mm_loadu_si128(&k[15])));
+
+    *abef = _mm_add_epi32(*abef, a);
+    *cdgh = _mm_add_epi32(*cdgh, c);
+}
+
+/*
+ * The PBKDF2 inner loop only ever compresses a 32-byte digest plus fixed padding, so
+ *   the last two message vectors are constants and the block is never built in memory.
+ */
+_SHANI_TARGET
+static inline void _shani_compress_digest(__m128i *abef, __m128i *cdgh, __m128i lo, __m128i hi)
+{
+    static const uint32_t pad_words[8] = { 0x80000000, 0, 0, 0, 0, 0, 0, (64 + 32) * 8 };
+
+    _shani_compress(abef, cdgh, lo, hi,
+                    _mm_loadu_si128((const __m128i *)&pad_words[0]),
+                    _mm_loadu_si128((const __m128i *)&pad_words[4]));
+}
+
+int pbkdf2_sha256_shani_supported(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 0;
+    if (!(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3)) return 0;
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return 0;
+    return (ebx & bit_SHA) ? 1 : 0;
+}
+
+_SHANI_TARGET
+void sha256_compress_shani(uint32_t state[8], const uint8_t block[64])
+{
+    const __m128i swap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m128i abef, cdgh, lo, hi;
+
+    _shani_to_abef(_mm_loadu_si128((const __m128i *)&state[0]),
+                   _mm_loadu_si128((const __m128i *)&state[4]), &abef, &cdgh);
+
+    _shani_compress(&abef, &cdgh,
+                    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&block[0]), swap),
+                    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&block[16]), swap),
+                    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&block[32]), swap),
+                    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&block[48]), swap));
+
+    _shani_from_abef(abef, cdgh, &lo, &hi);
+    _mm_storeu_si128((__m128i *)&state[0], lo);
+    _mm_storeu_si128((__m128i *)&state[4], hi);
+}
+
+_SHANI_TARGET
+int pbkdf2_sha256_32_shani(const uint8_t *password, size_t password_len,
+                           const uint8_t *salt, size_t salt_len,
+                           uint32_t rounds,
+                           uint8_t out[32])
+{
+    if (password_len > 64 || salt_len + 4 > 55 || !rounds) return -1;
+
+    uint32_t istate[8], ostate[8], state[8];
+    _pbkdf2_prepare(sha256_compress_shani, password, password_len, salt, salt_len, istate, ostate, state);
+
+    /* Key states stay in the hardware layout; U and T stay as native-order words. */
+    __m128i i_abef, i_cdgh, o_abef, o_cdgh;
+    _shani_to_abef(_mm_loadu_si128((const __m128i *)&istate[0]),
+                   _mm_loadu_si128((const __m128i *)&istate[4]), &i_abef, &i_cdgh);
+    _shani_to_abef(_mm_loadu_si128((const __m128i *)&ostate[0]),
+                   _mm_loadu_si128((const __m128i *)&ostate[4]), &o_abef, &o_cdgh);
+
+    __m128i u_lo = _mm_loadu_si128((const __m128i *)&state[0]);
+    __m128i u_hi = _mm_loadu_si128((const __m128i *)&state[4]);
+    __m128i t_lo = u_lo, t_hi = u_hi;
+
+    for (uint32_t r = 1; r < rounds; ++r) {
+        __m128i abef = i_abef, cdgh = i_cdgh;
+        _shani_compress_digest(&abef, &cdgh, u_lo, u_hi);
+        _shani_from_abef(abef, cdgh, &u_lo, &u_hi);
+
+        abef = o_abef; cdgh = o_cdgh;
+        _shani_compress_digest(&abef, &cdgh, u_lo, u_hi);
+        _shani_from_abef(abef, cdgh, &u_lo, &u_hi);
+
+        t_lo = _mm_xor_si128(t_lo, u_lo);
+        t_hi = _mm_xor_si128(t_hi, u_hi);
+    }
+
+    const __m128i swap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    _mm_storeu_si128((__m128i *)&out[0], _mm_shuffle_epi8(t_lo, swap));
+    _mm_storeu_si128((__m128i *)&out[16], _mm_shuffle_epi8(t_hi, swap));
+
+    return 0;
+}
+
+/* Two chains' digest compressions in one body, so each fills the other's 'sha256rnds2' latency. */
+_SHANI_TARGET
+static inline void _shani_compress_digest_x2(__m128i abef[2], __m128i cdgh[2],
+                                             const __m128i lo[2], const __m128i hi[2])
+{
+    static const uint32_t pad_words[8] = { 0x80000000, 0, 0, 0, 0, 0, 0, (64 + 32) * 8 };
+    const __m128i *k = (const __m128i *)_sha256_k;
+
+    __m128i a0 = abef[0], c0 = cdgh[0], a1 = abef[1], c1 = cdgh[1];
+    __m128i w0[4] = { lo[0], hi[0],
+                      _mm_loadu_si128((const __m128i *)&pad_words[0]),
+                      _mm_loadu_si128((const __m128i *)&pad_words[4]) };
+    __m128i w1[4] = { lo[1], hi[1], w0[2], w0[3] };
+
+    for (int i = 0; i < 16; ++i) {
+        __m128i ki = _mm_loadu_si128(&k[i]);
+        _SHANI_QUAD(a0, c0, _mm_add_epi32(w0[i & 3], ki));
+        _SHANI_QUAD(a1, c1, _mm_add_epi32(w1[i & 3], ki));
+
+        if (i < 12) {
+            w0[i & 3] = _SHANI_SCHEDULE(w0[i & 3], w0[(i + 1) & 3], w0[(i + 2) & 3], w0[(i + 3) & 3]);
+            w1[i & 3] = _SHANI_SCHEDULE(w1[i & 3], w1[(i + 1) & 3], w1[(i + 2) & 3], w1[(i + 3) & 3]);
+        }
+    }
+
+    abef[0] = _mm_add_epi32(abef[0], a0); cdgh[0] = _mm_add_epi32(cdgh[0], c0);
+    abef[1] = _mm_add_epi32(abef[1], a1); cdgh[1] = _mm_add_epi32(cdgh[1], c1);
+}
+
+_SHANI_TARGET
+int pbkdf2_sha256_32_shani_x2(const uint8_t *const *passwords, size_t password_len,
+                              const uint8_t *const *salts, size_t salt_len,
+                              uint32_t rounds,
+                              uint8_t *const *outs)
+{
+    if (password_len > 64 || salt_len + 4 > 55 || !rounds) return -1;
+
+    __m128i i_abef[2], i_cdgh[2], o_abef[2], o_cdgh[2];
+    __m128i u_lo[2], u_hi[2], t_lo[2], t_hi[2];
+
+    for (int c = 0; c < 2; ++c) {
+        uint32_t istate[8], ostate[8], state[8];
+        _pbkdf2_prepare(sha256_compress_shani, passwords[c], password_len, salts[c], salt_len,
+                        istate, ostate, state);
+
+        _shani_to_abef(_mm_loadu_si128((const __m128i *)&istate[0]),
+                       _mm_loadu_si128((const __m128i *)&istate[4]), &i_abef[c], &i_cdgh[c]);
+        _shani_to_abef(_mm_loadu_si128((const __m128i *)&ostate[0]),
+                       _mm_loadu_si128((const __m128i *)&ostate[4]), &o_abef[c], &o_cdgh[c]);
+
+        t_lo[c] = u_lo[c] = _mm_loadu_si128((const __m128i *)&state[0]);
+        t_hi[c] = u_hi[c] = _mm_loadu_si128((const __m128i *)&state[4]);
+    }
+
+    for (uint32_t r = 1; r < rounds; ++r) {
+        __m128i abef[2] = { i_abef[0], i_abef[1] }, cdgh[2] = { i_cdgh[0], i_cdgh[1] };
+        _shani_compress_digest_x2(abef, cdgh, u_lo, u_hi);
+        for (int c = 0; c < 2; ++c) _shani_from_abef(abef[c], cdgh[c], &u_lo[c], &u_hi[c]);
+
+        abef[0] = o_abef[0]; abef[1] = o_abef[1]; cdgh[0] = o_cdgh[0]; cdgh[1] = o_cdgh[1];
+        _shani_compress_digest_x2(abef, cdgh, u_lo, u_hi);
+        for (int c = 0; c < 2; ++c) {
+            _shani_from_abef(abef[c], cdgh[c], &u_lo[c], &u_hi[c]);
+            t_lo[c] = _mm_xor_si128(t_lo[c], u_lo[c]);
+            t_hi[c] = _mm_xor_si128(t_hi[c], u_hi[c]);
+        }
+    }
+
+    const __m128i swap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    for (int c = 0; c < 2; ++c) {
+        _mm_storeu_si128((__m128i *)&outs[c][0], _mm_shuffle_epi8(t_lo[c], swap));
+        _mm_storeu_si128((__m128i *)&outs[c][16], _mm_shuffle_epi8(t_hi[c], swap));
+    }
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string.h>
+
+#include "verify_batch.hpp"
+#include "kdf_backends.h"
+
+
+typedef struct _batch_unit {
+    size_t first;   /* Offset into the sorted order. */
+    size_t count;
+    uint64_t cost;
+} batch_unit_t;
+
+
+static inline uint32_t _group_key(uint64_t suffix, VbaAlgorithm algorithm)
+{
+    return ((uint32_t)algorithm << 16) | get_suffix_iterations(suffix);
+}
+
+static void _verify_unit(const batch_unit_t& unit,
+                         const std::vector<size_t>& order,
+                         const vba_salt_template_t& salt_template,
+                         const uint64_t *suffixes,
+                         const uint8_t *mac_addresses,
+                         const uint8_t *voucher_seeds,
+                         const VbaAlgorithm *algorithms,
+                         bool *results)
+{
+    vba_salt_template_t salts[VERIFY_BATCH_UNIT];
+    uint8_t digests[VERIFY_BATCH_UNIT][32];
+
+    const uint8_t *seed_ptrs[VERIFY_BATCH_UNIT], *salt_ptrs[VERIFY_BATCH_UNIT];
+    uint8_t *out_ptrs[VERIFY_BATCH_UNIT];
+
+    for (size_t i = 0; i < unit.count; ++i) {
+        size_t entry = order[unit.first + i];
+
+        salts[i] = salt_template;
+        memcpy(&salts[i].bytes[0], &mac_addresses[entry * 6], 6);
+
+        seed_ptrs[i] = &voucher_seeds[entry * 16];
+        salt_ptrs[i] = salts[i].bytes;
+        out_ptrs[i] = digests[i];
+    }
+
+    size_t head = order[unit.first];
+    uint16_t iterations = get_suffix_iterations(suffixes[head]);
+
+    int status = kdf_derive_batch(algorithms[head], unit.count,
+                                  seed_ptrs, salt_ptrs, VBA_SALT_LENGTH,
+                                  iterations, out_ptrs, 32);
+
+    for (size_t i = 0; i < unit.count; ++i) {
+        size_t entry = order[unit.first + i];
+
+        /* Same truncation as 'compute_address_hash_suffix': the first 8 bytes of the hash. */
+        results[entry] = 0 == status
+            && build_address_suffix(iterations, *((uint64_t *)&digests[i][0])) == suffixes[entry];
+    }
+}
+
+
+size_t verify_address_suffix_batch(size_t count,
+                                   const uint64_t *suffixes,
+                                   const uint8_t *mac_addresses,
+                                   const uint8_t *voucher_seeds,
+                                   const VbaAlgorithm *algorithms,
+                                   bool *results,
+                                   unsigned int threads)
+{
+    if (!count) return 0;
+
+    /* Sort entry indices so every (algorithm, iterations) group is contiguous. */
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; ++i) order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return _group_key(suffixes[a], algorithms[a]) < _group_key(suffixes[b], algorithms[b]);
+    });
+
+    /* Cut each group into units no wider than the batched kernels. */
+    std::vector<batch_unit_t> units;
+    for (size_t start = 0; start < count; ) {
+        uint32_t key = _group_key(suffixes[order[start]], algorithms[order[start]]);
+
+        size_t end = start;
+        while (end < count && end - start < VERIFY_BATCH_UNIT
+               && _group_key(suffixes[order[end]], algorithms[order[end]]) == key)
+            ++end;
+
+        uint64_t cost = estimate_address_cost(get_suffix_iterations(suffixes[order[start]]),
+                                              algorithms[order[start]]);
+        units.push_back({ start, end - start, cost });
+        start = end;
+    }
+
+    /* Longest units first so the last one to finish is a short one. */
+    std::stable_sort(units.begin(), units.end(), [](const batch_unit_t& a, const batch_unit_t& b) {
+        return a.cost > b.cost;
+    });
+
+    vba_salt_template_t salt_template;
+    init_salt_template(&salt_template, NULL);
+
+    if (!threads) threads = std::thread::hardware_concurrency();
+    if (!threads) threads = 1;
+    if (threads > units.size()) threads = (unsigned int)units.size();
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t u = next.fetch_add(1); u < units.size(); u = next.fetch_add(1))
+            _verify_unit(units[u], order, salt_template,
+                         suffixes, mac_addresses, voucher_seeds, algorithms, results);
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+
+    worker();
+
+    for (auto& thread : pool)
+        thread.join();
+
+    size_t verified = 0;
+    for (size_t i = 0; i < count; ++i)
+        verified += results[i] ? 1 : 0;
+
+    return verified;
+}
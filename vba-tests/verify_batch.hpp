@@ -0,0 +1,33 @@
+#ifndef _VERIFY_BATCH_H_
+#define _VERIFY_BATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vba.h"
+
+
+/* Largest group handed to one 'kdf_derive_batch' call; matches the widest kernel. */
+#define VERIFY_BATCH_UNIT   8
+
+
+/*
+ * Verifies 'count' suffixes at once, e.g. a whole neighbour table on refresh.
+ *   'mac_addresses' holds 6 bytes per entry and 'voucher_seeds' 16 bytes per entry.
+ *
+ * Entries are grouped by (algorithm, iteration count) so each group can go through
+ *   the batched kernel of the algorithm's KDF backend, and the groups are spread
+ *   across 'threads' workers, most expensive first. Zero threads means
+ *   'std::thread::hardware_concurrency'. 'results' receives one flag per entry and
+ *   the number of suffixes that verified is returned.
+ */
+size_t verify_address_suffix_batch(size_t count,
+                                   const uint64_t *suffixes,
+                                   const uint8_t *mac_addresses,
+                                   const uint8_t *voucher_seeds,
+                                   const VbaAlgorithm *algorithms,
+                                   bool *results,
+                                   unsigned int threads = 0);
+
+
+#endif /* _VERIFY_BATCH_H_ */
@@ -0,0 +1,296 @@
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#include "verify_cache.hpp"
+
+
+static inline uint64_t _mix64(uint64_t x)
+{
+    /* SplitMix64 finalizer. Cheap and good enough to spread keys across shards. */
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static inline uint64_t _nanoseconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+static inline bool _keys_equal(const verification_key_t& a, const verification_key_t& b)
+{
+    return a.suffix == b.suffix
+        && a.algorithm == b.algorithm
+        && 0 == memcmp(a.mac_address, b.mac_address, sizeof(a.mac_address))
+        && 0 == memcmp(a.voucher_seed, b.voucher_seed, sizeof(a.voucher_seed));
+}
+
+
+verification_key_t VerificationCache::MakeKey(uint64_t suffix,
+                                              const uint8_t* voucher_seed,
+                                              const uint8_t* mac_address,
+                                              VbaAlgorithm algorithm)
+{
+    verification_key_t key;
+    memset(&key, 0, sizeof(key));
+
+    memcpy(key.voucher_seed, voucher_seed, sizeof(key.voucher_seed));
+    memcpy(key.mac_address, mac_address, sizeof(key.mac_address));
+    key.suffix = suffix;
+    key.algorithm = algorithm;
+
+    return key;
+}
+
+uint64_t VerificationCache::HashKey(const verification_key_t& key)
+{
+    uint64_t seed_lo, seed_hi, mac = 0;
+    memcpy(&seed_lo, &key.voucher_seed[0], sizeof(uint64_t));
+    memcpy(&seed_hi, &key.voucher_seed[8], sizeof(uint64_t));
+    memcpy(&mac, key.mac_address, sizeof(key.mac_address));
+
+    uint64_t h = _mix64(seed_lo ^ ((uint64_t)key.algorithm << 56));
+    h = _mix64(h ^ seed_hi);
+    h = _mix64(h ^ mac);
+    h = _mix64(h ^ key.suffix);
+
+    return h;
+}
+
+
+VerificationCache::Entry* VerificationCache::ClockTable::Find(const verification_key_t& key,
+                                                              uint64_t hash)
+{
+    auto it = index.find(hash);
+    if (it == index.end()) return NULL;
+
+    Entry* entry = &slots[it->second];
+    return _keys_equal(entry->key, key) ? entry : NULL;
+}
+
+/* Returns true when an existing entry had to be evicted to make room. */
+bool VerificationCache::ClockTable::Put(const verification_key_t& key, uint64_t hash)
+{
+    if (slots.empty()) return false;
+
+    /* A full-hash collision with a different key simply takes over that slot. */
+    auto it = index.find(hash);
+    if (it != index.end()) {
+        Entry* entry = &slots[it->second];
+        entry->key = key;
+        entry->referenced = true;
+        return false;
+    }
+
+    /* Sweep the hand until an unreferenced (or empty) slot turns up. */
+    while (slots[hand].occupied && slots[hand].referenced) {
+        slots[hand].referenced = false;
+        hand = (hand + 1) % slots.size();
+    }
+
+    Entry* victim = &slots[hand];
+    bool evicted = victim->occupied;
+    if (evicted) index.erase(victim->hash);
+
+    victim->key = key;
+    victim->hash = hash;
+    victim->occupied = true;
+    victim->referenced = false;
+    index[hash] = hand;
+
+    hand = (hand + 1) % slots.size();
+    return evicted;
+}
+
+bool VerificationCache::ClockTable::Erase(const verification_key_t& key, uint64_t hash)
+{
+    Entry* entry = Find(key, hash);
+    if (!entry) return false;
+
+    index.erase(hash);
+    entry->occupied = false;
+    entry->referenced = false;
+    return true;
+}
+
+void VerificationCache::ClockTable::Clear()
+{
+    for (auto& entry : slots) {
+        entry.occupied = false;
+        entry.referenced = false;
+    }
+    index.clear();
+    hand = 0;
+}
+
+
+VerificationCache::VerificationCache(unsigned int shard_count,
+                                     unsigned int capacity,
+                                     unsigned int negative_capacity)
+    : shard_count(shard_count ? shard_count : 1),
+      negative_enabled(negative_capacity > 0),
+      lookups(0), hits(0), negative_hits(0), misses(0),
+      insertions(0), evictions(0), lookup_nanoseconds(0), verify_nanoseconds(0)
+{
+    unsigned int per_shard = (capacity + this->shard_count - 1) / this->shard_count;
+    unsigned int negative_per_shard = (negative_capacity + this->shard_count - 1) / this->shard_count;
+
+    shards = new Shard[this->shard_count];
+
+    for (unsigned int i = 0; i < this->shard_count; ++i) {
+        shards[i].positive.slots.resize(per_shard ? per_shard : 1);
+        shards[i].positive.index.reserve(per_shard);
+        shards[i].negative.slots.resize(negative_per_shard);
+        shards[i].negative.index.reserve(negative_per_shard);
+
+        shards[i].positive.Clear();
+        shards[i].negative.Clear();
+    }
+}
+
+VerificationCache::~VerificationCache()
+{
+    delete[] shards;
+}
+
+
+VerificationCache::Shard& VerificationCache::_ShardFor(uint64_t hash)
+{
+    /* The low bits pick the slot index in the map, so use the high bits here. */
+    return shards[(hash >> 32) % shard_count];
+}
+
+
+bool VerificationCache::Lookup(const verification_key_t& key, bool* result)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    uint64_t hash = HashKey(key);
+    Shard& shard = _ShardFor(hash);
+    Entry* entry = NULL;
+    bool outcome = false;
+
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        if ((entry = shard.positive.Find(key, hash))) {
+            outcome = true;
+        } else if (negative_enabled) {
+            entry = shard.negative.Find(key, hash);
+        }
+
+        if (entry) entry->referenced = true;
+    }
+
+    lookups.fetch_add(1, std::memory_order_relaxed);
+    lookup_nanoseconds.fetch_add(_nanoseconds_since(start), std::memory_order_relaxed);
+
+    if (!entry) {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    (outcome ? hits : negative_hits).fetch_add(1, std::memory_order_relaxed);
+    *result = outcome;
+    return true;
+}
+
+void VerificationCache::Insert(const verification_key_t& key, bool result)
+{
+    if (!result && !negative_enabled) return;
+
+    uint64_t hash = HashKey(key);
+    Shard& shard = _ShardFor(hash);
+    bool evicted = false;
+
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        if (result) {
+            shard.negative.Erase(key, hash);
+            evicted = shard.positive.Put(key, hash);
+        } else {
+            evicted = shard.negative.Put(key, hash);
+        }
+    }
+
+    insertions.fetch_add(1, std::memory_order_relaxed);
+    if (evicted) evictions.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool VerificationCache::Verify(uint64_t suffix,
+                               uint8_t* voucher_seed,
+                               uint8_t* mac_address,
+                               VbaAlgorithm algorithm)
+{
+    verification_key_t key = MakeKey(suffix, voucher_seed, mac_address, algorithm);
+
+    bool result = false;
+    if (Lookup(key, &result)) return result;
+
+    auto start = std::chrono::steady_clock::now();
+
+    result = verify_address_suffix(suffix, voucher_seed, mac_address, algorithm);
+
+    verify_nanoseconds.fetch_add(_nanoseconds_since(start), std::memory_order_relaxed);
+
+    Insert(key, result);
+    return result;
+}
+
+
+void VerificationCache::Clear()
+{
+    for (unsigned int i = 0; i < shard_count; ++i) {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        shards[i].positive.Clear();
+        shards[i].negative.Clear();
+    }
+}
+
+verification_cache_stats_t VerificationCache::GetStats() const
+{
+    verification_cache_stats_t stats = {
+        lookups.load(std::memory_order_relaxed),
+        hits.load(std::memory_order_relaxed),
+        negative_hits.load(std::memory_order_relaxed),
+        misses.load(std::memory_order_relaxed),
+        insertions.load(std::memory_order_relaxed),
+        evictions.load(std::memory_order_relaxed),
+        lookup_nanoseconds.load(std::memory_order_relaxed),
+        verify_nanoseconds.load(std::memory_order_relaxed),
+    };
+    return stats;
+}
+
+void VerificationCache::ResetStats()
+{
+    lookups = 0;
+    hits = 0;
+    negative_hits = 0;
+    misses = 0;
+    insertions = 0;
+    evictions = 0;
+    lookup_nanoseconds = 0;
+    verify_nanoseconds = 0;
+}
+
+void VerificationCache::PrintStats() const
+{
+    verification_cache_stats_t stats = GetStats();
+
+    double hit_rate = stats.lookups
+        ? 100.0 * (stats.hits + stats.negative_hits) / stats.lookups : 0.0;
+
+    printf("\tLookups: %lu    Hits: %lu    Negative hits: %lu    Misses: %lu    (hit rate %.2f%%)\n",
+           stats.lookups, stats.hits, stats.negative_hits, stats.misses, hit_rate);
+    printf("\tInsertions: %lu    Evictions: %lu\n", stats.insertions, stats.evictions);
+    printf("\tMean lookup: %.1f ns    Mean verification on miss: %.1f us\n",
+           stats.lookups ? (double)stats.lookup_nanoseconds / stats.lookups : 0.0,
+           stats.misses ? (double)stats.verify_nanoseconds / stats.misses / 1000.0 : 0.0);
+}
@@ -0,0 +1,123 @@
+#ifndef _VERIFY_CACHE_H_
+#define _VERIFY_CACHE_H_
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "vba.h"
+
+
+#define VERIFY_CACHE_DEFAULT_SHARDS     16
+#define VERIFY_CACHE_DEFAULT_CAPACITY   4096
+#define VERIFY_CACHE_DEFAULT_NEGATIVE   1024
+
+
+/*
+ * Everything that determines the outcome of 'verify_address_suffix'. The seed is
+ *   always read as 16 bytes by the KDFs, so the key does the same.
+ */
+typedef struct _verification_key {
+    uint8_t voucher_seed[16];
+    uint8_t mac_address[6];
+    uint64_t suffix;
+    VbaAlgorithm algorithm;
+} verification_key_t;
+
+typedef struct _verification_cache_stats {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t negative_hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+    uint64_t lookup_nanoseconds;
+    uint64_t verify_nanoseconds;
+} verification_cache_stats_t;
+
+
+/*
+ * A bounded, sharded cache of address verification results. Each shard is a pair of
+ *   fixed-size CLOCK tables: one for addresses which verified, one (optional) for
+ *   those which did not. Keeping failures in their own smaller table means a flood
+ *   of bogus suffixes can only churn the negative side and never evicts neighbours
+ *   that are known to be good.
+ *
+ * Results are deterministic for a given key, so entries never expire; they only
+ *   age out through CLOCK eviction.
+ */
+class VerificationCache
+{
+public:
+    VerificationCache(unsigned int shard_count = VERIFY_CACHE_DEFAULT_SHARDS,
+                      unsigned int capacity = VERIFY_CACHE_DEFAULT_CAPACITY,
+                      unsigned int negative_capacity = VERIFY_CACHE_DEFAULT_NEGATIVE);
+    ~VerificationCache();
+
+    /* Drop-in replacement for 'verify_address_suffix' which consults the cache first. */
+    bool Verify(uint64_t suffix,
+                uint8_t* voucher_seed,
+                uint8_t* mac_address,
+                VbaAlgorithm algorithm);
+
+    /* Returns true on a hit and writes the cached outcome to 'result'. */
+    bool Lookup(const verification_key_t& key, bool* result);
+    void Insert(const verification_key_t& key, bool result);
+
+    void Clear();
+
+    verification_cache_stats_t GetStats() const;
+    void ResetStats();
+    void PrintStats() const;
+
+    static verification_key_t MakeKey(uint64_t suffix,
+                                      const uint8_t* voucher_seed,
+                                      const uint8_t* mac_address,
+                                      VbaAlgorithm algorithm);
+    static uint64_t HashKey(const verification_key_t& key);
+
+private:
+    struct Entry {
+        verification_key_t key;
+        uint64_t hash;
+        bool occupied;
+        bool referenced;
+    };
+
+    struct ClockTable {
+        std::vector<Entry> slots;
+        std::unordered_map<uint64_t, uint32_t> index;
+        uint32_t hand;
+
+        Entry* Find(const verification_key_t& key, uint64_t hash);
+        bool Put(const verification_key_t& key, uint64_t hash);
+        bool Erase(const verification_key_t& key, uint64_t hash);
+        void Clear();
+    };
+
+    struct alignas(64) Shard {
+        std::mutex lock;
+        ClockTable positive;
+        ClockTable negative;
+    };
+
+    Shard& _ShardFor(uint64_t hash);
+
+    unsigned int shard_count;
+    bool negative_enabled;
+    Shard* shards;
+
+    std::atomic<uint64_t> lookups;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> negative_hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> insertions;
+    std::atomic<uint64_t> evictions;
+    std::atomic<uint64_t> lookup_nanoseconds;
+    std::atomic<uint64_t> verify_nanoseconds;
+};
+
+
+#endif /* _VERIFY_CACHE_H_ */
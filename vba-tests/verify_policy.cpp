@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "verify_policy.hpp"
+
+
+#define POLICY_DEFAULT_CEILING  0x1000
+
+
+verification_policy_config_t verification_policy_default_config()
+{
+    verification_policy_config_t config;
+    memset(&config, 0, sizeof(config));
+
+    config.max_iterations[PBKDF2] = POLICY_DEFAULT_CEILING;
+    config.max_iterations[ARGON2] = POLICY_DEFAULT_CEILING;
+    config.max_iterations[SCRYPT] = POLICY_DEFAULT_CEILING;
+    config.max_iterations[ARGON2ID] = POLICY_DEFAULT_CEILING;
+    config.max_iterations[ARGON2D_LANES] = POLICY_DEFAULT_CEILING;
+    config.max_iterations[ARGON2ID_LANES] = POLICY_DEFAULT_CEILING;
+    config.min_iterations = 1;
+
+    /* Enough for a few verifications at the ceiling in a burst, one per second after. */
+    config.source_budget = 4 * estimate_address_cost(POLICY_DEFAULT_CEILING, PBKDF2);
+    config.source_refill_per_second = estimate_address_cost(POLICY_DEFAULT_CEILING, PBKDF2);
+    config.source_slots = 4096;
+
+    return config;
+}
+
+const char* policy_decision_name(PolicyDecision decision)
+{
+    switch (decision) {
+        case POLICY_ALLOW:              return "allow";
+        case POLICY_REJECT_ALGORITHM:   return "reject-algorithm";
+        case POLICY_REJECT_ITERATIONS:  return "reject-iterations";
+        case POLICY_REJECT_MAC:         return "reject-mac";
+        case POLICY_REJECT_BUDGET:      return "reject-budget";
+        default:                        return "unknown";
+    }
+}
+
+
+VerificationPolicy::VerificationPolicy(const verification_policy_config_t& config)
+    : config(config), admitted_cost(0), refused_cost(0)
+{
+    if (!this->config.source_slots) this->config.source_slots = 1;
+
+    Bucket full = { this->config.source_budget, std::chrono::steady_clock::now() };
+    buckets.assign(this->config.source_slots, full);
+
+    for (int i = 0; i < POLICY_DECISION_COUNT; ++i)
+        decisions[i] = 0;
+}
+
+
+PolicyDecision VerificationPolicy::PreCheck(uint64_t suffix,
+                                            const uint8_t* mac_address,
+                                            VbaAlgorithm algorithm) const
+{
+    if (algorithm <= 0 || algorithm >= VBA_ALGORITHM_SLOTS || !config.max_iterations[algorithm])
+        return POLICY_REJECT_ALGORITHM;
+
+    uint16_t iterations = get_suffix_iterations(suffix);
+    if (iterations < config.min_iterations || iterations > config.max_iterations[algorithm])
+        return POLICY_REJECT_ITERATIONS;
+
+    /* The I/G bit marks a group address; no neighbour can own one. */
+    if (mac_address[0] & 0x01)
+        return POLICY_REJECT_MAC;
+
+    if (!(mac_address[0] | mac_address[1] | mac_address[2]
+          | mac_address[3] | mac_address[4] | mac_address[5]))
+        return POLICY_REJECT_MAC;
+
+    return POLICY_ALLOW;
+}
+
+
+bool VerificationPolicy::_Charge(uint64_t source, uint64_t cost)
+{
+    if (!config.source_budget) return true;
+
+    /* Fibonacci hashing onto the fixed bucket table. */
+    size_t slot = (size_t)((source * 0x9E3779B97F4A7C15ULL) >> 32) % buckets.size();
+    auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> guard(lock);
+    Bucket& bucket = buckets[slot];
+
+    double elapsed = std::chrono::duration<double>(now - bucket.refilled).count();
+    uint64_t refill = (uint64_t)(elapsed * config.source_refill_per_second);
+
+    if (refill) {
+        bucket.tokens = bucket.tokens + refill > config.source_budget
+            ? config.source_budget : bucket.tokens + refill;
+        bucket.refilled = now;
+    }
+
+    if (cost > bucket.tokens) return false;
+
+    bucket.tokens -= cost;
+    return true;
+}
+
+PolicyDecision VerificationPolicy::Admit(uint64_t source,
+                                         uint64_t suffix,
+                                         const uint8_t* mac_address,
+                                         VbaAlgorithm algorithm)
+{
+    PolicyDecision decision = PreCheck(suffix, mac_address, algorithm);
+    uint64_t cost = estimate_address_cost(get_suffix_iterations(suffix), algorithm);
+
+    if (POLICY_ALLOW == decision && !_Charge(source, cost))
+        decision = POLICY_REJECT_BUDGET;
+
+    decisions[decision].fetch_add(1, std::memory_order_relaxed);
+    (POLICY_ALLOW == decision ? admitted_cost : refused_cost)
+        .fetch_add(UINT64_MAX == cost ? 0 : cost, std::memory_order_relaxed);
+
+    return decision;
+}
+
+bool VerificationPolicy::Verify(uint64_t source,
+                                uint64_t suffix,
+                                uint8_t* voucher_seed,
+                                uint8_t* mac_address,
+                                VbaAlgorithm algorithm,
+                                PolicyDecision* decision)
+{
+    PolicyDecision d = Admit(source, suffix, mac_address, algorithm);
+    if (decision) *decision = d;
+
+    if (POLICY_ALLOW != d) return false;
+
+    return verify_address_suffix(suffix, voucher_seed, mac_address, algorithm);
+}
+
+
+uint64_t VerificationPolicy::Decisions(PolicyDecision decision) const
+{
+    return decisions[decision].load(std::memory_order_relaxed);
+}
+
+void VerificationPolicy::PrintStats() const
+{
+    printf("\tDecisions:");
+    for (int i = 0; i < POLICY_DECISION_COUNT; ++i)
+        printf("  %s=%lu", policy_decision_name((PolicyDecision)i), Decisions((PolicyDecision)i));
+    printf("\n\tAdmitted cost: %lu    Refused cost: %lu\n", AdmittedCost(), RefusedCost());
+}
@@ -0,0 +1,94 @@
+#ifndef _VERIFY_POLICY_H_
+#define _VERIFY_POLICY_H_
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+#include "vba.h"
+
+
+enum PolicyDecision
+{
+    POLICY_ALLOW = 0,
+    POLICY_REJECT_ALGORITHM,    /* Algorithm unknown or disabled on this node. */
+    POLICY_REJECT_ITERATIONS,   /* Encoded iteration count outside [min, ceiling]. */
+    POLICY_REJECT_MAC,          /* Group (multicast) or all-zero link-layer address. */
+    POLICY_REJECT_BUDGET,       /* The source has spent its KDF budget for now. */
+    POLICY_DECISION_COUNT,
+};
+
+typedef struct _verification_policy_config {
+    /* Highest iteration count accepted per algorithm. Zero disables the algorithm. */
+    uint16_t max_iterations[VBA_ALGORITHM_SLOTS];
+    uint16_t min_iterations;
+    /* Token bucket per source, in 'estimate_address_cost' units. Zero capacity disables budgets. */
+    uint64_t source_budget;
+    uint64_t source_refill_per_second;
+    /* Buckets are a fixed hashed table; sources that collide share a budget. */
+    unsigned int source_slots;
+} verification_policy_config_t;
+
+verification_policy_config_t verification_policy_default_config();
+
+const char* policy_decision_name(PolicyDecision decision);
+
+
+/*
+ * Cheap admission checks in front of 'verify_address_suffix'. Everything needed to
+ *   refuse a request is available without running the KDF: the algorithm, the MAC,
+ *   and the iteration count the sender encoded into the top 16 bits of the suffix.
+ *   Requests are charged their estimated cost against a per-source token bucket, so
+ *   a single neighbour cannot force this node to spend unbounded CPU on it.
+ */
+class VerificationPolicy
+{
+public:
+    VerificationPolicy(const verification_policy_config_t& config = verification_policy_default_config());
+
+    /* Pure pre-check; no budget is charged. */
+    PolicyDecision PreCheck(uint64_t suffix,
+                            const uint8_t* mac_address,
+                            VbaAlgorithm algorithm) const;
+
+    /* Pre-check, then charge the source's budget if the request is allowed. */
+    PolicyDecision Admit(uint64_t source,
+                         uint64_t suffix,
+                         const uint8_t* mac_address,
+                         VbaAlgorithm algorithm);
+
+    /* 'verify_address_suffix' behind 'Admit'. Rejected requests are never verified. */
+    bool Verify(uint64_t source,
+                uint64_t suffix,
+                uint8_t* voucher_seed,
+                uint8_t* mac_address,
+                VbaAlgorithm algorithm,
+                PolicyDecision* decision = NULL);
+
+    uint64_t Decisions(PolicyDecision decision) const;
+    uint64_t AdmittedCost() const { return admitted_cost.load(std::memory_order_relaxed); }
+    uint64_t RefusedCost() const { return refused_cost.load(std::memory_order_relaxed); }
+    void PrintStats() const;
+
+private:
+    struct Bucket {
+        uint64_t tokens;
+        std::chrono::steady_clock::time_point refilled;
+    };
+
+    bool _Charge(uint64_t source, uint64_t cost);
+
+    verification_policy_config_t config;
+
+    std::mutex lock;
+    std::vector<Bucket> buckets;
+
+    std::atomic<uint64_t> decisions[POLICY_DECISION_COUNT];
+    std::atomic<uint64_t> admitted_cost;
+    std::atomic<uint64_t> refused_cost;
+};
+
+
+#endif /* _VERIFY_POLICY_H_ */